@@ -33,8 +33,10 @@ AM_INIT_AUTOMAKE([-Wall -Werror])
 
 AC_SEARCH_LIBS([log10], [m], , IS_REQUIRED)
 AC_SEARCH_LIBS([clock_gettime], [rt], , IS_REQUIRED)
+AC_SEARCH_LIBS([pthread_create], [pthread], , IS_REQUIRED)
 
 AC_SEARCH_LIBS([nanosleep])
+AC_SEARCH_LIBS([dlopen], [dl])
 
 AC_CHECK_HEADERS([malloc.h])
 AC_CHECK_HEADERS([unistd.h])
@@ -48,6 +50,9 @@ AC_CHECK_DECLS([strlen, malloc, free], , IS_REQUIRED)
 #AC_CHECK_DECLS([O_LARGEFILE]) # does not work, use direct test instead
 AC_CHECK_DECLS([nanosleep],,,[#define _GNU_SOURCE 1
 #include <time.h>])
+AC_CHECK_DECLS([dlopen],,,[#include <dlfcn.h>])
+AC_CHECK_DECLS([vmsplice],,,[#define _GNU_SOURCE 1
+#include <fcntl.h>])
 AC_CHECK_DECLS([random])
 AC_CHECK_DECLS([exp10])
 AC_CHECK_DECLS([lseek64])
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+# Copyright 2010-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+#
+# Email: tst@1und1.de
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#####################################################################
+
+# Static cache analysis: compute the miss-ratio curve of a load
+# and optionally simulate some cache sizes, before booking hardware
+# time for replays against real caches (see also 27_cachecade.sh).
+#
+# usage: cache_sim.sh *.load.gz
+#
+# environment:
+#   sample_rate=0.01            fast mode: spatial sampling of blocks
+#   cache_sizes="1g,16g,128g"   simulate these cache sizes
+#   cache_policy=lru|arc|all    default all
+#   write_policy=back|through|around   default back
+#   cache_block=8               cache block size in sectors
+
+# check some preconditions
+script_dir="$(cd "$(dirname "$(which "$0")")"; pwd)"
+source "$script_dir/modules/lib.sh" || exit $?
+
+check_list="zcat basename sed"
+check_installed "$check_list"
+
+sample_rate="${sample_rate:-1}"
+cache_policy="${cache_policy:-all}"
+write_policy="${write_policy:-back}"
+cache_block="${cache_block:-8}"
+
+if (( !$# )); then
+    echo "usage: $0 <load-files>"
+    exit -1
+fi
+
+name="$(basename "$1" | sed 's/\.\(load\|replay\)\(\.gz\)\?$//')"
+opts="--block=$cache_block --sample=$sample_rate --mrc=$name.mrc"
+[ -n "$cache_sizes" ] && opts="$opts --sizes=$cache_sizes --policy=$cache_policy --write=$write_policy"
+
+# fail on errors of zcat or cache_sim.exe, not only of tee
+set -o pipefail
+zcat -f "$@" | "$bin_dir/cache_sim.exe" $opts | tee $name.cache_sim.log || exit $?
+set +o pipefail
+
+if which gnuplot >/dev/null 2>&1; then
+    echo "---> plot on $name.mrc.png"
+    gnuplot <<EOP
+set term png small size 1200,800;
+set output "$name.mrc.png";
+set title '$name miss-ratio curve (sample rate $sample_rate)';
+set logscale x;
+set xlabel 'LRU Cache Size [MiB]';
+set ylabel 'Miss Ratio';
+set yrange [0:1];
+plot '$name.mrc' using 1:2 title 'Reads+Writes' with lines, '$name.mrc' using 1:3 title 'Reads' with lines;
+EOP
+fi
@@ -50,6 +50,16 @@ script_dir="$(cd "$(dirname "$(which "$0")")"; pwd)"
 noecho=1
 source "$script_dir/modules/lib.sh" || exit $?
 
+# prefer the native comparator: it streams both inputs, tolerates
+# kernel merges / splits and reports timing and reordering statistics.
+# The blktrace is taken at the dispatch level by default (action_char=D).
+# set use_diff=1 for the old textual diff.
+if (( !use_diff )) && [ -x "$bin_dir/check_replay.exe" ] && [ -x "$bin_dir/blktrace_to_load.exe" ]; then
+    "$bin_dir/check_replay.exe" $check_replay_options "$replay" \
+	<("$bin_dir/blktrace_to_load.exe" --action=${action_char:-D} "$blktrace" - 2>/dev/null)
+    exit $?
+fi
+
 check_list="mkfifo grep sed cut gunzip diff blkparse"
 check_installed "$check_list"
 
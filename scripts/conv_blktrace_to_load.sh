@@ -44,6 +44,18 @@ script_dir="$(cd "$(dirname "$(which "$0")")"; pwd)"
 noecho=1
 source "$script_dir/modules/lib.sh" || exit $?
 
+# prefer the native converter: it reads the per-cpu files directly,
+# decodes them in parallel and produces the same output in one pass.
+# set use_blkparse=1 for the old blkparse(1) pipeline.
+if (( !use_blkparse )) && [ -x "$bin_dir/blktrace_to_load.exe" ]; then
+    header="${TMPDIR:-/tmp}/blktrace_to_load.$$"
+    echo_copyright "$filename.blktrace.*" > "$header" || exit $?
+    "$bin_dir/blktrace_to_load.exe" ${action_char:+--action=$action_char} --header="$header" "$filename" "$output"
+    status=$?
+    rm -f "$header"
+    exit $status
+fi
+
 check_list="grep sed cut head gzip blkparse"
 check_installed "$check_list"
 
@@ -27,6 +27,17 @@
 script_dir="$(cd "$(dirname "$(which "$0")")"; pwd)"
 source "$script_dir/modules/lib.sh" || exit $?
 
+# prefer the native importer, which produces one output per disk
+# in a single streaming pass. set use_gawk=1 for the old pipeline.
+if (( !use_gawk )) && [ -x "$bin_dir/trace_to_load.exe" ]; then
+    header="${TMPDIR:-/tmp}/trace_to_load.$$"
+    echo_copyright "$1" > "$header" || exit $?
+    "$bin_dir/trace_to_load.exe" --format=diskmon --split --header="$header" "$1"
+    status=$?
+    rm -f "$header"
+    exit $status
+fi
+
 check_list="grep sed cut gzip zcat gawk"
 check_installed "$check_list"
 
@@ -56,6 +56,30 @@ function from_start
 tmp="${TMPDIR:-/tmp}/snippets.$$"
 mkdir -p $tmp/s || exit $?
 
+base="$(basename "$1" | sed 's/\.\(load\|gz\|[0-9]\+\)//g')"
+
+# prefer the native tool: it creates the snippets in a single pass
+# and compresses all outputs of all splits in parallel, with identical
+# results (except for the date in the copyright header).
+# set use_gawk=1 for the old pipelines.
+if (( !use_gawk )) && [ -x "$bin_dir/derive_load.exe" ]; then
+    {
+	echo_copyright "$(basename "$1")..."
+	echo "start ; sector; length ; op ;  replay_delay ; replay_duration"
+    } > $tmp/header
+    cat "$@" |\
+	gunzip -f |\
+	"$bin_dir/derive_load.exe" \
+	--window=$window \
+	--splits="$split_list" \
+	--base="$base" \
+	--header=$tmp/header \
+	--tmp=$tmp
+    rc=$?
+    rm -rf $tmp
+    exit $rc
+fi
+
 echo "Creating snippets. This may take a long time...." 1>&2
 limit=$window
 snippet=0
@@ -97,8 +121,6 @@ cat "$@" |\
     echo "------------------------------------------------" 1>&2
 }
 
-base="$(basename "$1" | sed 's/\.\(load\|gz\|[0-9]\+\)//g')"
-
 for max in $split_list; do
     max_num=$(echo $max | sed 's/^0*//')
     dir="${base}.derived.split.$max"
@@ -0,0 +1,79 @@
+#!/usr/bin/env bash
+# Copyright 2010-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+#
+# Email: tst@1und1.de
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#####################################################################
+
+# Fit a statistical model to a natural load, and generate synthetic
+# loads of any length and scale from it, e.g. for capacity planning.
+# In contrast to the derived loads (create_derived_load.sh), no
+# request of the original is replayed as such.
+#
+# usage: create_synthetic_load.sh <load-files>
+#
+# The model is kept in <name>.model and reused when present.
+# Result: <name>.synthetic.load.gz
+#
+# environment:
+#   duration=<seconds>      length of the result (default: as the original)
+#   rate=<factor>           speed up the arrivals (default 1)
+#   space=<factor>          spread the positions (default 1)
+#   scale=<instances>       independent instances side by side (default 1)
+#   seed=<number>           (default 0)
+#   check_fit=1             refit the result and print its summary
+
+# check some preconditions
+script_dir="$(cd "$(dirname "$(which "$0")")"; pwd)"
+source "$script_dir/modules/lib.sh" || exit $?
+
+check_list="zcat gzip basename sed"
+check_installed "$check_list"
+
+if (( !$# )); then
+    echo "usage: $0 <load-files>"
+    exit -1
+fi
+
+name="$(basename "$1" | sed 's/\.\(load\|replay\)\(\.gz\)\?$//')"
+
+# fail on errors of any stage, not only of the last one
+set -o pipefail
+
+if ! [ -s "$name.model" ]; then
+    echo "Fitting $name.model"
+    zcat -f "$@" | "$bin_dir/fit_load.exe" > "$name.model.tmp" || exit $?
+    mv "$name.model.tmp" "$name.model"
+fi
+
+opts="--model=$name.model --rate=${rate:-1} --space=${space:-1} --scale=${scale:-1} --seed=${seed:-0}"
+[ -n "$duration" ] && opts="$opts --duration=$duration"
+
+echo "Generating $name.synthetic.load.gz"
+{
+    echo_copyright "$name.model"
+    "$bin_dir/gen_load.exe" $opts
+} | gzip -8 > "$name.synthetic.load.gz" ||\
+    { status=$?; rm -f "$name.synthetic.load.gz"; exit $status; }
+set +o pipefail
+
+if (( check_fit )); then
+    # sanity check: the summary of the result on stderr should
+    # resemble the one printed when fitting the original
+    echo "Checking $name.synthetic.load.gz"
+    zcat "$name.synthetic.load.gz" | "$bin_dir/fit_load.exe" > /dev/null
+fi
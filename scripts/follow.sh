@@ -0,0 +1,135 @@
+#!/usr/bin/env bash
+# Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+#
+# Email: tst@1und1.de
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#####################################################################
+
+# Live graphs of a running replay.
+#
+# Follows the output of blkreplay while it is being written, and
+# refreshes the throughput, latency-realtime and delay graphs every
+# <interval> seconds. Only the aggregated statistics of follow.exe
+# are plotted, so the cost of a refresh does not grow with the
+# length of the replay. Long soak tests can thus be watched, and
+# failing ones can be cut short.
+#
+# usage: follow.sh [--interval=<sec>] [--slot=<sec>] [--name=<name>] <file.replay> | -
+#
+# When the input is '-', stdin is read until EOF (this is used by
+# 90_graph.sh via graph_live_interval). Otherwise the file is followed
+# like tail -F until you press Ctrl-C.
+#
+# Output: <name>.live.{thrp,latency,delay,latency.raster}.$picturetype
+# and <name>.live.status
+
+# check some preconditions
+script_dir="$(cd "$(dirname "$(which "$0")")"; pwd)"
+noecho=1
+source "$script_dir/modules/lib.sh" || exit $?
+
+check_list="tail sed gnuplot"
+check_installed "$check_list"
+
+interval=10
+slot=1
+name=""
+picturetype="${picturetype:-png}"
+pictureoptions="${pictureoptions:-small size 1200,800}"
+
+while [ $# -gt 1 ]; do
+    case "$1" in
+	--interval=*)
+	interval="${1#*=}"
+	;;
+	--slot=*)
+	slot="${1#*=}"
+	;;
+	--name=*)
+	name="${1#*=}"
+	;;
+	*)
+	echo "unknown option '$1'"
+	exit -1
+	;;
+    esac
+    shift
+done
+
+if (( $# != 1 )); then
+    echo "usage: $0 [--interval=<sec>] [--slot=<sec>] [--name=<name>] <file.replay> | -"
+    exit -1
+fi
+
+input="$1"
+if [ -z "$name" ]; then
+    name="$(basename "$input" | sed 's/\.replay\(\.gz\)\?$//')"
+    [ "$name" = "-" ] && name="stdin"
+fi
+out="$name.live"
+
+function live_plot
+{
+    local status="$(cat $out.status 2>/dev/null)"
+    gnuplot <<EOP
+set term $picturetype $pictureoptions;
+set xlabel 'Real Duration [sec]';
+set output "$out.thrp.$picturetype";
+set title "$name throughput (live, slot ${slot}s) $status";
+set ylabel 'Requests per Second';
+plot '$out.thrp' using 1:2 title 'Reads' with lines lc rgb "#00BFFF", '$out.thrp' using 1:3 title 'Writes' with lines lc rgb "#FF0000";
+set output "$out.latency.$picturetype";
+set title "$name latency (live, slot ${slot}s) $status";
+set ylabel 'Latency [sec]';
+set logscale y;
+plot '$out.latency' using 1:2 title 'Reads avg' with lines lc rgb "#00BFFF", '$out.latency' using 1:3 title 'Writes avg' with lines lc rgb "#FF0000", '$out.latency' using 1:5 title 'p99' with lines lc rgb "#CDCD00", '$out.latency' using 1:4 title 'max' with points lc rgb "#A020F0";
+set output "$out.delay.$picturetype";
+set title "$name delay (live, slot ${slot}s) $status";
+set ylabel 'Delay [sec]';
+plot '$out.delay' using 1:2 title 'avg' with lines lc rgb "#00EE00", '$out.delay' using 1:4 title 'p99' with lines lc rgb "#CDCD00", '$out.delay' using 1:3 title 'max' with points lc rgb "#A020F0";
+unset logscale y;
+set output "$out.latency.raster.$picturetype";
+set title "$name latency (live density) $status";
+set ylabel 'log10(Latency [sec])';
+set cblabel 'log10(1 + Requests)';
+set palette defined (0 "white", 0.01 "light-blue", 1 "blue", 2 "green", 3 "yellow", 4 "red", 5 "black");
+set autoscale fix;
+plot '$out.latency.raster' notitle with image;
+EOP
+}
+
+if [ "$input" = "-" ]; then
+    follow_cmd="cat"
+else
+    follow_cmd="tail -c +1 -F \"$input\""
+    [[ "$input" = *.gz ]] && follow_cmd="$follow_cmd | gunzip"
+fi
+
+echo "---> live plots on $out.*.$picturetype every $interval seconds"
+eval "$follow_cmd" |\
+    "$bin_dir/follow.exe" --interval=$interval --slot=$slot --out="$out" |\
+    while read cmd nr requests rest; do
+	case "$cmd" in
+	    REFRESH)
+	    # nothing to plot before the first request has completed
+	    (( requests > 0 )) && live_plot 2>/dev/null
+	    ;;
+	    *)
+	    echo "$cmd $nr $requests $rest"
+	    ;;
+	esac
+    done
@@ -30,6 +30,15 @@ bad_latency="${bad_latency:-5.0}" # seconds
 bad_delay="${bad_delay:-10.0}" # seconds
 bad_ignore="${bad_ignore:-1}" # the n'th exceeding the limit
 ws_list="${ws_list:-000 001 006 060 600}"
+ws_block="${ws_block:-1}" # sectors per workingset key (native analyzer only)
+# density rasters for the sonar diagrams (native analyzer only), given as
+# <width>x<height>, or "auto" for the size from $pictureoptions.
+# They replace the per-point latency.realtime plots. empty = off.
+raster_size="${raster_size:-}"
+# cache for the results of the native analyzer, keyed by a content hash
+# of the inputs and all analyzer options. empty = off.
+graph_cache_dir="${graph_cache_dir:-}"
+analyze_threads="${analyze_threads:-}" # empty = all CPUs
 
 # defaults for colors (RGB values)
 
@@ -347,6 +356,9 @@ function gawk_thrps
     gawk -F ";" "$gawk_cmd"
 }
 
+# the old fifo/gawk pipelines, see the native analyzer below
+function gawk_pipelines
+{
 # produce throughput graphics always
 mkfifo $mainfifo.all.sort2.thr{p,s}
 cat $mainfifo.all.sort2.thrp |\
@@ -494,14 +506,8 @@ for mode in reads writes r_push w_push all; do
 	    $out.g00.$outp.thrs.completed &
 	mkfifo $inp.nosort.dyn.6
 	cat $inp.nosort.dyn.6 |\
-	    cut -d ';' -f 7 |\
-	    $bin_dir/bins.exe >\
-	    $out.g06.$outp.latency.bins &
-	mkfifo $inp.nosort.dyn.7
-	cat $inp.nosort.dyn.7 |\
-	    cut -d ';' -f 6 |\
-	    $bin_dir/bins.exe >\
-	    $out.g07.$outp.delay.bins &
+	    $bin_dir/bins.exe --columns=6,7 \
+	    --out=$out.g07.$outp.delay.bins,$out.g06.$outp.latency.bins &
 	mkfifo $inp.nosort.dyn.8
 	mkfifo $side.latency.flying.stat
 	cat $inp.nosort.dyn.8 |\
@@ -706,6 +712,60 @@ zcat -f $(cat $tmp/files) > "$tmp/fifo.master" &
 # really start all the background pipelines by this in _foreground_ ...
 
 start_time="$(grep " started at " < $prefifo.main | sed 's/^.*started at //' | (head -1; cat > /dev/null))"
+}
+
+# prefer the native analyzer: it reads the input only once and writes
+# all data files in a single pass. set use_gawk=1 for the old pipelines.
+if (( !use_gawk )) && [ -x "$bin_dir/analyze.exe" ]; then
+    if (( verbose_mode )); then
+	extra_modes="submit_level pushback_level submit_ahead submit_lag answer_lag submit_lag_cumul answer_lag_cumul input_wait answer_wait input_wait_cumul answer_wait_cumul"
+    fi
+    analyze_opts=""
+    (( static_mode )) && analyze_opts="$analyze_opts --static"
+    (( dynamic_mode )) && analyze_opts="$analyze_opts --dynamic"
+    (( verbose_mode )) && analyze_opts="$analyze_opts --verbose"
+    if [ "$raster_size" = "auto" ]; then
+	raster_size="$(echo "$pictureoptions" | sed -n 's/.*size \([0-9]\+\),\([0-9]\+\).*/\1x\2/p')"
+    fi
+    [ -n "$raster_size" ] && analyze_opts="$analyze_opts --raster=$raster_size"
+    analyze_threads_opt=""
+    [ -n "$analyze_threads" ] && analyze_threads_opt="--threads=$analyze_threads"
+    analyze_opts="--thrp-window=$thrp_window --turn-window=$turn_window --smooth-window=$smooth_latency_flying_window --bad-latency=$bad_latency --bad-delay=$bad_delay --ws-block=$ws_block$analyze_opts"
+    cache_file=""
+    if [ -n "$graph_cache_dir" ] && mkdir -p "$graph_cache_dir"; then
+	# the key covers everything the analyzer output depends on
+	cache_key="$(
+	    echo "$name $analyze_opts --ws-list=$ws_list"
+	    sha1sum < "$bin_dir/analyze.exe"
+	    for file in $(cat $tmp/files); do
+		sha1sum < "$file"
+	    done
+	    )"
+	cache_file="$graph_cache_dir/$(echo "$cache_key" | sha1sum | cut -d' ' -f1).tar.gz"
+    fi
+    if [ -n "$cache_file" ] && [ -s "$cache_file" ] && tar -C "$tmp" -xzf "$cache_file"; then
+	echo "Using cached analyzer results $cache_file"
+	touch "$cache_file"
+    else
+	echo "Starting native analyzer...."
+	zcat -f $(cat $tmp/files) |\
+	    $bin_dir/analyze.exe \
+	    --out="$out" \
+	    --tmp="$tmp" \
+	    --ws-list="$ws_list" \
+	    $analyze_threads_opt \
+	    $analyze_opts || exit $?
+	if [ -n "$cache_file" ]; then
+	    # only regular files, written by the analyzer
+	    (cd "$tmp" && find . -maxdepth 1 -type f ! -name files ! -name "names*" ! -name this -printf "%P\n" |\
+		tar -czf "$cache_file.$$" -T - && mv "$cache_file.$$" "$cache_file") ||\
+		rm -f "$cache_file.$$"
+	fi
+    fi
+    start_time="$(cat $tmp/start_time)"
+else
+    gawk_pipelines
+fi
 
 echo "Waiting for completion..."
 wait
@@ -1147,6 +1207,37 @@ EOF
     (( sequential_mode )) && wait
 done
 
+# density rasters: one picture per mode, rendered as heat map
+for raster_file in $tmp/*.raster.*; do
+    [ -s $raster_file ] || continue
+    title=$(basename $raster_file | sed 's/\.raster//')
+    (( is_fake )) && title="$title.FAKE"
+    case $raster_file in
+	*.realtime)
+	xlabel="Real Duration [sec]"
+	;;
+	*.sector)
+	xlabel="Request Position in Device [GiB]"
+	;;
+    esac
+    echo "---> plot on $title.raster.$picturetype"
+    (
+	<<EOF gnuplot
+	set term $picturetype $pictureoptions;
+	set output "$title.raster.$picturetype";
+	set title "$title (density) $start_time";
+	set ylabel 'log10(Latency [sec])';
+	set xlabel '$xlabel';
+	set cblabel 'log10(1 + Requests per Pixel)';
+	set palette defined (0 "white", 0.01 "light-blue", 1 "blue", 2 "green", 3 "yellow", 4 "red", 5 "black");
+	set autoscale fix;
+	$fake_label
+	plot '$raster_file' notitle with image;
+EOF
+    ) &
+    (( sequential_mode )) && wait
+done
+
 echo "Final wait..."
 wait
 echo "Done all plots."
@@ -181,14 +181,14 @@ function main_run
     for i in $(eval echo {0..$replay_max}); do
 	options=""
 	# list of parameterless options
-	optlist="dry_run fake_io o_direct no_o_direct o_sync no_o_sync no_dispatcher"
+	optlist="dry_run fake_io o_direct no_o_direct o_sync no_o_sync no_dispatcher numa_auto search_speedup dependency_replay"
 	for opt in $optlist; do
 	    if eval "(( $opt ))"; then
 		options="$options --$(echo $opt | sed 's/_/-/g')"
 	    fi
 	done
 	# list of options with parameters
-	optlist="replay_start replay_duration replay_out start_grace strong threads speedup fan_out bottleneck simulate_io ahead_limit verbose fill_random"
+	optlist="replay_start replay_duration replay_out start_grace strong threads speedup fan_out bottleneck simulate_io ahead_limit verbose fill_random cpus_main cpus_submit cpus_answer cpus_worker numa_node closed_loop closed_loop_max closed_loop_step search_interval search_percentile search_latency search_lag search_precision dependency_gap"
 	for opt in $optlist; do
 	    if eval "[ -n \"\$$opt\" ]"; then
 		options="$options --$(echo $opt | sed 's/_/-/g')=$(eval echo \$${opt})"
@@ -209,6 +209,7 @@ function main_run
 	    *)
 	    ;;
 	esac
+	options="$options$native_filter_list"
 	blkreplay="./blkreplay.exe $options ${replay_device[$i]} "
 	#echo "$blkreplay"
 	cmd="$buffer_cmd | $blkreplay | $buffer_cmd"
@@ -258,6 +259,7 @@ cleanup_list="main_cleanup"
 finish_list="main_finish"
 input_pipe_list="echo 'you did not implement any filters'"
 output_pipe_list="echo 'you did not implement any filters'"
+native_filter_list=""
 
 function main
 {
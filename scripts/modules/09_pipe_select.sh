@@ -23,6 +23,10 @@ function pipe_select_prepare
 {
     (( !enable_pipe_select )) && return 0
     echo "$FUNCNAME selecting [$pipe_select_from,$pipe_select_to] from the input"
+    if (( pipe_native )); then
+	native_filter_list="$native_filter_list --filter-select=$pipe_select_from,$pipe_select_to"
+	return 0
+    fi
     input_pipe_list="$input_pipe_list | gawk -F ';' '{ if (\$1 >= $pipe_select_from && \$1 < $pipe_select_to) print; }'"
     return 0
 }
@@ -23,6 +23,10 @@ function pipe_slip_prepare
 {
     (( !enable_pipe_slip )) && return 0
     echo "$FUNCNAME slipping each $pipe_slip_every requests by $pipe_slip_increase sectors"
+    if (( pipe_native )); then
+	native_filter_list="$native_filter_list --filter-slip=$pipe_slip_every,$pipe_slip_increase"
+	return 0
+    fi
     input_pipe_list="$input_pipe_list | gawk -F';' 'BEGIN { offset = 0; step = 0; } !/[a-z]/ && /[0-9] ;/ { if (++step >= $pipe_slip_every) { offset += $pipe_slip_increase; step = 0; } printf(\"%s ; %10d ; %s ; %s ; %s ; %s\n\", \$1, \$2 + offset, \$3, \$4, \$5, \$6); }'"
     return 0
 }
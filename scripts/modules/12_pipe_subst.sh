@@ -23,6 +23,10 @@ function pipe_subst_prepare
 {
     (( !enable_pipe_subst )) && return 0
     echo "$FUNCNAME substituting $pipe_subst_from by $pipe_subst_to"
+    if (( pipe_native )); then
+	native_filter_list="$native_filter_list --filter-subst=$pipe_subst_from,$pipe_subst_to"
+	return 0
+    fi
     input_pipe_list="$input_pipe_list | sed 's/ $pipe_subst_from / $pipe_subst_to /i'"
     return 0
 }
@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+# Copyright 2010-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+#
+# Email: tst@1und1.de
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#####################################################################
+
+function pipe_sample_prepare
+{
+    (( !enable_pipe_sample )) && return 0
+    local spec="space=$pipe_sample_space,block=$pipe_sample_block,rescale=$pipe_sample_rescale,time=$pipe_sample_time,window=$pipe_sample_window,seed=$pipe_sample_seed"
+    echo "$FUNCNAME sampling $spec"
+    if (( pipe_native )); then
+	native_filter_list="$native_filter_list --filter-sample=$spec"
+	return 0
+    fi
+    local opts="--space=$pipe_sample_space --block=$pipe_sample_block --time=$pipe_sample_time --window=$pipe_sample_window --seed=$pipe_sample_seed"
+    (( pipe_sample_rescale )) && opts="$opts --rescale"
+    # the summary on stderr reports the sampling error against the full input
+    input_pipe_list="$input_pipe_list | \"$bin_dir/sample_load.exe\" $opts"
+    return 0
+}
+
+prepare_list="$prepare_list pipe_sample_prepare"
@@ -23,6 +23,9 @@ function pipe_cmd_prepare
 {
     (( !enable_pipe_cmd )) && return 0
     echo "$FUNCNAME executing pipe command '$pipe_cmd'"
+    if [ -n "$native_filter_list" ]; then
+	echo "$FUNCNAME WARNING: pipe_cmd runs _before_ the native filters"
+    fi
     input_pipe_list="$input_pipe_list | ($pipe_cmd)"
     return 0
 }
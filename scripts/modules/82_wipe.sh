@@ -26,7 +26,7 @@ function wipe_setup
     (( !enable_wipe )) && return 0
     echo "$FUNCNAME filling all devices with random data"
     for i in $(eval echo {0..$replay_max}); do
-	cmd="time ./random_data.exe | dd of=${replay_device[$i]} bs=128k"
+	cmd="time ./random_data.exe | dd of=${replay_device[$i]} bs=1M iflag=fullblock"
 	echo "host $host: running command '$cmd'"
 	remote "${replay_host[$i]}" "$cmd" &
     done
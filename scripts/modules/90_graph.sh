@@ -19,6 +19,18 @@
 
 #####################################################################
 
+function graph_live_prepare
+{
+    (( !enable_graph || !graph_live_interval )) && return 0
+    echo "$FUNCNAME refreshing live graphs every $graph_live_interval seconds"
+    # tee a copy of each result stream into follow.sh,
+    # evaluated for each device in main_run
+    output_pipe_list="$output_pipe_list | tee >(\"$script_dir/follow.sh\" --interval=$graph_live_interval --name=\"\${output_file[\$i]%.replay.gz}\" - > /dev/null 2>&1)"
+    return 0
+}
+
+prepare_list="$prepare_list graph_live_prepare"
+
 function graph_finish
 {
     (( !enable_graph )) && return 0
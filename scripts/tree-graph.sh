@@ -22,8 +22,61 @@
 script_dir="$(cd "$(dirname "$(which "$0")")"; pwd)"
 source "$script_dir/modules/lib.sh" || exit $?
 
+# Graph all directories in parallel, up to max_jobs at a time. The
+# cpu_budget (default: number of CPUs) is divided among them.
+# The analyzer results are cached in graph_cache_dir by a content hash
+# of the inputs, so re-rendering after a change of graph.sh or the
+# graph options does not recompute them. Cache entries which were not
+# used for graph_cache_days (default: 30) are removed at startup;
+# graph_cache_days="" keeps them forever.
+#
+# A directory is regenerated when its graph.stamp does not match the
+# current inputs, graph.sh, analyze.exe and the *.conf files in the
+# directory and its parents.
+
+job_log="${job_log:-graph.log}"
+export graph_cache_dir="${graph_cache_dir-$HOME/.cache/blkreplay/graph}"
+graph_cache_days="${graph_cache_days-30}"
+
+check_list="sha1sum tar nproc find"
+check_installed "$check_list"
+
+# graph.sh touches a cache entry on each use, so this evicts by last use
+if [ -n "$graph_cache_dir" ] && [ -n "$graph_cache_days" ] && [ -d "$graph_cache_dir" ]; then
+    find "$graph_cache_dir" -maxdepth 1 -type f -name "*.tar.gz*" -mtime +$graph_cache_days -delete
+fi
+cpu_budget="${cpu_budget:-$(nproc)}"
+max_jobs="${max_jobs:-$cpu_budget}"
+
+function graph_stamp
+{
+    local dir="$1"
+    local limit=0
+    {
+	sha1sum < "$script_dir/graph.sh"
+	sha1sum < "$bin_dir/analyze.exe"
+	dir="$(cd "$dir"; pwd)"
+	while (( limit++ <= 20 )); do
+	    cat "$dir"/*.conf 2>/dev/null
+	    [ "$dir" = "/" ] && break
+	    dir="$(dirname "$dir")"
+	done
+	for file in "$1"/*.replay.gz; do
+	    echo "$(basename "$file") $(sha1sum < "$file")"
+	done
+    } | sha1sum | cut -d' ' -f1
+}
+
+function is_finished
+{
+    local test_dir="$1"
+    ls $test_dir/*.png > /dev/null 2>&1 &&\
+	[ -r $test_dir/graph.stamp ] &&\
+	[ "$(cat $test_dir/graph.stamp)" = "$(graph_stamp $test_dir)" ]
+}
+
 to_produce="png"
 to_check="replay.gz"
-to_start="nice $script_dir/graph.sh \$graph_options *.replay.gz"
+to_start="analyze_threads=\$(( (cpu_budget + max_jobs - 1) / max_jobs )) nice $script_dir/graph.sh \$graph_options *.replay.gz && graph_stamp . > graph.stamp"
 
 source "$script_dir/tree-replay.sh"
\ No newline at end of file
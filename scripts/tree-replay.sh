@@ -30,6 +30,9 @@ source "$script_dir/modules/lib.sh" || exit $?
 to_produce="${to_produce:-replay.gz}"
 to_check="${to_check:-}"
 to_start="${to_start:-main}"
+# number of directories processed in parallel
+max_jobs="${max_jobs:-1}"
+job_log="${job_log:-tree-job.log}"
 
 dry_run_script=0
 verbose_script=0
@@ -75,6 +78,10 @@ while [ $# -ge 1 ]; do
         work_dir="$val"
 	shift
         ;;
+	--jobs)
+	max_jobs="$val"
+	shift
+	;;
 	--test | --dry-run)
         dry_run_script="$val"
 	shift
@@ -91,6 +98,59 @@ while [ $# -ge 1 ]; do
     esac
 done
 
+# may be overridden by the caller, e.g. for detection of stale results
+if ! declare -f is_finished > /dev/null; then
+    function is_finished
+    {
+	local test_dir="$1"
+	ls $test_dir/*.$to_produce > /dev/null 2>&1
+    }
+fi
+
+function run_dir
+{
+    (
+	cd $test_dir
+	# source additional user modules (if available)
+	source_config "user_modules" || echo "(ignored)"
+	shopt -s nullglob
+	for module in $user_module_dir/[0-9]*.sh; do
+	    source_module "$module"
+	done
+
+	# source all individual config files (for overrides)
+	shopt -s nullglob
+	for i in $(echo $test_dir | sed 's/\// /g'); do
+	    [ "$i" = "." ] && continue
+	    if ! source_config "$i"; then
+		echo "Cannot source config file '$i.conf' -- please provide one."
+		exit -1
+	    fi
+	done
+	shopt -u nullglob
+
+	export sub_prefix=$(echo $test_dir | sed 's/\//./g' | sed 's/\.\././g')
+	if (( dry_run_script )); then
+	    echo "==> Dry Run ..."
+	    touch dry-run.$to_produce
+	else
+	    echo "==> $(date) Starting $sub_prefix"
+	    eval "$to_start" || { echo "Replay failure $?"; exit -1; }
+	fi
+	echo "==> $(date) Finished."
+    )
+}
+
+# wait until at most $1 parallel jobs are running
+job_failures=0
+function wait_jobs
+{
+    local limit="$1"
+    while (( $(jobs -rp | wc -l) > limit )); do
+	wait -n || { echo "Failure $?"; (( job_failures++ )); }
+    done
+}
+
 ignore_cmd="grep -v '[/.]old' | grep -v 'ignore'"
 sort_cmd="while read i; do if [ -e \"\$i\"/prio-[0-9]* ]; then echo \"\$(cd \$i; ls prio-[0-9]*):\$i\"; else echo \"z:\$i\"; fi; done | sort | sed 's/^[^:]*://'"
 
@@ -110,7 +170,7 @@ while (( resume )); do
 	    continue
 	fi
 	shopt -u nullglob
-	if ls $test_dir/*.$to_produce > /dev/null 2>&1; then
+	if is_finished $test_dir; then
 	    echo "Already finished $test_dir"
 	    continue
 	fi
@@ -127,36 +187,17 @@ while (( resume )); do
 	    resume=0
 	    break
 	fi
-	(
-	    cd $test_dir
-	    # source additional user modules (if available)
-	    source_config "user_modules" || echo "(ignored)"
-	    shopt -s nullglob
-	    for module in $user_module_dir/[0-9]*.sh; do
-		source_module "$module"
-	    done
-
-	    # source all individual config files (for overrides)
-	    shopt -s nullglob
-	    for i in $(echo $test_dir | sed 's/\// /g'); do
-		[ "$i" = "." ] && continue
-		if ! source_config "$i"; then
-		    echo "Cannot source config file '$i.conf' -- please provide one."
-		    exit -1
-		fi
-	    done
-	    shopt -u nullglob
-
-	    export sub_prefix=$(echo $test_dir | sed 's/\//./g' | sed 's/\.\././g')
-	    if (( dry_run_script )); then
-		echo "==> Dry Run ..."
-		touch dry-run.$to_produce
-	    else
-		echo "==> $(date) Starting $sub_prefix"
-		eval "$to_start" || { echo "Replay failure $?"; exit -1; }
-	    fi
-	    echo "==> $(date) Finished."
-	) || { echo "Failure $?"; exit -1; }
+	if (( max_jobs > 1 )); then
+	    # only for jobs which do not change the directory structure
+	    # (like graphing): all directories are scheduled in one pass
+	    wait_jobs $(( max_jobs - 1 ))
+	    (( job_failures )) && break
+	    echo "==> $(date) Starting job, see $test_dir/$job_log"
+	    run_dir > $test_dir/$job_log 2>&1 &
+	    echo "==============================================================="
+	    continue
+	fi
+	run_dir || { echo "Failure $?"; exit -1; }
 	echo "==============================================================="
 	echo ""
 	(( resume++ ))
@@ -164,6 +205,12 @@ while (( resume )); do
     done
 done
 
+wait_jobs 0
+if (( job_failures )); then
+    echo "$job_failures jobs failed, see $job_log files"
+    exit -1
+fi
+
 if (( dry_run_script )); then
     echo "removing dry-run.$to_produce everywhere..."
     rm -f $(find $work_dir -name "dry-run.$to_produce")
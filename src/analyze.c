@@ -0,0 +1,2113 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Native analyzer for graph.sh.
+ *
+ * Reads the concatenated .load / .replay files from stdin exactly once,
+ * and writes all the .g* data files, statistics and labels which were
+ * formerly produced by the farm of gawk / sort pipelines in graph.sh,
+ * in the same formats. Afterwards graph.sh only needs to drive gnuplot.
+ *
+ * The requests are spilled to unlinked files in the --tmp directory
+ * while reading, and mapped read-only afterwards, so they live in the
+ * page cache instead of the heap. Only the three orderings (by demanded
+ * start, by real start, and by completion) are kept in memory; they
+ * are computed once in parallel, then all output files are produced
+ * by a pool of threads.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "histogram.h"
+
+#define MAX_FIELDS 6    // start ; sector ; length ; op ; delay ; duration
+#define MAX_WS 16
+#define MAX_VARS 4096
+#define BUF_SIZE (1024 * 1024)
+#define ARENA_SIZE (16 * 1024 * 1024)
+
+// the same modes as in graph.sh
+enum {
+	MODE_READS,
+	MODE_WRITES,
+	MODE_R_PUSH,
+	MODE_W_PUSH,
+	MODE_ALL,
+	MODE_MAX,
+};
+
+static const char *mode_names[MODE_MAX] = {
+	"reads", "writes", "r_push", "w_push", "all",
+};
+
+#define IS_PUSH(mode) ((mode) == MODE_R_PUSH || (mode) == MODE_W_PUSH)
+
+struct record {
+	// raw text of the fields, as seen by cut(1): offsets into the
+	// text spill, or -1 when missing
+	long long rec_text[MAX_FIELDS];
+	// numeric values, as seen by gawk
+	double rec_start;
+	double rec_sector;
+	double rec_length;
+	double rec_delay;
+	double rec_duration;
+	// start + delay, and start + delay + duration, rounded to %14.9f
+	double rec_real;
+	double rec_completed;
+	int rec_nr;
+	int rec_flags;
+};
+
+struct record *records = NULL;
+char *texts = NULL;
+int record_count = 0;
+
+// orderings, as produced by sort -t';' -k2 -n
+int *order_setpoint = NULL;
+int *order_realtime = NULL;
+int *order_completed = NULL;
+
+char *out = NULL;
+char *tmp = NULL;
+char *ws_list = "";
+int static_mode = 0;
+int dynamic_mode = 0;
+int verbose_mode = 0;
+int thrp_window = 3;
+int turn_window = 1;
+double smooth_window = 1.0;
+double bad_latency = 5.0;
+double bad_delay = 10.0;
+int thread_count = 0;
+int raster_width = 0;
+int raster_height = 0;
+
+char **verbose_lines = NULL;
+int verbose_count = 0;
+int verbose_alloc = 0;
+
+/////////////////////////////////////////////////////////////////
+
+// helpers
+
+static
+void *xmalloc(size_t size)
+{
+	void *res = malloc(size);
+	if (!res && size) {
+		printf("FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	return res;
+}
+
+static
+void *xrealloc(void *ptr, size_t size)
+{
+	void *res = realloc(ptr, size);
+	if (!res && size) {
+		printf("FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	return res;
+}
+
+static
+char *arena_strdup(const char *str)
+{
+	static char *arena = NULL;
+	static size_t arena_rest = 0;
+	size_t len = strlen(str) + 1;
+	char *res;
+
+	if (len > arena_rest) {
+		arena_rest = len > ARENA_SIZE ? len : ARENA_SIZE;
+		arena = xmalloc(arena_rest);
+	}
+	res = arena;
+	memcpy(res, str, len);
+	arena += len;
+	arena_rest -= len;
+	return res;
+}
+
+/* Spill files: written sequentially while reading the input, then
+ * mapped read-only.
+ */
+struct spill {
+	FILE   *sp_file;
+	size_t  sp_size;
+};
+
+struct spill record_spill = {};
+struct spill text_spill = {};
+
+static
+void spill_open(struct spill *sp, const char *name)
+{
+	char path[4096];
+
+	snprintf(path, sizeof(path), "%s/%s.spill", tmp, name);
+	sp->sp_file = fopen(path, "w+");
+	if (!sp->sp_file) {
+		printf("FATAL ERROR: cannot create '%s' (errno=%d)\n", path, errno);
+		exit(-1);
+	}
+	unlink(path);
+	setvbuf(sp->sp_file, NULL, _IOFBF, BUF_SIZE);
+	sp->sp_size = 0;
+}
+
+static
+long long spill_write(struct spill *sp, const void *data, size_t len)
+{
+	long long res = sp->sp_size;
+
+	if (len && fwrite(data, len, 1, sp->sp_file) != 1) {
+		printf("FATAL ERROR: cannot write spill file (errno=%d)\n", errno);
+		exit(-1);
+	}
+	sp->sp_size += len;
+	return res;
+}
+
+static
+void *spill_map(struct spill *sp)
+{
+	void *res = NULL;
+
+	if (fflush(sp->sp_file) < 0) {
+		printf("FATAL ERROR: cannot write spill file (errno=%d)\n", errno);
+		exit(-1);
+	}
+	if (sp->sp_size) {
+		res = mmap(NULL, sp->sp_size, PROT_READ, MAP_SHARED, fileno(sp->sp_file), 0);
+		if (res == MAP_FAILED) {
+			printf("FATAL ERROR: cannot map spill file (errno=%d)\n", errno);
+			exit(-1);
+		}
+	}
+	return res;
+}
+
+/* Raw text of a field, or NULL when missing
+ */
+static
+const char *field(struct record *rec, int nr)
+{
+	if (rec->rec_text[nr] < 0)
+		return NULL;
+	return texts + rec->rec_text[nr];
+}
+
+static
+FILE *open_output(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+static
+FILE *open_output(const char *fmt, ...)
+{
+	char name[4096];
+	va_list args;
+	FILE *res;
+
+	va_start(args, fmt);
+	vsnprintf(name, sizeof(name), fmt, args);
+	va_end(args);
+	res = fopen(name, "w");
+	if (!res) {
+		printf("FATAL ERROR: cannot create '%s' (errno=%d)\n", name, errno);
+		exit(-1);
+	}
+	setvbuf(res, NULL, _IOFBF, BUF_SIZE);
+	return res;
+}
+
+static
+void close_output(FILE *res)
+{
+	if (fclose(res) < 0) {
+		printf("FATAL ERROR: cannot write output (errno=%d)\n", errno);
+		exit(-1);
+	}
+}
+
+/* Numeric value of a text field like gawk computes it.
+ */
+static
+double num(const char *str)
+{
+	if (!str)
+		return 0.0;
+	return strtod(str, NULL);
+}
+
+/* The value of a number after printing it with 9 decimals.
+ * gawk pipelines passed such numbers as text, so later
+ * comparisons and truncations are based on the rounded value.
+ */
+static
+double rounded(double val)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.9f", val);
+	return strtod(buf, NULL);
+}
+
+/* Emulation of gawk's comparison $n < 100000000000000000:
+ * numeric for fields looking numeric, otherwise string comparison.
+ */
+static
+int below_limit(const char *str)
+{
+	const char *tmp = str;
+	char *end;
+	double val;
+
+	if (!str)
+		return 1;
+	while (isspace(*tmp))
+		tmp++;
+	if (isdigit(*tmp) || *tmp == '.' || *tmp == '-' || *tmp == '+') {
+		val = strtod(tmp, &end);
+		if (end != tmp) {
+			while (isspace(*end))
+				end++;
+			if (!*end)
+				return val < 100000000000000000.0;
+		}
+	}
+	return strcmp(str, "100000000000000000") < 0;
+}
+
+static
+int mode_match(int mode, struct record *rec)
+{
+	return mode == MODE_ALL || (rec->rec_flags & (1 << mode));
+}
+
+/////////////////////////////////////////////////////////////////
+
+// statistics in the format of make_statistics{,_short}
+
+struct stat {
+	double st_min;
+	double st_max;
+	double st_sum;
+	int st_count;
+	// only for the long form
+	int st_hit;
+	double st_start;
+};
+
+static
+void stat_add(struct stat *st, double val)
+{
+	st->st_sum += val;
+	st->st_count++;
+	if (val > st->st_max)
+		st->st_max = val;
+	if (val < st->st_min || !st->st_min)
+		st->st_min = val;
+}
+
+static
+void stat_add_bad(struct stat *st, double stamp, double val, double bad)
+{
+	stat_add(st, val);
+	if (val > bad) {
+		if (!st->st_hit)
+			st->st_start = stamp;
+		st->st_hit++;
+	}
+}
+
+static
+void stat_write_short(struct stat *st, const char *prefix, FILE *res)
+{
+	fprintf(res,
+		"%smin=%f\n%smax=%f\n%scount=%d\n%savg=%f\n",
+		prefix, st->st_min,
+		prefix, st->st_max,
+		prefix, st->st_count,
+		prefix, st->st_count > 0 ? st->st_sum / st->st_count : 0);
+}
+
+/* Write $tmp/stat.<outfix>.<mode> and $tmp/label.<outfix>.<mode>
+ * like _output_statistics did.
+ */
+static
+void stat_output(struct stat *st, int is_long, const char *name, const char *outfix, int mode)
+{
+	char prefix[256];
+	FILE *res;
+
+	snprintf(prefix, sizeof(prefix), "%s_%s_", name, mode_names[mode]);
+	res = open_output("%s/stat.%s.%s", tmp, outfix, mode_names[mode]);
+	if (is_long) {
+		fprintf(res,
+			"%smin=%11.9f\n%smax=%11.9f\n%scount=%d\n%savg=%11.9f\n%shit=%d\n%sstart=%11.9f\n",
+			prefix, st->st_min,
+			prefix, st->st_max,
+			prefix, st->st_count,
+			prefix, st->st_count > 0 ? st->st_sum / st->st_count : 0,
+			prefix, st->st_hit,
+			prefix, st->st_start);
+	} else {
+		stat_write_short(st, prefix, res);
+	}
+	close_output(res);
+
+	res = open_output("%s/label.%s.%s", tmp, outfix, mode_names[mode]);
+	if (is_long) {
+		fprintf(res, "%s_label=\"  (avg=%11.9f, max=%11.9f)\"\n",
+			mode_names[mode],
+			st->st_count > 0 ? st->st_sum / st->st_count : 0,
+			st->st_max);
+	} else {
+		fprintf(res, "%s_label=\"  (avg=%f, max=%f)\"\n",
+			mode_names[mode],
+			st->st_count > 0 ? st->st_sum / st->st_count : 0,
+			st->st_max);
+	}
+	close_output(res);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// hash tables keyed by block or sector number
+
+struct hash {
+	unsigned long long *h_key; // key + 1, 0 means empty
+	unsigned int *h_val;
+	size_t h_size;
+	size_t h_count;
+};
+
+static
+unsigned int *hash_get(struct hash *h, unsigned long long key)
+{
+	size_t pos;
+
+	if (h->h_count * 2 >= h->h_size) {
+		struct hash new = {};
+		size_t i;
+
+		new.h_size = h->h_size ? h->h_size * 2 : 1024;
+		new.h_key = calloc(new.h_size, sizeof(unsigned long long));
+		new.h_val = calloc(new.h_size, sizeof(unsigned int));
+		if (!new.h_key || !new.h_val) {
+			printf("FATAL ERROR: out of memory\n");
+			exit(-1);
+		}
+		for (i = 0; i < h->h_size; i++) {
+			if (h->h_key[i])
+				*hash_get(&new, h->h_key[i] - 1) = h->h_val[i];
+		}
+		free(h->h_key);
+		free(h->h_val);
+		*h = new;
+	}
+
+	pos = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 20) & (h->h_size - 1);
+	while (h->h_key[pos] && h->h_key[pos] != key + 1)
+		pos = (pos + 1) & (h->h_size - 1);
+	if (!h->h_key[pos]) {
+		h->h_key[pos] = key + 1;
+		h->h_val[pos] = 0;
+		h->h_count++;
+	}
+	return &h->h_val[pos];
+}
+
+static
+void hash_free(struct hash *h)
+{
+	free(h->h_key);
+	free(h->h_val);
+	memset(h, 0, sizeof(*h));
+}
+
+/////////////////////////////////////////////////////////////////
+
+// throughput, like gawk_thrps
+
+struct thrps {
+	FILE *t_out;
+	struct stat *t_stat;
+	long long t_oldtime;
+	double t_count;
+};
+
+static
+void thrps_line(struct thrps *t, long long stamp, double count, int zero)
+{
+	char buf[64];
+
+	if (zero)
+		snprintf(buf, sizeof(buf), "0.0");
+	else
+		snprintf(buf, sizeof(buf), "%13.3f", count / (double)thrp_window);
+	fprintf(t->t_out, "%lld %s\n", stamp, buf);
+	if (t->t_stat)
+		stat_add(t->t_stat, strtod(buf, NULL));
+}
+
+static
+void thrps_put(struct thrps *t, double stamp, double param)
+{
+	long long time = (long long)stamp;
+
+	if (time - t->t_oldtime >= thrp_window) {
+		thrps_line(t, t->t_oldtime, t->t_count, 0);
+		t->t_oldtime += thrp_window;
+		if (time - t->t_oldtime >= thrp_window) {
+			long long factor;
+			thrps_line(t, t->t_oldtime, 0, 1);
+			factor = (long long)((double)(time - t->t_oldtime) / thrp_window);
+			t->t_oldtime += factor * thrp_window;
+			if (factor > 1)
+				thrps_line(t, t->t_oldtime, 0, 1);
+		}
+		t->t_count = 0;
+	}
+	t->t_count += param;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// sorting
+
+static
+int compare_order(const void *_a, const void *_b, void *_key)
+{
+	int a = *(const int *)_a;
+	int b = *(const int *)_b;
+	size_t offset = (size_t)_key;
+	double ka = *(double *)((char *)&records[a] + offset);
+	double kb = *(double *)((char *)&records[b] + offset);
+
+	if (ka < kb)
+		return -1;
+	if (ka > kb)
+		return 1;
+	return a - b;
+}
+
+static
+int *make_order(size_t offset)
+{
+	int *order = xmalloc(sizeof(int) * (record_count + 1));
+	int i;
+
+	for (i = 0; i < record_count; i++)
+		order[i] = i;
+	qsort_r(order, record_count, sizeof(int), compare_order, (void *)offset);
+	return order;
+}
+
+static
+void task_sort_setpoint(int mode)
+{
+	order_setpoint = make_order(offsetof(struct record, rec_start));
+}
+
+static
+void task_sort_realtime(int mode)
+{
+	order_realtime = make_order(offsetof(struct record, rec_real));
+}
+
+static
+void task_sort_completed(int mode)
+{
+	order_completed = make_order(offsetof(struct record, rec_completed));
+}
+
+/////////////////////////////////////////////////////////////////
+
+// global overview
+
+static
+void task_overview_demand(int mode)
+{
+	struct thrps thrp = { .t_out = open_output("%s.g000.sort0.overview.thrp.demand.extra", out) };
+	struct thrps thrs = { .t_out = open_output("%s.g000.sort0.overview.thrs.demand.extra", out) };
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order_setpoint[i]];
+		thrps_put(&thrp, rec->rec_start, 1);
+		thrps_put(&thrs, rec->rec_start, rec->rec_length);
+	}
+	close_output(thrp.t_out);
+	close_output(thrs.t_out);
+}
+
+static
+void task_overview_actual(int mode)
+{
+	struct thrps thrp = { .t_out = open_output("%s.g000.sort1.overview.thrp.actual.extra", out) };
+	struct thrps thrs = { .t_out = open_output("%s.g000.sort1.overview.thrs.actual.extra", out) };
+	struct stat st = {};
+	FILE *res;
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order_completed[i]];
+		thrps_put(&thrp, rec->rec_completed, 1);
+		thrps_put(&thrs, rec->rec_completed, rec->rec_length);
+		stat_add(&st, rec->rec_completed);
+	}
+	close_output(thrp.t_out);
+	close_output(thrs.t_out);
+
+	res = open_output("%s/stat.duration.actual", tmp);
+	stat_write_short(&st, "duration_actual_", res);
+	close_output(res);
+}
+
+static
+void task_duration_demand(int mode)
+{
+	struct stat st = {};
+	FILE *res;
+	int i;
+
+	for (i = 0; i < record_count; i++)
+		stat_add(&st, records[i].rec_start);
+
+	res = open_output("%s/stat.duration.demand", tmp);
+	stat_write_short(&st, "duration_demand_", res);
+	close_output(res);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// static per-mode graphics
+
+static
+void task_rqsize(int mode)
+{
+	FILE *res = open_output("%s.g40.%s.tmp.rqsize.bins", out, mode_names[mode]);
+	struct histogram b;
+	struct stat st = {};
+	int i;
+
+	hist_init(&b, HIST_DEFAULT_SUBDIV);
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[i];
+		if (!mode_match(mode, rec))
+			continue;
+		hist_put(&b, rec->rec_length);
+		stat_add(&st, rec->rec_length);
+	}
+	hist_print(&b, res);
+	hist_free(&b);
+	close_output(res);
+	stat_output(&st, 0, "rqsize", "rqsize", mode);
+}
+
+static
+void task_rqpos(int mode)
+{
+	FILE *res = open_output("%s.g41.%s.tmp.rqpos.bins", out, mode_names[mode]);
+	FILE *ymax_file;
+	int *table = NULL;
+	int alloc = 0;
+	int xmax = -2;
+	int ymax = 0;
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[i];
+		int pos;
+		if (!mode_match(mode, rec))
+			continue;
+		pos = (int)(rec->rec_sector / 2097152);
+		if (pos < 0)
+			continue;
+		if (pos + 2 >= alloc) {
+			int new_alloc = (pos + 2) * 2;
+			table = xrealloc(table, new_alloc * sizeof(int));
+			memset(table + alloc, 0, (new_alloc - alloc) * sizeof(int));
+			alloc = new_alloc;
+		}
+		table[pos]++;
+		if (pos > xmax)
+			xmax = pos;
+	}
+	for (i = 0; i <= xmax + 1; i++) {
+		fprintf(res, "%5d %5d\n%5d %5d\n", i, table[i], i + 1, table[i]);
+		if (table[i] > ymax)
+			ymax = table[i];
+	}
+	close_output(res);
+	free(table);
+
+	ymax_file = open_output("%s/rqpos_%s.ymax", tmp, mode_names[mode]);
+	if (ymax > 0)
+		fprintf(ymax_file, "ymax=%d\n", ymax);
+	close_output(ymax_file);
+}
+
+static
+int compare_desc(const void *_a, const void *_b)
+{
+	unsigned int a = *(const unsigned int *)_a;
+	unsigned int b = *(const unsigned int *)_b;
+
+	return a < b ? 1 : a > b ? -1 : 0;
+}
+
+/* Repetition frequency of 4k blocks, and its quantiles
+ */
+static
+void task_freq(int mode)
+{
+	FILE *res = open_output("%s.g44.%s.tmp.freq.bins", out, mode_names[mode]);
+	FILE *quantile = open_output("%s.g44.%s.side.freq.bins.quantile", out, mode_names[mode]);
+	struct hash h = {};
+	unsigned int *list;
+	double total_sum = 0;
+	double limit = 1.0 / 64;
+	double sum = 0;
+	size_t count;
+	size_t i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[i];
+		long long block;
+		double len;
+		if (!mode_match(mode, rec))
+			continue;
+		block = (long long)(rec->rec_sector / 8);
+		len = rec->rec_length;
+		do {
+			(*hash_get(&h, block))++;
+			block++;
+			len -= 8;
+		} while (len > 0);
+	}
+
+	list = xmalloc(sizeof(unsigned int) * (h.h_count + 1));
+	for (i = 0, count = 0; i < h.h_size; i++) {
+		if (h.h_key[i]) {
+			list[count++] = h.h_val[i];
+			total_sum += h.h_val[i];
+		}
+	}
+	hash_free(&h);
+	qsort(list, count, sizeof(unsigned int), compare_desc);
+
+	for (i = 0; i < count; i++) {
+		fprintf(res, "%u\n", list[i]);
+		if (!total_sum)
+			continue;
+		sum += list[i];
+		if (sum >= total_sum * limit) {
+			fprintf(quantile, "%lu %6.3f %6.3f %5.3f\n",
+				(unsigned long)(i + 1),
+				(i + 1) * 100.0 / count,
+				limit * 100.0,
+				total_sum / (total_sum - sum + (i + 1)));
+			limit *= 2;
+		}
+	}
+	free(list);
+	close_output(res);
+	close_output(quantile);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// dynamic per-mode graphics
+
+static
+void print_fields(FILE *res, const char *a, const char *b)
+{
+	if (b)
+		fprintf(res, "%s %s\n", a ? a : "", b);
+	else
+		fprintf(res, "%s\n", a ? a : "");
+}
+
+static
+void task_dyn_points(int mode)
+{
+	FILE *latency = open_output("%s.g03.%s.tmp.latency.points", out, mode_names[mode]);
+	FILE *delay = open_output("%s.g05.%s.tmp.delay.points", out, mode_names[mode]);
+	FILE *xy = open_output("%s.g12.%s.tmp.latency.delay.xy", out, mode_names[mode]);
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[i];
+		char nr[32];
+		if (!mode_match(mode, rec))
+			continue;
+		snprintf(nr, sizeof(nr), "%6d", rec->rec_nr);
+		print_fields(latency, nr, field(rec, 5));
+		print_fields(delay, nr, field(rec, 4));
+		print_fields(xy, field(rec, 4), field(rec, 5));
+	}
+	close_output(latency);
+	close_output(delay);
+	close_output(xy);
+}
+
+static
+void task_dyn_setpoint(int mode)
+{
+	FILE *latency = open_output("%s.g02.%s.tmp.latency.setpoint", out, mode_names[mode]);
+	FILE *delay = open_output("%s.g04.%s.tmp.delay.setpoint", out, mode_names[mode]);
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order_setpoint[i]];
+		if (!mode_match(mode, rec))
+			continue;
+		print_fields(latency, field(rec, 0), field(rec, 5));
+		print_fields(delay, field(rec, 0), field(rec, 4));
+	}
+	close_output(latency);
+	close_output(delay);
+}
+
+static
+void task_dyn_realtime(int mode)
+{
+	FILE *res = open_output("%s.g01.%s.tmp.latency.realtime", out, mode_names[mode]);
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order_realtime[i]];
+		char buf[64];
+		if (!mode_match(mode, rec))
+			continue;
+		snprintf(buf, sizeof(buf), "%14.9f", rec->rec_real);
+		print_fields(res, buf, field(rec, 5) ? field(rec, 5) : "");
+	}
+	close_output(res);
+}
+
+static
+void task_dyn_completed(int mode)
+{
+	FILE *res = open_output("%s.g03.%s.tmp.latency.completed", out, mode_names[mode]);
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order_completed[i]];
+		char buf[64];
+		if (!mode_match(mode, rec))
+			continue;
+		snprintf(buf, sizeof(buf), "%14.9f", rec->rec_completed);
+		print_fields(res, buf, field(rec, 5) ? field(rec, 5) : "");
+	}
+	close_output(res);
+}
+
+/* Density rasters for the sonar diagrams: instead of one point per
+ * request, count the requests per pixel. The counts are written on a
+ * log10(1 + count) scale as a full grid, suitable for gnuplot
+ * "with image". The latency axis is log10(latency). All modes use
+ * the same ranges, so the pictures can be compared. With --raster,
+ * the per-point latency.realtime files are not written.
+ */
+
+struct raster {
+	int    *r_count;
+	double  r_x_min;
+	double  r_x_max;
+	double  r_y_min;
+	double  r_y_max;
+};
+
+static
+void raster_init(struct raster *r, double x_min, double x_max, double y_min, double y_max)
+{
+	r->r_count = xmalloc(sizeof(int) * raster_width * raster_height);
+	memset(r->r_count, 0, sizeof(int) * raster_width * raster_height);
+	if (x_max <= x_min)
+		x_max = x_min + 1.0;
+	if (y_max <= y_min)
+		y_max = y_min + 1.0;
+	r->r_x_min = x_min;
+	r->r_x_max = x_max;
+	r->r_y_min = y_min;
+	r->r_y_max = y_max;
+}
+
+static
+void raster_put(struct raster *r, double x, double y)
+{
+	int col = (x - r->r_x_min) / (r->r_x_max - r->r_x_min) * raster_width;
+	int row = (y - r->r_y_min) / (r->r_y_max - r->r_y_min) * raster_height;
+
+	if (col >= raster_width)
+		col = raster_width - 1;
+	if (row >= raster_height)
+		row = raster_height - 1;
+	if (col < 0 || row < 0)
+		return;
+	r->r_count[col * raster_height + row]++;
+}
+
+static
+void raster_write(struct raster *r, FILE *res)
+{
+	double dx = (r->r_x_max - r->r_x_min) / raster_width;
+	double dy = (r->r_y_max - r->r_y_min) / raster_height;
+	int col;
+	int row;
+
+	for (col = 0; col < raster_width; col++) {
+		for (row = 0; row < raster_height; row++) {
+			int count = r->r_count[col * raster_height + row];
+
+			fprintf(res, "%.9g %.6f %.4f\n",
+				r->r_x_min + (col + 0.5) * dx,
+				r->r_y_min + (row + 0.5) * dy,
+				count ? log10(1.0 + count) : 0.0);
+		}
+		fputc('\n', res);
+	}
+	free(r->r_count);
+}
+
+static
+void task_dyn_raster(int mode)
+{
+	struct raster realtime;
+	struct raster sector;
+	FILE *res;
+	double t_max = 0.0;
+	double s_max = 0.0;
+	double l_min = 0.0;
+	double l_max = 0.0;
+	int found = 0;
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[i];
+		double l;
+
+		if (rec->rec_duration <= 0.0)
+			continue;
+		l = log10(rec->rec_duration);
+		if (!found++ || l < l_min)
+			l_min = l;
+		if (found == 1 || l > l_max)
+			l_max = l;
+		if (rec->rec_real > t_max)
+			t_max = rec->rec_real;
+		if (rec->rec_sector > s_max)
+			s_max = rec->rec_sector;
+	}
+	if (!found)
+		return;
+
+	raster_init(&realtime, 0.0, t_max, l_min, l_max);
+	raster_init(&sector, 0.0, s_max / 2097152.0, l_min, l_max);
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[i];
+		double l;
+
+		if (!mode_match(mode, rec) || rec->rec_duration <= 0.0)
+			continue;
+		l = log10(rec->rec_duration);
+		raster_put(&realtime, rec->rec_real, l);
+		raster_put(&sector, rec->rec_sector / 2097152.0, l);
+	}
+	res = open_output("%s.g13.%s.raster.latency.realtime", out, mode_names[mode]);
+	raster_write(&realtime, res);
+	close_output(res);
+	res = open_output("%s.g14.%s.raster.latency.sector", out, mode_names[mode]);
+	raster_write(&sector, res);
+	close_output(res);
+}
+
+static
+void task_dyn_bins(int mode)
+{
+	FILE *latency = open_output("%s.g06.%s.tmp.latency.bins", out, mode_names[mode]);
+	FILE *delay = open_output("%s.g07.%s.tmp.delay.bins", out, mode_names[mode]);
+	struct histogram lb;
+	struct histogram db;
+	struct stat lst = {};
+	struct stat dst = {};
+	int i;
+
+	hist_init(&lb, HIST_DEFAULT_SUBDIV);
+	hist_init(&db, HIST_DEFAULT_SUBDIV);
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[i];
+		if (!mode_match(mode, rec))
+			continue;
+		hist_put(&lb, rec->rec_duration);
+		hist_put(&db, rec->rec_delay);
+		stat_add_bad(&lst, rec->rec_start, rec->rec_duration, bad_latency);
+		stat_add_bad(&dst, rec->rec_start, rec->rec_delay, bad_delay);
+	}
+	hist_print(&lb, latency);
+	hist_print(&db, delay);
+	hist_free(&lb);
+	hist_free(&db);
+	close_output(latency);
+	close_output(delay);
+	stat_output(&lst, 1, "latency", "latencies", mode);
+	stat_output(&dst, 1, "delay", "delays", mode);
+}
+
+static
+void task_thr_setpoint(int mode)
+{
+	struct stat pst = {};
+	struct stat sst = {};
+	struct thrps thrp = { .t_out = open_output("%s.g00.%s.tmp.thrp.setpoint", out, mode_names[mode]), .t_stat = &pst };
+	struct thrps thrs = { .t_out = open_output("%s.g00.%s.tmp.thrs.setpoint", out, mode_names[mode]), .t_stat = &sst };
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order_setpoint[i]];
+		if (!mode_match(mode, rec))
+			continue;
+		thrps_put(&thrp, rec->rec_start, 1);
+		thrps_put(&thrs, rec->rec_start, rec->rec_length);
+	}
+	close_output(thrp.t_out);
+	close_output(thrs.t_out);
+	stat_output(&pst, 0, "thrp_setpoint", "thrp.setpoint", mode);
+	stat_output(&sst, 0, "thrs_setpoint", "thrs.setpoint", mode);
+}
+
+static
+void task_thr_completed(int mode)
+{
+	struct stat pst = {};
+	struct stat sst = {};
+	struct thrps thrp = { .t_out = open_output("%s.g00.%s.tmp.thrp.completed", out, mode_names[mode]), .t_stat = &pst };
+	struct thrps thrs = { .t_out = open_output("%s.g00.%s.tmp.thrs.completed", out, mode_names[mode]), .t_stat = &sst };
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order_completed[i]];
+		if (!mode_match(mode, rec))
+			continue;
+		thrps_put(&thrp, rec->rec_completed, 1);
+		thrps_put(&thrs, rec->rec_completed, rec->rec_length);
+	}
+	close_output(thrp.t_out);
+	close_output(thrs.t_out);
+	stat_output(&pst, 0, "thrp_completed", "thrp.completed", mode);
+	stat_output(&sst, 0, "thrs_completed", "thrs.completed", mode);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// flying requests, like compute_flying
+
+struct flying_event {
+	double ev_stamp;
+	long long ev_seq;
+	int ev_rec;
+	int ev_delta;
+};
+
+static
+int compare_event(const void *_a, const void *_b)
+{
+	const struct flying_event *a = _a;
+	const struct flying_event *b = _b;
+
+	if (a->ev_stamp < b->ev_stamp)
+		return -1;
+	if (a->ev_stamp > b->ev_stamp)
+		return 1;
+	return a->ev_seq < b->ev_seq ? -1 : a->ev_seq > b->ev_seq ? 1 : 0;
+}
+
+static
+struct flying_event *flying_events(int mode, int latency, int *count)
+{
+	struct flying_event *ev = xmalloc(sizeof(struct flying_event) * (record_count * 2 + 1));
+	int nr = 0;
+	int i;
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[i];
+		double start;
+		double end;
+		if (!mode_match(mode, rec))
+			continue;
+		if (latency) {
+			start = rec->rec_start + rec->rec_delay;
+			end = start + rec->rec_duration;
+		} else {
+			start = rec->rec_start;
+			end = rec->rec_start + rec->rec_delay;
+		}
+		ev[nr].ev_stamp = rounded(start);
+		ev[nr].ev_seq = nr;
+		ev[nr].ev_rec = i;
+		ev[nr].ev_delta = 1;
+		nr++;
+		ev[nr].ev_stamp = rounded(end);
+		ev[nr].ev_seq = nr;
+		ev[nr].ev_rec = i;
+		ev[nr].ev_delta = -1;
+		nr++;
+	}
+	qsort(ev, nr, sizeof(struct flying_event), compare_event);
+	*count = nr;
+	return ev;
+}
+
+static
+void task_latency_flying(int mode)
+{
+	FILE *res = open_output("%s.g08.%s.tmp.latency.flying", out, mode_names[mode]);
+	FILE *smooth = open_output("%s.g08.%s.tmp.smooth.latency.flying", out, mode_names[mode]);
+	FILE *lxy = NULL;
+	FILE *dxy = NULL;
+	struct flying_event *ev;
+	struct stat st = {};
+	double start = 0;
+	double sum = 0;
+	int sum_count = 0;
+	int flying = 0;
+	int count;
+	int i;
+
+	if (mode != MODE_ALL) {
+		lxy = open_output("%s.g10.%s.tmp.latency.xy", out, mode_names[mode]);
+		dxy = open_output("%s.g11.%s.tmp.delay.xy", out, mode_names[mode]);
+	}
+
+	ev = flying_events(mode, 1, &count);
+	for (i = 0; i < count; i++) {
+		struct record *rec = &records[ev[i].ev_rec];
+		double stamp = ev[i].ev_stamp;
+
+		flying += ev[i].ev_delta;
+		fprintf(res, "%17.9f %5d\n", stamp, flying);
+		stat_add(&st, flying);
+		if (ev[i].ev_delta > 0 && lxy) {
+			fprintf(lxy, "%5d %s\n", flying, field(rec, 5) ? field(rec, 5) : "");
+			fprintf(dxy, "%5d %s\n", flying, field(rec, 4) ? field(rec, 4) : "");
+		}
+
+		// smooth_y
+		if (!start)
+			start = stamp;
+		while (smooth_window > 0 && stamp >= start + smooth_window) {
+			fprintf(smooth, "%14.9f %f\n", start + smooth_window, sum_count > 0 ? sum / sum_count : 0);
+			start += smooth_window;
+			sum_count = 0;
+			sum = 0.0;
+		}
+		sum_count++;
+		sum += flying;
+	}
+	free(ev);
+
+	close_output(res);
+	close_output(smooth);
+	if (lxy) {
+		close_output(lxy);
+		close_output(dxy);
+	}
+	stat_output(&st, 0, "latency_flying", "latency.flying", mode);
+}
+
+static
+void task_delay_flying(int mode)
+{
+	FILE *res = open_output("%s.g09.%s.tmp.delay.flying", out, mode_names[mode]);
+	struct flying_event *ev;
+	struct stat st = {};
+	int flying = 0;
+	int count;
+	int i;
+
+	ev = flying_events(mode, 0, &count);
+	for (i = 0; i < count; i++) {
+		flying += ev[i].ev_delta;
+		fprintf(res, "%17.9f %5d\n", ev[i].ev_stamp, flying);
+		stat_add(&st, flying);
+	}
+	free(ev);
+	close_output(res);
+	stat_output(&st, 0, "delay_flying", "delay.flying", mode);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// turns, like compute_turns
+
+static
+void compute_turns(int mode, int *order, int completed)
+{
+	FILE *res;
+	struct stat st = {};
+	double advance = turn_window > 0 ? turn_window : 1;
+	double start = 0;
+	double old = 0;
+	int turns = 0;
+	int count = 0;
+	int i;
+
+	if (completed)
+		res = open_output("%s.g43.%s.tmp.turns.completed", out, mode_names[mode]);
+	else
+		res = open_output("%s.g42.%s.tmp.turns.setpoint", out, mode_names[mode]);
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order[i]];
+		double stamp = completed ? rec->rec_completed : rec->rec_start;
+		if (!mode_match(mode, rec))
+			continue;
+		if (!start)
+			start = stamp;
+		while (stamp >= start + advance) {
+			char buf[64];
+			snprintf(buf, sizeof(buf), "%f", count > 0 ? turns * 100.0 / count : 0);
+			fprintf(res, "%.9f %s\n", start + advance, buf);
+			stat_add(&st, strtod(buf, NULL));
+			start += advance;
+			if (turn_window) {
+				turns = 0;
+				count = 0;
+			}
+		}
+		if (rec->rec_sector < old)
+			turns++;
+		count++;
+		old = rec->rec_sector;
+	}
+	close_output(res);
+	if (completed)
+		stat_output(&st, 0, "turns_completed", "turns.completed", mode);
+	else
+		stat_output(&st, 0, "turns_setpoint", "turns.setpoint", mode);
+}
+
+static
+void task_turns_setpoint(int mode)
+{
+	compute_turns(mode, order_setpoint, 0);
+}
+
+static
+void task_turns_completed(int mode)
+{
+	compute_turns(mode, order_completed, 1);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// working sets, like compute_ws
+
+/* All windows of --ws-list are computed in a single pass.
+ * The set of touched keys (sector / ws_block) is split into chunks
+ * of 64k keys. A chunk starts as a sorted array of 16bit offsets and
+ * is turned into a bitmap of 8k once it would exceed that size.
+ * Thus a chunk never needs more than 8k, and memory only depends on
+ * the touched part of the address space, not on its total size.
+ */
+
+#define WS_CHUNK_BITS 16
+#define WS_CHUNK_KEYS (1 << WS_CHUNK_BITS)
+#define WS_ARRAY_MAX  (WS_CHUNK_KEYS / 16)
+
+struct ws_chunk {
+	unsigned short *c_array;
+	unsigned long long *c_bitmap;
+	int c_count;
+	int c_alloc;
+};
+
+struct ws_set {
+	struct hash s_index; // chunk number -> position in s_chunks + 1
+	struct ws_chunk *s_chunks;
+	int s_count;
+	int s_alloc;
+	unsigned long long s_keys;
+	unsigned long long s_min;
+	unsigned long long s_max;
+};
+
+struct ws_window {
+	const char *w_name;
+	long w_window;
+	double w_advance;
+	double w_start;
+	FILE *w_log;
+	FILE *w_sum;
+	FILE *w_avg;
+	struct ws_set w_set;
+};
+
+char *ws_names[MAX_WS];
+int ws_count = 0;
+long long ws_block = 1;
+
+static
+int ws_chunk_add(struct ws_chunk *chunk, unsigned int offset)
+{
+	int low = 0;
+	int high = chunk->c_count;
+
+	if (chunk->c_bitmap) {
+		unsigned long long bit = 1ULL << (offset & 63);
+		if (chunk->c_bitmap[offset >> 6] & bit)
+			return 0;
+		chunk->c_bitmap[offset >> 6] |= bit;
+		chunk->c_count++;
+		return 1;
+	}
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (chunk->c_array[mid] < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low < chunk->c_count && chunk->c_array[low] == offset)
+		return 0;
+
+	if (chunk->c_count >= WS_ARRAY_MAX) {
+		int i;
+		chunk->c_bitmap = calloc(WS_CHUNK_KEYS / 64, sizeof(unsigned long long));
+		if (!chunk->c_bitmap) {
+			printf("FATAL ERROR: out of memory\n");
+			exit(-1);
+		}
+		for (i = 0; i < chunk->c_count; i++)
+			chunk->c_bitmap[chunk->c_array[i] >> 6] |= 1ULL << (chunk->c_array[i] & 63);
+		free(chunk->c_array);
+		chunk->c_array = NULL;
+		return ws_chunk_add(chunk, offset);
+	}
+	if (chunk->c_count >= chunk->c_alloc) {
+		chunk->c_alloc = chunk->c_alloc ? chunk->c_alloc * 2 : 16;
+		chunk->c_array = xrealloc(chunk->c_array, sizeof(unsigned short) * chunk->c_alloc);
+	}
+	memmove(&chunk->c_array[low + 1], &chunk->c_array[low], sizeof(unsigned short) * (chunk->c_count - low));
+	chunk->c_array[low] = offset;
+	chunk->c_count++;
+	return 1;
+}
+
+static
+int ws_set_add(struct ws_set *set, unsigned long long key)
+{
+	unsigned int *pos = hash_get(&set->s_index, key >> WS_CHUNK_BITS);
+
+	if (!*pos) {
+		if (set->s_count >= set->s_alloc) {
+			set->s_alloc = set->s_alloc ? set->s_alloc * 2 : 64;
+			set->s_chunks = xrealloc(set->s_chunks, sizeof(struct ws_chunk) * set->s_alloc);
+		}
+		memset(&set->s_chunks[set->s_count], 0, sizeof(struct ws_chunk));
+		*pos = ++set->s_count;
+	}
+	if (!ws_chunk_add(&set->s_chunks[*pos - 1], key & (WS_CHUNK_KEYS - 1)))
+		return 0;
+	if (!set->s_keys || key < set->s_min)
+		set->s_min = key;
+	if (!set->s_keys || key > set->s_max)
+		set->s_max = key;
+	set->s_keys++;
+	return 1;
+}
+
+static
+void ws_set_free(struct ws_set *set)
+{
+	int i;
+
+	for (i = 0; i < set->s_count; i++) {
+		free(set->s_chunks[i].c_array);
+		free(set->s_chunks[i].c_bitmap);
+	}
+	free(set->s_chunks);
+	hash_free(&set->s_index);
+	memset(set, 0, sizeof(*set));
+}
+
+static
+void ws_window_flush(struct ws_window *w)
+{
+	double delta = 0.0;
+	unsigned long long c = 0;
+
+	if (w->w_window) {
+		c = w->w_set.s_keys;
+		if (c > 0)
+			delta = (double)(w->w_set.s_max - w->w_set.s_min) * ws_block;
+	}
+	fprintf(w->w_log, "%.9f %llu\n", w->w_start + w->w_advance, w->w_set.s_keys);
+	if (w->w_sum) {
+		fprintf(w->w_sum, "%.9f %.9f\n", w->w_start + w->w_advance, delta);
+		fprintf(w->w_avg, "%.9f %.9f\n", w->w_start + w->w_advance, c > 0 ? delta / c : 0);
+	}
+	if (w->w_window)
+		ws_set_free(&w->w_set);
+	w->w_start += w->w_advance;
+}
+
+static
+void task_ws(int unused)
+{
+	struct ws_window *windows = xmalloc(sizeof(struct ws_window) * (ws_count + 1));
+	int nr;
+	int i;
+
+	for (nr = 0; nr < ws_count; nr++) {
+		struct ws_window *w = &windows[nr];
+		memset(w, 0, sizeof(*w));
+		w->w_name = ws_names[nr];
+		// same interpretation as bash and gawk: leading 0 means octal
+		w->w_window = strtol(w->w_name, NULL, 0);
+		w->w_advance = w->w_window > 0 ? w->w_window : 1;
+		w->w_log = open_output("%s.g30.ws_log.%s.extra", out, w->w_name);
+		if (w->w_window > 5) {
+			w->w_sum = open_output("%s.g32.sum_dist.%s.extra", out, w->w_name);
+			w->w_avg = open_output("%s.g33.avg_dist.%s.extra", out, w->w_name);
+		}
+	}
+
+	for (i = 0; i < record_count; i++) {
+		struct record *rec = &records[order_setpoint[i]];
+		unsigned long long key = (unsigned long long)rec->rec_sector / ws_block;
+
+		for (nr = 0; nr < ws_count; nr++) {
+			struct ws_window *w = &windows[nr];
+			if (!w->w_start)
+				w->w_start = rec->rec_start;
+			while (rec->rec_start >= w->w_start + w->w_advance)
+				ws_window_flush(w);
+			ws_set_add(&w->w_set, key);
+		}
+	}
+
+	for (nr = 0; nr < ws_count; nr++) {
+		struct ws_window *w = &windows[nr];
+		char link_src[4096];
+		char link_dst[4096];
+
+		ws_set_free(&w->w_set);
+		close_output(w->w_log);
+		if (w->w_sum) {
+			close_output(w->w_sum);
+			close_output(w->w_avg);
+		}
+		snprintf(link_src, sizeof(link_src), "%s.g30.ws_log.%s.extra", out, w->w_name);
+		snprintf(link_dst, sizeof(link_dst), "%s.g31.ws_lin.%s.extra", out, w->w_name);
+		unlink(link_dst);
+		if (symlink(link_src, link_dst) < 0)
+			printf("WARN: cannot create symlink '%s' (errno=%d)\n", link_dst, errno);
+	}
+	free(windows);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// verbose mode, from the "INFO: action=" lines
+
+/* Value of " <name>=" like extract_fields: digits and dots,
+ * or a quoted string.
+ */
+static
+int extract_field(const char *line, const char *name, char *buf, int size, const char **end)
+{
+	char pattern[64];
+	const char *pos;
+	int len;
+
+	snprintf(pattern, sizeof(pattern), " %s=", name);
+	pos = strstr(line, pattern);
+	if (!pos)
+		return 0;
+	pos += strlen(pattern);
+	if (*pos == '\'') {
+		const char *tmp = strchr(pos + 1, '\'');
+		if (!tmp)
+			return 0;
+		len = tmp + 1 - pos;
+	} else {
+		len = strspn(pos, "0123456789.");
+	}
+	if (len >= size)
+		len = size - 1;
+	memcpy(buf, pos, len);
+	buf[len] = '\0';
+	if (end)
+		*end = pos + len;
+	return 1;
+}
+
+static
+int has_action(const char *line, const char *a, const char *b)
+{
+	char pattern[64];
+
+	snprintf(pattern, sizeof(pattern), "'%s'", a);
+	if (strstr(line, pattern))
+		return 1;
+	if (!b)
+		return 0;
+	snprintf(pattern, sizeof(pattern), "'%s'", b);
+	return strstr(line, pattern) != NULL;
+}
+
+static
+void verbose_level(const char *field, const char *name)
+{
+	FILE *res = open_output("%s.%s", out, name);
+	int i;
+
+	for (i = 0; i < verbose_count; i++) {
+		char buf[256];
+		if (!has_action(verbose_lines[i], "submit", "got_answer"))
+			continue;
+		if (extract_field(verbose_lines[i], field, buf, sizeof(buf), NULL))
+			fprintf(res, "%s\n", buf);
+	}
+	close_output(res);
+}
+
+static
+void task_verbose_levels(int mode)
+{
+	FILE *res;
+	int i;
+
+	verbose_level("count_submitted", "g50.submit_level");
+	verbose_level("count_pushback", "g51.pushback_level");
+
+	res = open_output("%s.g52.submit_ahead", out);
+	for (i = 0; i < verbose_count; i++) {
+		char real_time[256];
+		char rq_time[256];
+		const char *end;
+		if (!has_action(verbose_lines[i], "submit", NULL))
+			continue;
+		if (!extract_field(verbose_lines[i], "real_time", real_time, sizeof(real_time), &end) ||
+		    !extract_field(end, "rq_time", rq_time, sizeof(rq_time), NULL))
+			continue;
+		fprintf(res, "%14.9f\n", num(rq_time) - num(real_time));
+	}
+	close_output(res);
+}
+
+struct stamp {
+	double s_seqnr;
+	double s_time;
+	int s_nr;
+};
+
+static
+int compare_stamp(const void *_a, const void *_b)
+{
+	const struct stamp *a = _a;
+	const struct stamp *b = _b;
+
+	if (a->s_seqnr < b->s_seqnr)
+		return -1;
+	if (a->s_seqnr > b->s_seqnr)
+		return 1;
+	return a->s_nr - b->s_nr;
+}
+
+/* Like diff_timestamps / _diff_timestamps followed by cumul.
+ */
+static
+void verbose_diff(const char *a, const char *b, int by_seqnr, const char *name, const char *cumul_name)
+{
+	FILE *res = open_output("%s.%s", out, name);
+	FILE *cumul = open_output("%s.%s", out, cumul_name);
+	struct stamp *list = xmalloc(sizeof(struct stamp) * (verbose_count + 1));
+	double old = 0;
+	double sum = 0;
+	int count = 0;
+	int i;
+
+	for (i = 0; i < verbose_count; i++) {
+		char real_time[256];
+		char seqnr[256];
+		const char *end;
+		if (!has_action(verbose_lines[i], a, b))
+			continue;
+		if (!extract_field(verbose_lines[i], "real_time", real_time, sizeof(real_time), &end))
+			continue;
+		if (by_seqnr) {
+			if (!extract_field(end, "seqnr", seqnr, sizeof(seqnr), NULL))
+				continue;
+			list[count].s_seqnr = num(seqnr);
+		}
+		list[count].s_time = num(real_time);
+		list[count].s_nr = count;
+		count++;
+	}
+	if (by_seqnr)
+		qsort(list, count, sizeof(struct stamp), compare_stamp);
+
+	for (i = 0; i < count; i++) {
+		if (i % 2) {
+			char buf[64];
+			snprintf(buf, sizeof(buf), "%14.9f", list[i].s_time - old);
+			fprintf(res, "%s\n", buf);
+			sum += strtod(buf, NULL);
+			fprintf(cumul, "%14.9f\n", sum);
+		}
+		old = list[i].s_time;
+	}
+	free(list);
+	close_output(res);
+	close_output(cumul);
+}
+
+static
+void task_verbose_submit_lag(int mode)
+{
+	verbose_diff("submit", "worker_got_rq", 1, "g53.submit_lag", "g53.submit_lag_cumul");
+}
+
+static
+void task_verbose_answer_lag(int mode)
+{
+	verbose_diff("worker_send_answer", "got_answer", 1, "g54.answer_lag", "g54.answer_lag_cumul");
+}
+
+static
+void task_verbose_input_wait(int mode)
+{
+	verbose_diff("wait_for_input", "got_input", 0, "g55.input_wait", "g55.input_wait_cumul");
+}
+
+static
+void task_verbose_answer_wait(int mode)
+{
+	verbose_diff("wait_for_answer", "got_answer", 0, "g56.answer_wait", "g56.answer_wait_cumul");
+}
+
+/////////////////////////////////////////////////////////////////
+
+// variables, like extract_variables
+
+static const char *var_list[] = {
+	"use_my_guess", "dry_run", "use_o_direct", "use_o_sync", "wraparound_factor", "size_of_device", NULL
+};
+
+char *vars[MAX_VARS];
+int var_count = 0;
+
+/* Match a variable name where each '_' may also be a sequence
+ * of blanks, followed by '=' or ':' and a value.
+ * Returns the length of the match, or 0.
+ */
+static
+int match_var(const char *str, const char *name, char *res, int size)
+{
+	const char *pos = str;
+	const char *end_name;
+	const char *value;
+	int len;
+
+	for (; *name; name++) {
+		if (*name == '_') {
+			if (*pos != '_' && *pos != ' ')
+				return 0;
+			while (*pos == '_' || *pos == ' ')
+				pos++;
+			continue;
+		}
+		if (*pos != *name)
+			return 0;
+		pos++;
+	}
+	end_name = pos;
+	while (*pos == ' ')
+		pos++;
+	if (*pos != '=' && *pos != ':')
+		return 0;
+	pos++;
+	while (*pos == ' ')
+		pos++;
+	value = pos;
+	if (*pos == '\'') {
+		const char *tmp = strchr(pos + 1, '\'');
+		if (!tmp)
+			return 0;
+		len = tmp + 1 - pos;
+	} else {
+		len = strspn(pos, "0123456789.");
+		if (!len)
+			return 0;
+	}
+	if ((end_name - str) + len + 2 > size)
+		return 0;
+	snprintf(res, size, "%.*s=%.*s", (int)(end_name - str), str, len, value);
+	return value + len - str;
+}
+
+/* Like sed 's/ \+/_/g'
+ */
+static
+void blanks_to_underscore(char *buf)
+{
+	char *dst = buf;
+	char *src = buf;
+
+	while (*src) {
+		if (*src == ' ') {
+			while (*src == ' ')
+				src++;
+			*dst++ = '_';
+			continue;
+		}
+		*dst++ = *src++;
+	}
+	*dst = '\0';
+}
+
+static
+void add_var(const char *var)
+{
+	int i;
+
+	for (i = 0; i < var_count; i++) {
+		if (!strcmp(vars[i], var))
+			return;
+	}
+	if (var_count < MAX_VARS)
+		vars[var_count++] = strdup(var);
+}
+
+/* Whole segments which already look like name=value
+ * are taken over as well, as the grep in extract_variables did.
+ */
+static
+void check_segment(const char *str, int len)
+{
+	char buf[256];
+	int i;
+
+	if (len <= 0 || len >= sizeof(buf))
+		return;
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	if (!islower(buf[0]))
+		return;
+	for (i = 0; islower(buf[i]) || buf[i] == '_' || buf[i] == ' '; i++)
+		;
+	if (buf[i] != '=')
+		return;
+	if (buf[i + 1] == '\'') {
+		char *tmp = strchr(buf + i + 2, '\'');
+		if (!tmp || tmp[1])
+			return;
+	} else if (!buf[i + 1] || strspn(buf + i + 1, "0123456789.") != strlen(buf + i + 1)) {
+		return;
+	}
+	blanks_to_underscore(buf);
+	add_var(buf);
+}
+
+static
+void extract_variables(const char *line)
+{
+	const char *seg = line;
+	const char *pos;
+
+	if (!isalpha(line[0]) && line[0] != '#')
+		return;
+	for (pos = line; *pos; ) {
+		char buf[256];
+		int best = 0;
+		int i;
+
+		for (i = 0; var_list[i]; i++) {
+			char tmp[256];
+			int len = match_var(pos, var_list[i], tmp, sizeof(tmp));
+			if (len > best) {
+				best = len;
+				strcpy(buf, tmp);
+			}
+		}
+		if (!best) {
+			pos++;
+			continue;
+		}
+		check_segment(seg, pos - seg);
+		blanks_to_underscore(buf);
+		add_var(buf);
+		pos += best;
+		seg = pos;
+	}
+	check_segment(seg, strlen(seg));
+}
+
+static
+int compare_var(const void *a, const void *b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// input
+
+static
+void add_record(char *line)
+{
+	struct record rec = {};
+	char *fields[MAX_FIELDS] = {};
+	size_t len = strlen(line);
+	long long base;
+	char *pos;
+	int i;
+
+	// flags for the mode selection regexes of graph.sh
+	for (pos = line; (pos = strchr(pos, ' ')); pos++) {
+		if (!pos[1] || pos[2] != ' ')
+			continue;
+		switch (pos[1]) {
+		case 'r':
+			rec.rec_flags |= 1 << MODE_R_PUSH;
+			/* fallthrough */
+		case 'R':
+			rec.rec_flags |= 1 << MODE_READS;
+			break;
+		case 'w':
+			rec.rec_flags |= 1 << MODE_W_PUSH;
+			/* fallthrough */
+		case 'W':
+			rec.rec_flags |= 1 << MODE_WRITES;
+			break;
+		}
+	}
+
+	for (i = 0, pos = line; i < MAX_FIELDS && pos; i++) {
+		char *next = strchr(pos, ';');
+		fields[i] = pos;
+		if (next)
+			*next++ = '\0';
+		pos = next;
+	}
+
+	// awk filter for garbage lines
+	if (!below_limit(fields[0]) ||
+	    !below_limit(fields[4]) ||
+	    !below_limit(fields[5]))
+		return;
+
+	rec.rec_start = num(fields[0]);
+	rec.rec_sector = num(fields[1]);
+	rec.rec_length = num(fields[2]);
+	rec.rec_delay = num(fields[4]);
+	rec.rec_duration = num(fields[5]);
+	rec.rec_real = rounded(rec.rec_start + rec.rec_delay);
+	rec.rec_completed = rounded(rec.rec_start + rec.rec_delay + rec.rec_duration);
+	rec.rec_nr = ++record_count;
+
+	base = spill_write(&text_spill, line, len + 1);
+	for (i = 0; i < MAX_FIELDS; i++)
+		rec.rec_text[i] = fields[i] ? base + (fields[i] - line) : -1;
+	spill_write(&record_spill, &rec, sizeof(rec));
+}
+
+static
+void read_input(FILE *inp)
+{
+	FILE *warnings = open_output("%s/warnings", tmp);
+	FILE *start_time = open_output("%s/start_time", tmp);
+	char *line = NULL;
+	size_t alloc = 0;
+	int have_start = 0;
+	ssize_t len;
+
+	spill_open(&record_spill, "records");
+	spill_open(&text_spill, "texts");
+	while ((len = getline(&line, &alloc, inp)) >= 0) {
+		char *pos;
+
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		if (!strncmp(line, "WARN", 4))
+			fprintf(warnings, "%s\n", line);
+		if (!have_start && (pos = strstr(line, " started at "))) {
+			char *last;
+			while ((last = strstr(pos + 1, "started at ")))
+				pos = last;
+			pos = strstr(pos, "started at ") + strlen("started at ");
+			fprintf(start_time, "%s\n", pos);
+			have_start = 1;
+		}
+		extract_variables(line);
+		if (verbose_mode && !strncmp(line, "INFO: action=", 13)) {
+			if (verbose_count >= verbose_alloc) {
+				verbose_alloc = verbose_alloc ? verbose_alloc * 2 : 4096;
+				verbose_lines = xrealloc(verbose_lines, sizeof(char *) * verbose_alloc);
+			}
+			verbose_lines[verbose_count++] = arena_strdup(line);
+		}
+
+		if (strchr(line, ';') && !strstr(line, "replay_"))
+			add_record(line);
+	}
+	free(line);
+	records = spill_map(&record_spill);
+	texts = spill_map(&text_spill);
+	if (!have_start)
+		fprintf(start_time, "\n");
+	close_output(warnings);
+	close_output(start_time);
+}
+
+static
+void write_vars(void)
+{
+	FILE *res = open_output("%s/vars", tmp);
+	int i;
+
+	qsort(vars, var_count, sizeof(char *), compare_var);
+	for (i = 0; i < var_count; i++)
+		fprintf(res, "%s\n", vars[i]);
+	close_output(res);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// thread pool
+
+struct task {
+	void (*t_fn)(int arg);
+	int t_arg;
+};
+
+struct task *tasks = NULL;
+int task_count = 0;
+int task_next = 0;
+pthread_mutex_t task_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static
+void add_task(void (*fn)(int arg), int arg)
+{
+	tasks = xrealloc(tasks, sizeof(struct task) * (task_count + 1));
+	tasks[task_count].t_fn = fn;
+	tasks[task_count].t_arg = arg;
+	task_count++;
+}
+
+static
+void *worker(void *arg)
+{
+	for (;;) {
+		struct task *task;
+
+		pthread_mutex_lock(&task_mutex);
+		task = task_next < task_count ? &tasks[task_next++] : NULL;
+		pthread_mutex_unlock(&task_mutex);
+		if (!task)
+			break;
+		task->t_fn(task->t_arg);
+	}
+	return NULL;
+}
+
+/* Run all pending tasks, and wait for their completion.
+ */
+static
+void run_tasks(void)
+{
+	pthread_t threads[256];
+	int count = thread_count;
+	int i;
+
+	if (count > task_count - task_next)
+		count = task_count - task_next;
+	if (count > 256)
+		count = 256;
+	for (i = 0; i < count; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL)) {
+			printf("FATAL ERROR: cannot create thread\n");
+			exit(-1);
+		}
+	}
+	for (i = 0; i < count; i++)
+		pthread_join(threads[i], NULL);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+static
+void usage(const char *name)
+{
+	printf("usage: %s --out=<prefix> --tmp=<dir> [options] < input\n"
+	       "  --static --dynamic --verbose\n"
+	       "  --thrp-window=<sec> --turn-window=<sec> --smooth-window=<sec>\n"
+	       "  --bad-latency=<sec> --bad-delay=<sec> --ws-list=\"<window> ...\"\n"
+	       "  --ws-block=<sectors> --threads=<count> --raster=<width>x<height>\n",
+	       name);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	char *ws_copy;
+	char *tmp_str;
+	int mode;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (!strncmp(arg, "--out=", 6)) {
+			out = arg + 6;
+		} else if (!strncmp(arg, "--tmp=", 6)) {
+			tmp = arg + 6;
+		} else if (!strcmp(arg, "--static")) {
+			static_mode = 1;
+		} else if (!strcmp(arg, "--dynamic")) {
+			dynamic_mode = 1;
+		} else if (!strcmp(arg, "--verbose")) {
+			verbose_mode = 1;
+		} else if (!strncmp(arg, "--thrp-window=", 14)) {
+			thrp_window = atoi(arg + 14);
+		} else if (!strncmp(arg, "--turn-window=", 14)) {
+			turn_window = atoi(arg + 14);
+		} else if (!strncmp(arg, "--smooth-window=", 16)) {
+			smooth_window = atof(arg + 16);
+		} else if (!strncmp(arg, "--bad-latency=", 14)) {
+			bad_latency = atof(arg + 14);
+		} else if (!strncmp(arg, "--bad-delay=", 12)) {
+			bad_delay = atof(arg + 12);
+		} else if (!strncmp(arg, "--ws-list=", 10)) {
+			ws_list = arg + 10;
+		} else if (!strncmp(arg, "--ws-block=", 11)) {
+			ws_block = atoll(arg + 11);
+		} else if (!strncmp(arg, "--threads=", 10)) {
+			thread_count = atoi(arg + 10);
+		} else if (!strncmp(arg, "--raster=", 9)) {
+			if (sscanf(arg + 9, "%dx%d", &raster_width, &raster_height) != 2 ||
+			    raster_width <= 0 || raster_height <= 0) {
+				printf("ERROR: bad raster size '%s'\n", arg + 9);
+				usage(argv[0]);
+			}
+		} else {
+			printf("ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		}
+	}
+	if (!out || !tmp)
+		usage(argv[0]);
+	if (thrp_window <= 0)
+		thrp_window = 1;
+	if (ws_block <= 0)
+		ws_block = 1;
+	if (thread_count <= 0)
+		thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (thread_count <= 0)
+		thread_count = 1;
+
+	ws_copy = strdup(ws_list);
+	for (tmp_str = strtok(ws_copy, " \t"); tmp_str && ws_count < MAX_WS; tmp_str = strtok(NULL, " \t"))
+		ws_names[ws_count++] = tmp_str;
+
+	read_input(stdin);
+	write_vars();
+
+	// phase 1: orderings, and everything not depending on them
+	add_task(task_sort_setpoint, 0);
+	if (dynamic_mode)
+		add_task(task_sort_realtime, 0);
+	add_task(task_sort_completed, 0);
+	add_task(task_duration_demand, 0);
+	for (mode = 0; mode < MODE_MAX; mode++) {
+		if (static_mode && !IS_PUSH(mode)) {
+			add_task(task_rqsize, mode);
+			add_task(task_rqpos, mode);
+		}
+		if (!IS_PUSH(mode))
+			add_task(task_freq, mode);
+		if (dynamic_mode) {
+			if (mode != MODE_ALL)
+				add_task(task_dyn_points, mode);
+			add_task(task_dyn_bins, mode);
+			if (raster_width && (mode == MODE_READS || mode == MODE_WRITES || mode == MODE_ALL))
+				add_task(task_dyn_raster, mode);
+			add_task(task_latency_flying, mode);
+			add_task(task_delay_flying, mode);
+		}
+	}
+	if (verbose_mode) {
+		add_task(task_verbose_levels, 0);
+		add_task(task_verbose_submit_lag, 0);
+		add_task(task_verbose_answer_lag, 0);
+		add_task(task_verbose_input_wait, 0);
+		add_task(task_verbose_answer_wait, 0);
+	}
+	run_tasks();
+
+	// phase 2: everything based on the orderings
+	add_task(task_overview_demand, 0);
+	add_task(task_overview_actual, 0);
+	if (ws_count > 0)
+		add_task(task_ws, 0);
+	for (mode = 0; mode < MODE_MAX; mode++) {
+		if (dynamic_mode && mode != MODE_ALL) {
+			add_task(task_dyn_setpoint, mode);
+			// the density rasters replace these point plots
+			if (!raster_width)
+				add_task(task_dyn_realtime, mode);
+			add_task(task_dyn_completed, mode);
+		}
+		add_task(task_thr_setpoint, mode);
+		if (dynamic_mode) {
+			add_task(task_thr_completed, mode);
+			if (!IS_PUSH(mode))
+				add_task(task_turns_completed, mode);
+		}
+		if ((static_mode || dynamic_mode) && !IS_PUSH(mode))
+			add_task(task_turns_setpoint, mode);
+	}
+	run_tasks();
+
+	printf("INFO: analyzed %d requests with %d threads\n", record_count, thread_count);
+	return 0;
+}
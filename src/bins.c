@@ -21,58 +21,210 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 
-#include <math.h>
+#include "histogram.h"
 
-#if !HAVE_DECL_EXP10
-# define exp10(x) (exp((x) * log(10)))
-#endif
+/* Logarithmic histograms of numbers read from stdin.
+ *
+ * Compatible usage: bins.exe [<subdiv>] reads one value per line
+ * and prints "<value> <count>" lines for the used range.
+ *
+ * With --columns, several fields of each line are binned in a single
+ * pass. Partial results can be saved with --save and combined later
+ * with --merge, and --percentiles prints percentile values.
+ */
+
+#define MAX_COLUMNS 32
+#define BUF_SIZE    4096
+
+double bin_subdiv = HIST_DEFAULT_SUBDIV;
+int columns[MAX_COLUMNS];
+int column_count = 0;
+char separator = ';';
+char *out_list = NULL;
+char *save_file = NULL;
+char *percentile_list = NULL;
+int merge_count = 0;
 
-#define MAX_BINS (1024 * 1024 * 8)
+struct histogram hist[MAX_COLUMNS];
 
-double bin_subdiv = 10.0;
-int bin_min = MAX_BINS;
-int bin_max = 0;
-int bin_count[MAX_BINS];
+static
+void usage(const char *name)
+{
+	printf("usage: %s [<subdiv>] [options] < <values>\n"
+	       "  --subdiv=<n>           buckets per decade (default 10)\n"
+	       "  --columns=<c>,...      bin these fields (1-based, default: first value of the line)\n"
+	       "  --sep=<char>           field separator for --columns (default ';')\n"
+	       "  --out=<file>,...       bins of each column ('-' for stdout, default '-' for a single column)\n"
+	       "  --save=<file>          save all columns as binary partial histogram\n"
+	       "  --merge=<file>         add a saved partial, may be repeated (stdin is not read then)\n"
+	       "  --percentiles=<p>,...  print these percentiles of each column\n",
+	       name);
+	exit(-1);
+}
 
-void put_bin(double val)
+static
+void read_input(FILE *in)
 {
-	int bin;
+	char buf[BUF_SIZE];
 
-	if (val <= 0)
-		return;
+	while (fgets(buf, sizeof(buf), in)) {
+		char *ptr = buf;
+		int field = 1;
+		int i;
 
-	bin = log10(val) * bin_subdiv;
-	bin += MAX_BINS/2;
-	if (bin < 0 || bin >= MAX_BINS)
-		return;
+		if (!column_count) {
+			hist_put(&hist[0], strtod(buf, NULL));
+			continue;
+		}
+		/* columns[] is sorted by field number, so a single scan
+		 * over the line is enough.
+		 */
+		for (i = 0; i < column_count; i++) {
+			while (field < columns[i] && *ptr) {
+				if (*ptr++ == separator)
+					field++;
+			}
+			if (field == columns[i])
+				hist_put(&hist[i], strtod(ptr, NULL));
+		}
+	}
+}
 
-	bin_count[bin]++;
+static
+void print_percentiles(int nr, FILE *out)
+{
+	char *list = strdup(percentile_list);
+	char *tmp;
 
-	if (bin < bin_min)
-		bin_min = bin;
-	if (bin >= bin_max)
-		bin_max = bin + 1;
+	fprintf(out, "column=%d count=%lld", column_count ? columns[nr] : 1, hist[nr].h_total);
+	for (tmp = strtok(list, ","); tmp; tmp = strtok(NULL, ",")) {
+		fprintf(out, " p%s=%le", tmp, hist_percentile(&hist[nr], atof(tmp)));
+	}
+	fprintf(out, "\n");
+	free(list);
 }
 
-int main(int argc, const char *argv[])
+int main(int argc, char *argv[])
 {
+	int count;
 	int i;
-	char buf[4096];
 
-	if (argc > 1) {
-		bin_subdiv = atof(argv[1]);
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (isdigit(arg[0]) || arg[0] == '.') {
+			bin_subdiv = atof(arg);
+		} else if (!strncmp(arg, "--subdiv=", 9)) {
+			bin_subdiv = atof(arg + 9);
+		} else if (!strncmp(arg, "--columns=", 10)) {
+			char *tmp;
+
+			for (tmp = strtok(arg + 10, ","); tmp && column_count < MAX_COLUMNS; tmp = strtok(NULL, ",")) {
+				columns[column_count] = atoi(tmp);
+				if (columns[column_count] <= 0 ||
+				    (column_count > 0 && columns[column_count] <= columns[column_count - 1])) {
+					printf("ERROR: columns must be ascending field numbers\n");
+					usage(argv[0]);
+				}
+				column_count++;
+			}
+		} else if (!strncmp(arg, "--sep=", 6)) {
+			separator = arg[6];
+		} else if (!strncmp(arg, "--out=", 6)) {
+			out_list = arg + 6;
+		} else if (!strncmp(arg, "--save=", 7)) {
+			save_file = arg + 7;
+		} else if (!strncmp(arg, "--merge=", 8)) {
+			merge_count++;
+		} else if (!strncmp(arg, "--percentiles=", 14)) {
+			percentile_list = arg + 14;
+		} else {
+			printf("ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		}
+	}
+	if (bin_subdiv <= 0)
+		usage(argv[0]);
+	count = column_count ? column_count : 1;
+	for (i = 0; i < count; i++)
+		hist_init(&hist[i], bin_subdiv);
+	if (!out_list && !save_file && !percentile_list) {
+		if (count > 1) {
+			printf("ERROR: --out is needed for multiple columns\n");
+			usage(argv[0]);
+		}
+		out_list = "-";
+	}
+
+	if (merge_count) {
+		for (i = 1; i < argc; i++) {
+			FILE *in;
+			int nr;
+
+			if (strncmp(argv[i], "--merge=", 8))
+				continue;
+			in = fopen(argv[i] + 8, "r");
+			if (!in) {
+				printf("ERROR: cannot open '%s'\n", argv[i] + 8);
+				exit(-1);
+			}
+			// exactly one histogram per column
+			for (nr = 0; nr < count; nr++) {
+				if (hist_load(&hist[nr], in))
+					break;
+			}
+			if (nr < count || getc(in) != EOF) {
+				printf("ERROR: '%s' is not a matching histogram file\n", argv[i] + 8);
+				exit(-1);
+			}
+			fclose(in);
+		}
+	} else {
+		read_input(stdin);
 	}
-	
-	while (fgets(buf, sizeof(buf), stdin)) {
-		double val = 0;
-		sscanf(buf, " %lf", &val);
-		put_bin(val);
+
+	if (out_list) {
+		char *tmp = strtok(out_list, ",");
+
+		for (i = 0; i < count && tmp; i++, tmp = strtok(NULL, ",")) {
+			FILE *out = stdout;
+
+			if (strcmp(tmp, "-"))
+				out = fopen(tmp, "w");
+			if (!out) {
+				printf("ERROR: cannot create '%s'\n", tmp);
+				exit(-1);
+			}
+			hist_print(&hist[i], out);
+			if (out != stdout)
+				fclose(out);
+		}
 	}
+	if (save_file) {
+		FILE *out = strcmp(save_file, "-") ? fopen(save_file, "w") : stdout;
 
-	for (i = bin_min; i < bin_max; i++) {
-		printf("%le %6d\n", exp10((double)(i - MAX_BINS/2) / bin_subdiv), bin_count[i]);
+		if (!out) {
+			printf("ERROR: cannot create '%s'\n", save_file);
+			exit(-1);
+		}
+		for (i = 0; i < count; i++) {
+			if (hist_save(&hist[i], out)) {
+				printf("ERROR: cannot write '%s'\n", save_file);
+				exit(-1);
+			}
+		}
+		if (out != stdout)
+			fclose(out);
+	}
+	if (percentile_list) {
+		for (i = 0; i < count; i++)
+			print_percentiles(i, stdout);
 	}
+	for (i = 0; i < count; i++)
+		hist_free(&hist[i]);
 
 	return 0;
 }
@@ -81,6 +81,8 @@
 
 #include <signal.h>
 
+#include <sched.h>
+
 #ifdef HAVE_SYS_STAT_H
 # include <sys/stat.h>
 #endif
@@ -89,6 +91,20 @@
 # include <sys/types.h>
 #endif
 
+#include <sys/mman.h>
+
+#if HAVE_DECL_DLOPEN
+# include <dlfcn.h>
+#endif
+
+#include "io_backend.h"
+#include "sampling.h"
+
+#ifdef __linux__
+# include <sys/sysmacros.h>
+# include <sys/syscall.h>
+#endif
+
 /**********************************************************
  *
  */
@@ -124,6 +140,7 @@
 #define DEFAULT_THREADS      1024
 #define DEFAULT_FAN_OUT         4
 #define DEFAULT_SPEEDUP       1.0
+#define MAX_DEVICES           256
 
 #ifndef TMP_DIR
 # define TMP_DIR "/tmp"
@@ -143,7 +160,6 @@ int replay_end = 0;
 int replay_duration = 0;
 int replay_out = 0;
 int already_forked = 0;
-int overflow = 0;
 int verify_fd = -1;
 int complete_fd = -1;
 int main_fd = -1;
@@ -185,6 +201,30 @@ int fan_out = DEFAULT_FAN_OUT;
 int verbose = 0;
 int bottleneck = 0;
 
+char *cpus_main = NULL;    // CPU lists for pinning the process roles
+char *cpus_submit = NULL;
+char *cpus_answer = NULL;
+char *cpus_worker = NULL;
+int numa_node = -1;        // -1 = don't care
+int numa_auto = 0;         // determine numa_node from <device>
+
+int closed_loop = 0;       // 0 = open loop, else queue depth
+int closed_loop_max = 0;   // sweep by doubling up to this queue depth
+int closed_loop_step = 10; // duration of each sweep step (in seconds)
+int closed_loop_qd = 0;    // current queue depth of the sweep
+
+int dependency_mode = 0;   // as fast as possible, keeping inferred dependencies
+FLOAT dependency_gap = 0.001; // max think time of a dependency (in seconds)
+
+int search_mode = 0;       // adaptive search for the max sustainable speedup
+int search_interval = 10;  // measurement interval (in seconds)
+FLOAT search_percentile = 99.0;
+FLOAT search_latency = 0.05; // bound for the latency percentile (in seconds)
+FLOAT search_lag = 1.0;      // bound for the replay_delay percentile (in seconds)
+FLOAT search_precision = 0.02;
+
+char *precondition = NULL; // synthetic write load until steady state
+
 int count_submitted = 0;   // number of requests on the fly
 int count_catchup = 0;     // number of requests catching up
 int count_pushback = 0;    // number of requests on pushback list
@@ -199,6 +239,7 @@ int statist_completed = 0; // number of completed requests
 int statist_dropped = 0;   // number of dropped requests (verify_mode == 1)
 int statist_pushback = 0;  // number of pushed back requests (verify_mode == 2)
 int statist_ordered = 0;   // number of waits (verify_mode == 3)
+int statist_logical = 0;   // number of completed logical requests (striping)
 long long verify_errors = 0;
 long long verify_errors_after = 0;
 long long verify_mismatches = 0;
@@ -208,10 +249,10 @@ struct timespec start_grace = {
 };
 struct timespec start_stamp = {};
 struct timespec first_stamp = {};
-struct timespec timeshift = {};
 struct timespec meta_delays = {};
 long long meta_delay_count;
 struct timespec simulate_io = {};
+char *sim_device = NULL;
 struct timespec ahead_limit = {};
 
 #define _STRINGIFY(x) #x
@@ -280,28 +321,249 @@ void flush_stdout(void)
 }
 
 static
-void set_role(char *txt)
+void do_exit(int status)
 {
-	my_role = txt;
 	if (verbose > 0) {
-		printf("INFO: process pid=%d role='%s'\n",
+		printf("INFO: exit pid=%d role='%s' status=%d flush_total=%lu.%09lu\n",
 		       getpid(),
-		       my_role);
+		       my_role,
+		       status,
+		       flush_total.tv_sec, flush_total.tv_nsec);
+	}
+	exit(status);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+// CPU and NUMA placement
+
+/* Each process role may be pinned to its own set of CPUs.
+ * Roles without an explicit CPU list fall back to the CPUs of the
+ * NUMA node (when given), otherwise to the original affinity mask.
+ * Thus children never silently inherit the pinning of their parents.
+ */
+
+#ifdef CPU_SETSIZE
+
+static
+int read_sysfs(const char *path, char *buf, int len)
+{
+	FILE *f = fopen(path, "r");
+	int ok;
+
+	if (!f)
+		return 0;
+	ok = !!fgets(buf, len, f);
+	fclose(f);
+	return ok;
+}
+
+static cpu_set_t orig_cpus;
+static cpu_set_t node_cpus;
+static int has_node_cpus = 0;
+static int placement_active = 0;
+
+static const struct placement {
+	char  *pl_role;
+	char **pl_cpus;
+} placement_table[] = {
+	{ "main",              &cpus_main   },
+	{ "submit_dispatcher", &cpus_submit },
+	{ "answer_dispatcher", &cpus_answer },
+	{ "worker",            &cpus_worker },
+	{}
+};
+
+/* Parse the Linux cpulist syntax, e.g. "0-3,8,10-11"
+ */
+static
+int parse_cpulist(const char *txt, cpu_set_t *set)
+{
+	int count = 0;
+
+	CPU_ZERO(set);
+	while (*txt && *txt != '\n') {
+		int from;
+		int to;
+		int len = 0;
+
+		if (sscanf(txt, "%d%n", &from, &len) != 1)
+			return -1;
+		txt += len;
+		to = from;
+		if (*txt == '-') {
+			txt++;
+			if (sscanf(txt, "%d%n", &to, &len) != 1)
+				return -1;
+			txt += len;
+		}
+		if (from < 0 || to < from || to >= CPU_SETSIZE)
+			return -1;
+		for (; from <= to; from++) {
+			CPU_SET(from, set);
+			count++;
+		}
+		if (*txt == ',')
+			txt++;
+		else if (*txt && *txt != '\n')
+			return -1;
+	}
+	return count;
+}
+
+static
+int device_numa_node(const char *name)
+{
+	static const char *candidates[] = {
+		"/sys/dev/block/%u:%u/device/numa_node",
+		"/sys/dev/block/%u:%u/device/device/numa_node",
+		"/sys/dev/block/%u:%u/../device/numa_node",         // partitions
+		"/sys/dev/block/%u:%u/../device/device/numa_node",
+		NULL
+	};
+	struct stat st;
+	int i;
+
+	if (stat(name, &st) < 0 || !S_ISBLK(st.st_mode))
+		return -1;
+
+	for (i = 0; candidates[i]; i++) {
+		char path[256];
+		char buf[64];
+		int node;
+
+		snprintf(path, sizeof(path), candidates[i], major(st.st_rdev), minor(st.st_rdev));
+		if (read_sysfs(path, buf, sizeof(buf)) &&
+		    sscanf(buf, "%d", &node) == 1 &&
+		    node >= 0)
+			return node;
+	}
+	return -1;
+}
+
+/* Prefer node-local memory for all buffers.
+ * The policy is inherited by all children.
+ */
+static
+void set_numa_memory(int node)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+# ifndef MPOL_PREFERRED
+#  define MPOL_PREFERRED 1
+# endif
+	unsigned long mask[16] = {};
+	int bits = 8 * sizeof(unsigned long);
+
+	if (node >= (int)(sizeof(mask) * 8))
+		return;
+	mask[node / bits] |= 1UL << (node % bits);
+	if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8 + 1) < 0) {
+		printf("WARN: cannot set NUMA memory policy for node %d (%d %s)\n", node, errno, strerror(errno));
 		flush_stdout();
 	}
+#endif
 }
 
 static
-void do_exit(int status)
+void placement_init(void)
+{
+	const struct placement *pl;
+	cpu_set_t check;
+
+	for (pl = placement_table; pl->pl_role; pl++) {
+		if (!*pl->pl_cpus)
+			continue;
+		if (parse_cpulist(*pl->pl_cpus, &check) <= 0) {
+			printf("ERROR: bad CPU list '%s' for role '%s'\n", *pl->pl_cpus, pl->pl_role);
+			do_exit(-1);
+		}
+		placement_active = 1;
+	}
+
+	if (numa_auto && numa_node < 0 && main_name) {
+		numa_node = device_numa_node(main_name);
+		if (numa_node < 0)
+			printf("INFO: cannot determine NUMA node of device=%s\n", main_name);
+		else
+			printf("INFO: device=%s is attached to NUMA node %d\n", main_name, numa_node);
+		flush_stdout();
+	}
+	if (numa_node >= 0) {
+		char path[256];
+		char buf[4096];
+
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+		if (!read_sysfs(path, buf, sizeof(buf)) ||
+		    parse_cpulist(buf, &node_cpus) <= 0) {
+			printf("ERROR: cannot determine CPUs of NUMA node %d\n", numa_node);
+			do_exit(-1);
+		}
+		has_node_cpus = 1;
+		placement_active = 1;
+		set_numa_memory(numa_node);
+	}
+
+	if (placement_active &&
+	    sched_getaffinity(0, sizeof(orig_cpus), &orig_cpus) < 0) {
+		printf("WARN: cannot determine CPU affinity (%d %s), placement is OFF\n", errno, strerror(errno));
+		flush_stdout();
+		placement_active = 0;
+	}
+}
+
+static
+void set_placement(const char *role)
+{
+	const struct placement *pl;
+	cpu_set_t cpus;
+
+	if (!placement_active)
+		return;
+
+	for (pl = placement_table; pl->pl_role; pl++) {
+		if (!strcmp(pl->pl_role, role))
+			break;
+	}
+	if (pl->pl_role && *pl->pl_cpus)
+		parse_cpulist(*pl->pl_cpus, &cpus);
+	else if (has_node_cpus)
+		memcpy(&cpus, &node_cpus, sizeof(cpus));
+	else
+		memcpy(&cpus, &orig_cpus, sizeof(cpus));
+
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+		printf("WARN: cannot set CPU affinity for pid=%d role='%s' (%d %s)\n", getpid(), role, errno, strerror(errno));
+		flush_stdout();
+	}
+}
+
+#else // CPU_SETSIZE
+
+static
+void placement_init(void)
+{
+	if (cpus_main || cpus_submit || cpus_answer || cpus_worker ||
+	    numa_node >= 0 || numa_auto) {
+		printf("WARN: CPU / NUMA placement is not supported on this platform\n");
+		flush_stdout();
+	}
+}
+
+#define set_placement(role) /*empty*/
+
+#endif // CPU_SETSIZE
+
+static
+void set_role(char *txt)
 {
+	my_role = txt;
+	set_placement(txt);
 	if (verbose > 0) {
-		printf("INFO: exit pid=%d role='%s' status=%d flush_total=%lu.%09lu\n",
+		printf("INFO: process pid=%d role='%s'\n",
 		       getpid(),
-		       my_role,
-		       status,
-		       flush_total.tv_sec, flush_total.tv_nsec);
+		       my_role);
+		flush_stdout();
 	}
-	exit(status);
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -328,15 +590,22 @@ struct request {
 	int verify_errors;
 	short q_nr;
 	short q_index;
+	short dev;
 	char rwbs;
 	char has_version;
 	// starting from here, the rest is _not_ transferred over the pipelines
 	struct request *next;
 	unsigned int *old_version;
+	struct request *parent;    // logical request when striping
+	int pending;               // number of outstanding members
+	int stream;                // index of the input stream
+	long long dep_id;          // input order, in dependency mode
+	double orig_delay;         // replay_delay / replay_duration of the input,
+	double orig_duration;      // only parsed in dependency mode
 };
 
 // the following reduces a potential space bottleneck on the answer pipe
-#define RQ_SIZE (sizeof(struct request) - 2*sizeof(void*))
+#define RQ_SIZE offsetof(struct request, next)
 #ifdef PIPE_BUF
 # define FILL_MAX  (PIPE_BUF / RQ_SIZE)
 #else
@@ -391,6 +660,9 @@ void del_request(long long sector, long long seqnr)
 #define FLY_ZONE        64
 #define FLY_HASH_FN(sector) (((sector) / FLY_ZONE) % FLY_HASH)
 #define FLY_NEXT_ZONE(sector) (((sector / FLY_ZONE) + 1) * FLY_ZONE)
+// different devices never conflict
+#define FLY_DEV_SHIFT   48
+#define FLY_SECTOR(rq) ((rq)->sector + ((long long)(rq)->dev << FLY_DEV_SHIFT))
 
 struct fly {
 	struct fly *fl_next;
@@ -490,140 +762,621 @@ static struct fly_hash fly_hash = {};
 
 ///////////////////////////////////////////////////////////////////////
 
-// abstracting read() and write()
+// multiple devices
 
-static
-int do_read(void *buffer, int len)
-{
-#ifdef HAVE_DECL_NANOSLEEP
-	if (simulate_io.tv_sec || simulate_io.tv_nsec)
-		nanosleep(&simulate_io, NULL);
-#endif
-	if (dry_run)
-		return len;
-	if (mmap_ptr) {
-	}
-	return read(main_fd, buffer, len);
-}
+/* All devices share the dispatchers, the workers and the time base.
+ * main_name / main_fd / main_size always denote the currently
+ * selected device.
+ */
+struct device {
+	char     *dev_name;
+	char     *dev_output;   // NULL = stdout
+	FILE     *dev_out;
+	int       dev_fd;
+	int       dev_overflow;
+	long long dev_size;
+	long long dev_max_size;
+	int       dev_total;
+	int       dev_writes;
+	int       dev_completed;
+	int       dev_did_head;
+};
+
+struct device devices[MAX_DEVICES] = {};
+int device_count = 0;
+
+int stripe_chunk = 0;      // split requests across the devices (in sectors)
+int concat_mode = 0;       // concatenate the devices
+long long logical_size = 0;
+
+int consolidate_mode = 0;  // replay all --input streams concurrently
+
+int main_dev = 0;
 
 static
-int do_write(void *buffer, int len)
+void select_device(int nr)
 {
-#ifdef HAVE_DECL_NANOSLEEP
-	if (simulate_io.tv_sec || simulate_io.tv_nsec)
-		nanosleep(&simulate_io, NULL);
-#endif
-	if (dry_run)
-		return len;
-	if (mmap_ptr) {
-	}
-	return write(main_fd, buffer, len);
+	struct device *dev = &devices[nr];
+	main_dev = nr;
+	main_name = dev->dev_name;
+	main_fd = dev->dev_fd;
+	main_size = dev->dev_size;
 }
 
 ///////////////////////////////////////////////////////////////////////
 
-// version number bookkeeping
+// simulated device for dry runs
 
-static
-unsigned int *get_blockversion(int fd, long long blocknr, int count)
-{
-	int status;
-	void *data;
-	int memlen = count * sizeof(unsigned int);
-	struct timespec t0;
-	struct timespec t1;
-	struct timespec delay;
+/* Parametric model of a rotating disk, a SSD, or a RAID-0 of them.
+ * Each head (disk) or channel (SSD) is a server with its own queue.
+ * The service time depends on the position and size of the request,
+ * and the queueing delay on the other requests on the fly. The state
+ * lives in shared memory, so all workers see the same queues.
+ *
+ * Spec: {hdd|ssd|raid0}{,<param>=<value>}
+ */
 
-	if (!verify_mode)
-		return NULL;
+#define SIM_HDD                 0
+#define SIM_SSD                 1
+#define SIM_MAX_CHANNELS       64
+#define SIM_PAGE                8 // sectors
 
-	clock_gettime(CLOCK_REALTIME, &t0);
+struct sim_server {
+	long long srv_busy_until;  // ns, CLOCK_REALTIME
+	long long srv_head;        // disk: sector after the last request
+	long long srv_written;     // SSD: bytes since the last GC pause
+};
 
-	data = malloc(memlen);
-	if (!data) {
-		printf("FATAL ERROR: out of memory for hashing\n");
-		flush_stdout();
-		verify_mode = 0;
-		return NULL;
-	}
-	if (lseek64(fd, blocknr * sizeof(unsigned int), SEEK_SET) != blocknr * sizeof(unsigned int)) {
-		printf("FATAL ERROR: llseek(%lld) in verify table failed %d (%s)\n", blocknr, errno, strerror(errno));
-		flush_stdout();
-		verify_mode = 0;
-		free(data);
-		return NULL;
-	}
+struct sim_state {
+	volatile int st_lock;
+	struct sim_server st_server[0];
+};
 
-	status = read(fd, data, memlen);
+static struct sim_model {
+	int    sim_type;
+	double sim_members;   // RAID-0 members, 1 = no RAID
+	double sim_chunk;     // RAID-0 chunk size (sectors)
+	double sim_seek_min;  // disk: track-to-track seek (ms)
+	double sim_seek_max;  // disk: full stroke seek (ms)
+	double sim_rpm;
+	double sim_channels;  // SSD
+	double sim_read_us;   // SSD: page read latency
+	double sim_write_us;  // SSD: page program latency
+	double sim_gc_every;  // SSD: MiB written per channel between GC pauses
+	double sim_gc_ms;     // SSD: duration of a GC pause
+	double sim_mbps;      // transfer rate per head / channel (MB/s)
+} sim = {
+	.sim_members  = 1,
+	.sim_chunk    = 128,
+	.sim_seek_min = 0.5,
+	.sim_seek_max = 15.0,
+	.sim_rpm      = 7200,
+	.sim_channels = 8,
+	.sim_read_us  = 80,
+	.sim_write_us = 250,
+	.sim_gc_every = 64,
+	.sim_gc_ms    = 3.0,
+	.sim_mbps     = 150,
+};
 
-	clock_gettime(CLOCK_REALTIME, &t1);
-	timespec_diff(&delay, &t0, &t1);
-	timespec_add(&meta_delays, &delay);
-	meta_delay_count++;
+static const struct sim_param {
+	const char *par_name;
+	double     *par_val;
+} sim_params[] = {
+	{ "members",  &sim.sim_members },
+	{ "chunk",    &sim.sim_chunk },
+	{ "seek_min", &sim.sim_seek_min },
+	{ "seek_max", &sim.sim_seek_max },
+	{ "rpm",      &sim.sim_rpm },
+	{ "channels", &sim.sim_channels },
+	{ "read_us",  &sim.sim_read_us },
+	{ "write_us", &sim.sim_write_us },
+	{ "gc_every", &sim.sim_gc_every },
+	{ "gc_ms",    &sim.sim_gc_ms },
+	{ "mbps",     &sim.sim_mbps },
+	{}
+};
 
-	if (status < 0) {
-		printf("FATAL ERROR: read(%lld) from verify table failed %d %d (%s)\n", blocknr, status, errno, strerror(errno));
-		flush_stdout();
-		verify_mode = 0;
-		free(data);
-		return NULL;
+static struct sim_state *sim_state = NULL;
+static int sim_servers = 0; // per device
+
+static
+void sim_error(const char *txt)
+{
+	printf("ERROR: cannot parse --sim-device='%s' at '%s'\n", sim_device, txt);
+	do_exit(-1);
+}
+
+static
+void sim_init(void)
+{
+	char *spec;
+	char *tmp;
+	int is_raid = 0;
+	size_t size;
+
+	if (!sim_device)
+		sim_device = "hdd";
+	spec = strdup(sim_device);
+	tmp = strtok(spec, ",");
+	if (!tmp)
+		sim_error("");
+	if (!strcmp(tmp, "ssd")) {
+		sim.sim_type = SIM_SSD;
+		sim.sim_mbps = 200;
+	} else if (!strcmp(tmp, "raid0")) {
+		is_raid = 1;
+		sim.sim_members = 4;
+	} else if (strcmp(tmp, "hdd")) {
+		sim_error(tmp);
 	}
-	if (status < memlen) { // this may result from a sparse file
-		memset(data+status, 0, memlen - status);
+	while ((tmp = strtok(NULL, ","))) {
+		const struct sim_param *par;
+		char *val = strchr(tmp, '=');
+
+		if (!val)
+			sim_error(tmp);
+		*val++ = '\0';
+		if (is_raid && !strcmp(tmp, "disk")) {
+			if (!strcmp(val, "ssd")) {
+				sim.sim_type = SIM_SSD;
+				sim.sim_mbps = 200;
+			} else if (strcmp(val, "hdd")) {
+				sim_error(val);
+			}
+			continue;
+		}
+		for (par = sim_params; par->par_name; par++) {
+			if (!strcmp(tmp, par->par_name))
+				break;
+		}
+		if (!par->par_name || sscanf(val, "%lf", par->par_val) != 1 || *par->par_val < 0)
+			sim_error(tmp);
 	}
-	return data;
+	free(spec);
+
+	if (!is_raid || sim.sim_members < 1)
+		sim.sim_members = 1;
+	if (sim.sim_chunk < SIM_PAGE)
+		sim.sim_chunk = SIM_PAGE;
+	if (sim.sim_channels < 1)
+		sim.sim_channels = 1;
+	if (sim.sim_channels > SIM_MAX_CHANNELS)
+		sim.sim_channels = SIM_MAX_CHANNELS;
+	if (sim.sim_rpm < 1)
+		sim.sim_rpm = 1;
+	if (sim.sim_mbps <= 0)
+		sim.sim_mbps = 1;
+
+	sim_servers = (int)sim.sim_members;
+	if (sim.sim_type == SIM_SSD)
+		sim_servers *= (int)sim.sim_channels;
+	size = sizeof(struct sim_state) + sizeof(struct sim_server) * sim_servers * device_count;
+	sim_state = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sim_state == MAP_FAILED) {
+		printf("ERROR: cannot allocate shared memory for the simulation (%d %s)\n", errno, strerror(errno));
+		do_exit(-1);
+	}
+	memset(sim_state, 0, size);
+	printf("INFO: simulating %s with %d %s per device\n",
+	       sim_device,
+	       sim_servers,
+	       sim.sim_type == SIM_SSD ? "channels" : "disks");
+	flush_stdout();
 }
 
+/* Service time of one piece of a request at one server (ns).
+ */
 static
-void put_blockversion(int fd, unsigned int *data, long long blocknr, int count)
+long long sim_service(struct sim_server *srv, long long sector, long long bytes, int is_write, long long member_size)
 {
-	int status;
-	struct timespec t0;
-	struct timespec t1;
-	struct timespec delay;
+	double ms = bytes / (sim.sim_mbps * 1000.0);
+
+	if (sim.sim_type == SIM_HDD) {
+		long long dist = sector - srv->srv_head;
+
+		if (dist < 0)
+			dist = -dist;
+		if (dist) {
+			double rotation = 60000.0 / sim.sim_rpm;
+			// pseudo-random, but reproducible rotational position
+			unsigned long long hash = (unsigned long long)sector * 0x9E3779B97F4A7C15ULL;
+
+			if (member_size < 1)
+				member_size = 1;
+			ms += sim.sim_seek_min + (sim.sim_seek_max - sim.sim_seek_min) * sqrt((double)dist / member_size);
+			ms += rotation * (double)(hash >> 40) / (double)(1ULL << 24);
+		}
+		srv->srv_head = sector + bytes / 512;
+	} else {
+		ms += (is_write ? sim.sim_write_us : sim.sim_read_us) / 1000.0;
+		if (is_write && sim.sim_gc_every > 0) {
+			srv->srv_written += bytes;
+			if (srv->srv_written >= sim.sim_gc_every * 1024 * 1024) {
+				srv->srv_written = 0;
+				ms += sim.sim_gc_ms;
+			}
+		}
+	}
+	return ms * 1000000.0;
+}
 
-	if (!verify_mode)
-		return;
+/* Account a request at the servers of the current device,
+ * and sleep until the last piece has completed.
+ */
+static
+void sim_io(long long pos, int len, int is_write)
+{
+	struct sim_server *base = &sim_state->st_server[main_dev * sim_servers];
+	long long member_size = main_size / (long long)sim.sim_members;
+	long long sector = pos / 512;
+	long long end = sector + len / 512;
+	long long bytes[SIM_MAX_CHANNELS];
+	struct timespec now;
+	long long now_ns;
+	long long done = 0;
+	int channels = sim.sim_type == SIM_SSD ? (int)sim.sim_channels : 1;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	now_ns = (long long)now.tv_sec * NANO + now.tv_nsec;
+
+	while (__sync_lock_test_and_set(&sim_state->st_lock, 1))
+		sched_yield();
+
+	while (sector < end) {
+		long long chunk = (long long)sim.sim_chunk;
+		long long stripe = sector / chunk;
+		int member = stripe % (long long)sim.sim_members;
+		long long member_sector = (stripe / (long long)sim.sim_members) * chunk + sector % chunk;
+		long long piece = chunk - sector % chunk;
+		long long pos;
+		int i;
 
-	clock_gettime(CLOCK_REALTIME, &t0);
+		if (piece > end - sector)
+			piece = end - sector;
+		if (sim.sim_members <= 1) {
+			member_sector = sector;
+			piece = end - sector;
+		}
 
-	if (lseek64(fd, blocknr * sizeof(unsigned int), SEEK_SET) != blocknr * sizeof(unsigned int)) {
-		printf("FATAL ERROR: llseek(%lld) in verify table failed %d (%s)\n", blocknr, errno, strerror(errno));
-		flush_stdout();
-		verify_mode = 0;
-		return;
-	}
+		// distribute the pages over the channels
+		memset(bytes, 0, sizeof(bytes));
+		for (pos = member_sector; pos < member_sector + piece; pos += SIM_PAGE - pos % SIM_PAGE) {
+			long long rest = SIM_PAGE - pos % SIM_PAGE;
+			if (rest > member_sector + piece - pos)
+				rest = member_sector + piece - pos;
+			bytes[(pos / SIM_PAGE) % channels] += rest * 512;
+		}
+		for (i = 0; i < channels; i++) {
+			struct sim_server *srv = &base[member * channels + i];
+			long long start;
 
-	status = write(fd, data, count * sizeof(unsigned int));
+			if (!bytes[i])
+				continue;
+			start = srv->srv_busy_until > now_ns ? srv->srv_busy_until : now_ns;
+			srv->srv_busy_until = start + sim_service(srv, member_sector, bytes[i], is_write, member_size);
+			if (srv->srv_busy_until > done)
+				done = srv->srv_busy_until;
+		}
+		sector += piece;
+	}
 
-	clock_gettime(CLOCK_REALTIME, &t1);
-	timespec_diff(&delay, &t0, &t1);
-	timespec_add(&meta_delays, &delay);
-	meta_delay_count++;
+	__sync_lock_release(&sim_state->st_lock);
 
-	if (status < 0) {
-		printf("FATAL ERROR: write to verify table failed %d (%s)\n", errno, strerror(errno));
-		flush_stdout();
-		verify_mode = 0;
+#ifdef HAVE_DECL_NANOSLEEP
+	clock_gettime(CLOCK_REALTIME, &now);
+	now_ns = (long long)now.tv_sec * NANO + now.tv_nsec;
+	if (done > now_ns) {
+		struct timespec delay = {
+			.tv_sec  = (done - now_ns) / NANO,
+			.tv_nsec = (done - now_ns) % NANO,
+		};
+		nanosleep(&delay, NULL);
 	}
+#endif
 }
 
+///////////////////////////////////////////////////////////////////////
+
+// IO backends, see io_backend.h
+
 static
-void force_blockversion(int fd, unsigned int version, long long blocknr, int count)
+int file_open(const char *name, int flags, long long *size)
 {
-	if (!verify_mode)
-		return;
-	{
-		unsigned int data[count];
-		int i;
-		for (i = 0; i < count; i++)
-			data[i] = version;
-		put_blockversion(fd, data, blocknr, count);
-	}
+	int fd = open(name, flags);
+
+	if (fd >= 0)
+		*size = lseek64(fd, 0, SEEK_END);
+	return fd;
 }
 
 static
-int compare_blockversion(unsigned int *a, unsigned int *b, int count)
+void file_close(int handle)
+{
+	close(handle);
+}
+
+static
+int sync_submit(int handle, struct io_req *req)
+{
+	long long s_status = lseek64(handle, req->io_pos, SEEK_SET);
+
+	if (s_status != req->io_pos) {
+		printf("ERROR: bad lseek64() %lld on fd=%d at pos %lld (%s) pid=%d\n", s_status, handle, req->io_pos / 512, strerror(errno), getpid());
+		flush_stdout();
+		return -1;
+	}
+	if (req->io_write)
+		req->io_status = write(handle, req->io_buffer, req->io_len);
+	else
+		req->io_status = read(handle, req->io_buffer, req->io_len);
+	return 0;
+}
+
+static
+int null_submit(int handle, struct io_req *req)
+{
+	req->io_status = req->io_len;
+	return 0;
+}
+
+static
+int delay_submit(int handle, struct io_req *req)
+{
+#ifdef HAVE_DECL_NANOSLEEP
+	nanosleep(&simulate_io, NULL);
+#endif
+	req->io_status = req->io_len;
+	return 0;
+}
+
+static
+int model_submit(int handle, struct io_req *req)
+{
+	sim_io(req->io_pos, req->io_len, req->io_write);
+	req->io_status = req->io_len;
+	return 0;
+}
+
+static
+int sync_reap(int handle, struct io_req *req)
+{
+	return req->io_status;
+}
+
+enum {
+	BACKEND_SYNC,
+	BACKEND_NULL,
+	BACKEND_DELAY,
+	BACKEND_MODEL,
+};
+
+/* Only the sync backend transfers data. The others open the
+ * device read-only, just for determining its size.
+ */
+static const struct io_backend backends[] = {
+	[BACKEND_SYNC] = {
+		.be_name     = "sync",
+		.be_descr    = "read() / write() on the device (default)",
+		.be_has_data = 1,
+		.be_open     = file_open,
+		.be_submit   = sync_submit,
+		.be_reap     = sync_reap,
+		.be_close    = file_close,
+	},
+	[BACKEND_NULL] = {
+		.be_name     = "null",
+		.be_descr    = "no IO at all (--dry-run, --fake-io)",
+		.be_open     = file_open,
+		.be_submit   = null_submit,
+		.be_reap     = sync_reap,
+		.be_close    = file_close,
+	},
+	[BACKEND_DELAY] = {
+		.be_name     = "delay",
+		.be_descr    = "constant delay per request (--simulate-io)",
+		.be_open     = file_open,
+		.be_submit   = delay_submit,
+		.be_reap     = sync_reap,
+		.be_close    = file_close,
+	},
+	[BACKEND_MODEL] = {
+		.be_name     = "model",
+		.be_descr    = "simulated device model (--sim-device)",
+		.be_open     = file_open,
+		.be_submit   = model_submit,
+		.be_reap     = sync_reap,
+		.be_close    = file_close,
+	},
+	{}
+};
+
+const struct io_backend *backend = &backends[BACKEND_SYNC];
+char *io_backend = NULL;
+
+/* Select the backend, either explicitly by --io-backend, or
+ * implicitly by the older options.
+ */
+static
+void backend_init(void)
+{
+	const struct io_backend *be;
+	const char *name = io_backend;
+
+	if (!name) {
+		be = &backends[BACKEND_SYNC];
+		if (dry_run || fake_io)
+			be = &backends[BACKEND_NULL];
+		if (simulate_io.tv_sec || simulate_io.tv_nsec)
+			be = &backends[BACKEND_DELAY];
+		if (sim_device)
+			be = &backends[BACKEND_MODEL];
+		name = be->be_name;
+	}
+	for (be = backends; be->be_name; be++) {
+		if (!strcmp(be->be_name, name))
+			break;
+	}
+	if (!be->be_name) {
+#if HAVE_DECL_DLOPEN
+		void *handle = dlopen(name, RTLD_NOW);
+
+		if (!handle) {
+			printf("ERROR: cannot load backend '%s' (%s)\n", name, dlerror());
+			do_exit(-1);
+		}
+		be = dlsym(handle, BACKEND_SYMBOL);
+		if (!be || !be->be_name || !be->be_open || !be->be_submit || !be->be_reap || !be->be_close) {
+			printf("ERROR: '%s' provides no valid '%s'\n", name, BACKEND_SYMBOL);
+			do_exit(-1);
+		}
+#else
+		printf("ERROR: unknown backend '%s'\n", name);
+		do_exit(-1);
+#endif
+	}
+	if (be->be_has_data && (dry_run || fake_io)) {
+		// a dry run must never touch the data
+		printf("ERROR: --dry-run and --fake-io cannot be combined with backend '%s', which transfers data\n", be->be_name);
+		do_exit(-1);
+	}
+	backend = be;
+	if (!backend->be_has_data)
+		dry_run = 1;
+}
+
+static
+int do_io(void *buffer, int len, long long pos, int is_write)
+{
+	struct io_req req = {
+		.io_pos    = pos,
+		.io_buffer = buffer,
+		.io_len    = len,
+		.io_write  = is_write,
+		.io_status = -1,
+	};
+
+	if (backend->be_submit(main_fd, &req) < 0)
+		return -1;
+	return backend->be_reap(main_fd, &req);
+}
+
+static
+int do_read(void *buffer, int len, long long pos)
+{
+	return do_io(buffer, len, pos, 0);
+}
+
+static
+int do_write(void *buffer, int len, long long pos)
+{
+	return do_io(buffer, len, pos, 1);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+// version number bookkeeping
+
+static
+unsigned int *get_blockversion(int fd, long long blocknr, int count)
+{
+	int status;
+	void *data;
+	int memlen = count * sizeof(unsigned int);
+	struct timespec t0;
+	struct timespec t1;
+	struct timespec delay;
+
+	if (!verify_mode)
+		return NULL;
+
+	clock_gettime(CLOCK_REALTIME, &t0);
+
+	data = malloc(memlen);
+	if (!data) {
+		printf("FATAL ERROR: out of memory for hashing\n");
+		flush_stdout();
+		verify_mode = 0;
+		return NULL;
+	}
+	if (lseek64(fd, blocknr * sizeof(unsigned int), SEEK_SET) != blocknr * sizeof(unsigned int)) {
+		printf("FATAL ERROR: llseek(%lld) in verify table failed %d (%s)\n", blocknr, errno, strerror(errno));
+		flush_stdout();
+		verify_mode = 0;
+		free(data);
+		return NULL;
+	}
+
+	status = read(fd, data, memlen);
+
+	clock_gettime(CLOCK_REALTIME, &t1);
+	timespec_diff(&delay, &t0, &t1);
+	timespec_add(&meta_delays, &delay);
+	meta_delay_count++;
+
+	if (status < 0) {
+		printf("FATAL ERROR: read(%lld) from verify table failed %d %d (%s)\n", blocknr, status, errno, strerror(errno));
+		flush_stdout();
+		verify_mode = 0;
+		free(data);
+		return NULL;
+	}
+	if (status < memlen) { // this may result from a sparse file
+		memset(data+status, 0, memlen - status);
+	}
+	return data;
+}
+
+static
+void put_blockversion(int fd, unsigned int *data, long long blocknr, int count)
+{
+	int status;
+	struct timespec t0;
+	struct timespec t1;
+	struct timespec delay;
+
+	if (!verify_mode)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &t0);
+
+	if (lseek64(fd, blocknr * sizeof(unsigned int), SEEK_SET) != blocknr * sizeof(unsigned int)) {
+		printf("FATAL ERROR: llseek(%lld) in verify table failed %d (%s)\n", blocknr, errno, strerror(errno));
+		flush_stdout();
+		verify_mode = 0;
+		return;
+	}
+
+	status = write(fd, data, count * sizeof(unsigned int));
+
+	clock_gettime(CLOCK_REALTIME, &t1);
+	timespec_diff(&delay, &t0, &t1);
+	timespec_add(&meta_delays, &delay);
+	meta_delay_count++;
+
+	if (status < 0) {
+		printf("FATAL ERROR: write to verify table failed %d (%s)\n", errno, strerror(errno));
+		flush_stdout();
+		verify_mode = 0;
+	}
+}
+
+static
+void force_blockversion(int fd, unsigned int version, long long blocknr, int count)
+{
+	if (!verify_mode)
+		return;
+	{
+		unsigned int data[count];
+		int i;
+		for (i = 0; i < count; i++)
+			data[i] = version;
+		put_blockversion(fd, data, blocknr, count);
+	}
+}
+
+static
+int compare_blockversion(unsigned int *a, unsigned int *b, int count)
 {
 	for (; count > 0; a++, b++, count--) {
 		if (!*a)
@@ -659,7 +1412,7 @@ void check_tags(struct request *rq, void *buffer, int len, int do_write)
 		if (!rq->old_version[i/512]) { // version not yet valid
 			continue;
 		}
-		if (dry_run)
+		if (!backend->be_has_data)
 			continue;
 		if (tag->tag_start != start_stamp.tv_sec) {
 			printf("VERIFY ERROR (%s): bad start tag at sector %lld+%d (tag %lld != [expected] %ld)\n", mode, rq->sector, i/512, tag->tag_start, start_stamp.tv_sec);
@@ -692,14 +1445,10 @@ void make_tags(struct request *rq, void *buffer, int len)
 	// check old tag before overwriting
 	if (verify_mode >= 1) {
 		int status;
-		status = do_read(buffer, len);
+		status = do_read(buffer, len, (long long)rq->sector * 512);
 		if (status == len) {
 			check_tags(rq, buffer, len, 1);
 		}
-		if (lseek64(main_fd, rq->sector * 512, SEEK_SET) != rq->sector * 512) {
-			printf("ERROR: bad lseek at make_tags()\n");
-			flush_stdout();
-		}
 	}
 
 	if (fill_random < 0)
@@ -778,17 +1527,13 @@ void check_all_tags()
 			if (!version)
 				continue;
 
-			if (lseek64(main_fd, blocknr * 512, SEEK_SET) != blocknr * 512) {
-				printf("ERROR: bad lseek in check_all_tags()\n");
-				flush_stdout();
-			}
-			if (do_read(buffer, 512) != 512) {
+			if (do_read(buffer, 512, blocknr * 512) != 512) {
 				printf("ERROR: bad read in check_all_tags(): %d %s\n", errno, strerror(errno));
 				flush_stdout();
 			}
 			checked++;
 			version2 = table2[i];
-			if (dry_run)
+			if (!backend->be_has_data)
 				continue;
 			if (tag->tag_write_seqnr != version && tag->tag_write_seqnr != version2) {
 				if (version != version2) {
@@ -819,7 +1564,6 @@ void paranoia_check(struct request *rq, void *buffer)
 	void *buffer2 = NULL;
 	struct verify_tag *tag = buffer;
 	struct verify_tag *tag2;
-	long long s_status;
 
 	if (posix_memalign(&buffer2, 4096, len)) {
 		printf("VERIFY ERROR: cannot allocate memory\n");
@@ -828,21 +1572,14 @@ void paranoia_check(struct request *rq, void *buffer)
 		goto done;
 	}
 	tag2 = buffer2;
-	s_status = lseek64(main_fd, newpos, SEEK_SET);
-	if (s_status != newpos) {
-		printf("VERIFY ERROR: bad lseek64() %lld on main_fd=%d at pos %lld (%s) pid=%d\n", s_status, main_fd, rq->sector, strerror(errno), getpid());
-		flush_stdout();
-		rq->verify_errors++;
-		goto done;
-	}
-	status2 = do_read(buffer2, len);
+	status2 = do_read(buffer2, len, newpos);
 	if (status2 != len) {
 		printf("VERIFY ERROR: bad %cIO %d / %d on %d at pos %lld (%s)\n", rq->rwbs, status2, errno, main_fd, rq->sector, strerror(errno));
 		flush_stdout();
 		rq->verify_errors++;
 		goto done;
 	}
-	if (dry_run)
+	if (!backend->be_has_data)
 		goto done;
 	if (memcmp(buffer, buffer2, len)) {
 		printf("VERIFY ERROR: memcmp(): bad storage semantics at sector = %lld len = %d tag_start = %lld tag2_start = %lld\n", rq->sector, len, tag->tag_start, tag2->tag_start);
@@ -951,9 +1688,9 @@ int do_action(struct request *rq)
 	struct timespec t0 = {};
 	struct timespec t1 = {};
 	int len = rq->length * 512;
-	long long newpos;
-	long long s_status;
+	long long newpos = (long long)rq->sector * 512;
 
+	select_device(rq->dev);
 	if (main_fd < 0) {
 		return -1;
 	}
@@ -962,13 +1699,6 @@ int do_action(struct request *rq)
 		flush_stdout();
 	}
 
-	newpos = (long long)rq->sector * 512;
-	s_status = lseek64(main_fd, newpos, SEEK_SET);
-	if (s_status != newpos) {
-		printf("ERROR: bad lseek64() %lld on main_fd=%d at pos %lld (%s) pid=%d\n", s_status, main_fd, rq->sector, strerror(errno), getpid());
-		flush_stdout();
-		return -1;
-	}
 	{
 		int status = -1;
 		void *buffer = NULL;
@@ -980,8 +1710,7 @@ int do_action(struct request *rq)
 		if (toupper(rq->rwbs) == 'R') {
 			do_wait(rq, &t0);
 			
-			if (!fake_io)
-				status = do_read(buffer, len);
+			status = do_read(buffer, len, newpos);
 
 			clock_gettime(CLOCK_REALTIME, &t1);
 			timespec_diff(&rq->replay_duration, &t0, &t1);
@@ -992,8 +1721,7 @@ int do_action(struct request *rq)
 
 			do_wait(rq, &t0);
 
-			if (!fake_io)
-				status = do_write(buffer, len);
+			status = do_write(buffer, len, newpos);
 
 			clock_gettime(CLOCK_REALTIME, &t1);
 			timespec_diff(&rq->replay_duration, &t0, &t1);
@@ -1003,7 +1731,7 @@ int do_action(struct request *rq)
 			}
 		}
 		free(buffer);
-		if (!fake_io && status != len) {
+		if (status != len) {
 			printf("ERROR: bad %cIO %d / %d on %d at pos %lld (%s)\n", rq->rwbs, status, errno, main_fd, rq->sector, strerror(errno));
 			flush_stdout();
 			//do_exit(-1);
@@ -1229,7 +1957,7 @@ void submit_to_queues(struct request *rq, int is_pushback)
 	rq->tag.tag_seqnr = ++seqnr;
 	if (conflict_mode &&
 	    (strong_mode || toupper(rq->rwbs) == 'W'))
-		fly_add(&fly_hash, rq->sector, rq->length, toupper(rq->rwbs));
+		fly_add(&fly_hash, FLY_SECTOR(rq), rq->length, toupper(rq->rwbs));
 
 	if (toupper(rq->rwbs) != 'R') {
 		write_seqnr++;
@@ -1297,8 +2025,12 @@ void check_pushback(void)
 			flush_stdout();
 			break;
 		}
+		if (closed_loop && count_submitted >= closed_loop_qd) {
+			// revivals count against the queue depth
+			break;
+		}
 
-		has_conflict = fly_check(&fly_hash, tmp->sector, tmp->length, toupper(tmp->rwbs));
+		has_conflict = fly_check(&fly_hash, FLY_SECTOR(tmp), tmp->length, toupper(tmp->rwbs));
 		if (has_conflict) {
 			prev = tmp;
 			ptr = &tmp->next;
@@ -1333,19 +2065,145 @@ void check_pushback(void)
 
 ///////////////////////////////////////////////////////////////////////
 
+// latency statistics over an interval
+
+struct lat_stat {
+	long long ls_count;
+	long long ls_sectors;
+	double ls_sum;
+	double ls_max;
+	double *ls_values;
+	long long ls_alloc;
+};
+
+static
+void lat_stat_add(struct lat_stat *st, struct timespec *val, int sectors)
+{
+	double lat = val->tv_nsec * (1.0/(double)NANO) + val->tv_sec;
+	if (st->ls_count >= st->ls_alloc) {
+		long long new_alloc = st->ls_alloc ? st->ls_alloc * 2 : 4096;
+		double *new_values = realloc(st->ls_values, new_alloc * sizeof(double));
+		if (!new_values) {
+			printf("FATAL ERROR: out of memory for latency statistics\n");
+			do_exit(-1);
+		}
+		st->ls_values = new_values;
+		st->ls_alloc = new_alloc;
+	}
+	st->ls_values[st->ls_count++] = lat;
+	st->ls_sectors += sectors;
+	st->ls_sum += lat;
+	if (lat > st->ls_max)
+		st->ls_max = lat;
+}
+
+static
+int lat_compare(const void *a, const void *b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Sorts the values, so call it only at the end of an interval.
+ */
+static
+double lat_stat_percentile(struct lat_stat *st, double percent)
+{
+	long long idx;
+	if (st->ls_count <= 0)
+		return 0.0;
+	qsort(st->ls_values, st->ls_count, sizeof(double), lat_compare);
+	idx = (long long)(percent / 100.0 * st->ls_count);
+	if (idx >= st->ls_count)
+		idx = st->ls_count - 1;
+	return st->ls_values[idx];
+}
+
+static
+void lat_stat_reset(struct lat_stat *st)
+{
+	st->ls_count = 0;
+	st->ls_sectors = 0;
+	st->ls_sum = 0.0;
+	st->ls_max = 0.0;
+}
+
+struct lat_stat closed_loop_stat = {};
+int closed_loop_first_seqnr = 0;
+struct lat_stat precond_stat = {};
+
+/* Load streams, see section "input streams" below.
+ */
+struct raw_request {
+	struct timespec raw_stamp;
+	long long       raw_sector;
+	int             raw_length;
+	char            raw_rwbs;
+	double          raw_delay;
+	double          raw_duration;
+};
+
+struct stream {
+	char           *st_name;
+	FILE           *st_inp;
+	int             st_is_pipe;
+	int             st_dev;
+	struct request *st_next;
+	struct timespec st_timeshift;
+	struct timespec st_old_stamp;
+	// relocation (consolidation mode)
+	long long       st_offset;
+	struct timespec st_shift;
+	FLOAT           st_speedup;
+	struct timespec st_first_stamp; // speedup is relative to this
+	int             st_has_first;
+	// native filter state
+	int             st_pass;
+	int             st_pass_count;
+	int             st_slip_step;
+	long long       st_slip_offset;
+	int             st_record;     // remember input for repetitions
+	int             st_replaying;
+	struct raw_request *st_buf;
+	int             st_buf_count;
+	int             st_buf_alloc;
+	int             st_buf_pos;
+	// pieces of a request split by --filter-sample
+	struct sample_piece st_piece[SAMPLE_MAX_PIECES];
+	int             st_piece_count;
+	int             st_piece_pos;
+	struct request  st_piece_rq;
+	// per-stream statistics
+	int             st_total;
+	struct lat_stat st_lat;
+};
+
+struct stream streams[MAX_DEVICES] = {};
+int stream_count = 0;
+struct lat_stat search_lat_stat = {};
+struct lat_stat search_lag_stat = {};
+int search_first_seqnr = 0;
+
+///////////////////////////////////////////////////////////////////////
+
 static
 void dump_request(struct request *rq)
 {
+	struct device *dev = rq->dev >= 0 ? &devices[rq->dev] : NULL;
+	FILE *out = dev && dev->dev_out ? dev->dev_out : stdout;
 	struct timespec delay;
 	static int did_head = 0;
-	if (!did_head) {
-		printf("orig_start ; sector; length ; op ;  replay_delay; replay_duration\n");
-		did_head++;
+	int *did = out == stdout ? &did_head : &dev->dev_did_head;
+	if (!*did) {
+		fprintf(out, "orig_start ; sector; length ; op ;  replay_delay; replay_duration%s\n",
+			consolidate_mode ? " ; stream" : "");
+		(*did)++;
 	}
 
 	timespec_diff(&delay, &rq->orig_factor_stamp, &rq->replay_stamp);
 
-	printf("%4lu.%09lu ; %10lld ; %3d ; %c ; %3lu.%09lu ; %3lu.%09lu\n",
+	fprintf(out, "%4lu.%09lu ; %10lld ; %3d ; %c ; %3lu.%09lu ; %3lu.%09lu",
 	       rq->orig_factor_stamp.tv_sec,
 	       rq->orig_factor_stamp.tv_nsec,
 	       rq->sector,
@@ -1357,9 +2215,67 @@ void dump_request(struct request *rq)
 
 	       rq->replay_duration.tv_sec,
 	       rq->replay_duration.tv_nsec);
+	if (consolidate_mode) {
+		fprintf(out, " ; %3d", rq->stream);
+		if (!rq->parent)
+			lat_stat_add(&streams[rq->stream].st_lat, &rq->replay_duration, rq->length);
+	}
+	fputc('\n', out);
 
-	flush_stdout();
+	if (out == stdout)
+		flush_stdout();
+	if (!dev) {
+		statist_logical++;
+		return;
+	}
 	statist_completed++;
+	dev->dev_completed++;
+}
+
+static
+void deps_complete(struct request *rq);
+
+/* Members of a striped / concatenated request report back to their
+ * logical request. While members are pending, the logical
+ * replay_duration holds the end time, and a negative replay_stamp
+ * means that no member has completed yet.
+ */
+static
+void finish_member(struct request *rq, int completed)
+{
+	struct request *parent = rq->parent;
+	struct timespec end;
+
+	if (!parent)
+		return;
+	rq->parent = NULL;
+
+	if (completed) {
+		memcpy(&end, &rq->replay_stamp, sizeof(end));
+		timespec_add(&end, &rq->replay_duration);
+		if ((long)parent->replay_stamp.tv_sec < 0 ||
+		    rq->replay_stamp.tv_sec < parent->replay_stamp.tv_sec ||
+		    (rq->replay_stamp.tv_sec == parent->replay_stamp.tv_sec &&
+		     rq->replay_stamp.tv_nsec < parent->replay_stamp.tv_nsec))
+			memcpy(&parent->replay_stamp, &rq->replay_stamp, sizeof(parent->replay_stamp));
+		if (end.tv_sec > parent->replay_duration.tv_sec ||
+		    (end.tv_sec == parent->replay_duration.tv_sec &&
+		     end.tv_nsec > parent->replay_duration.tv_nsec))
+			memcpy(&parent->replay_duration, &end, sizeof(parent->replay_duration));
+	}
+
+	if (--parent->pending > 0)
+		return;
+
+	if (dependency_mode)
+		deps_complete(parent);
+
+	if ((long)parent->replay_stamp.tv_sec >= 0) {
+		memcpy(&end, &parent->replay_duration, sizeof(end));
+		timespec_diff(&parent->replay_duration, &parent->replay_stamp, &end);
+		dump_request(parent);
+	}
+	free(parent);
 }
 
 static
@@ -1387,6 +2303,20 @@ int get_answer(void)
 		verify_errors += rq.verify_errors;
 		res = 1;
 
+		if (closed_loop && rq.seqnr >= closed_loop_first_seqnr)
+			lat_stat_add(&closed_loop_stat, &rq.replay_duration, rq.length);
+		if (precondition)
+			lat_stat_add(&precond_stat, &rq.replay_duration, rq.length);
+		if (search_mode && search_first_seqnr && rq.seqnr >= search_first_seqnr) {
+			struct timespec lag = {};
+			if (rq.replay_stamp.tv_sec > rq.orig_factor_stamp.tv_sec ||
+			    (rq.replay_stamp.tv_sec == rq.orig_factor_stamp.tv_sec &&
+			     rq.replay_stamp.tv_nsec > rq.orig_factor_stamp.tv_nsec))
+				timespec_diff(&lag, &rq.orig_factor_stamp, &rq.replay_stamp);
+			lat_stat_add(&search_lat_stat, &rq.replay_duration, rq.length);
+			lat_stat_add(&search_lag_stat, &lag, 0);
+		}
+
 		if (verbose) {
 			verbose_status(&rq, "got_answer");
 		}
@@ -1397,6 +2327,9 @@ int get_answer(void)
 			memcpy(&old->replay_duration, &rq.replay_duration, sizeof(old->replay_duration));
 			memcpy(&old->orig_factor_stamp, &rq.orig_factor_stamp, sizeof(old->orig_factor_stamp));
 			dump_request(old);
+			if (dependency_mode && !old->parent)
+				deps_complete(old);
+			finish_member(old, 1);
 			del_request(old->sector, old->seqnr);
 		} else {
 			printf("ERROR: request %lld vanished\n", rq.sector);
@@ -1404,7 +2337,7 @@ int get_answer(void)
 
 		if (conflict_mode &&
 		    (strong_mode || toupper(rq.rwbs) == 'W'))
-			fly_delete(&fly_hash, rq.sector, rq.length, toupper(rq.rwbs));
+			fly_delete(&fly_hash, FLY_SECTOR(&rq), rq.length, toupper(rq.rwbs));
 		if (toupper(rq.rwbs) != 'R') {
 			if (verify_mode) {
 				unsigned int *data = get_blockversion(complete_fd, rq.sector, rq.length);
@@ -1435,7 +2368,7 @@ void main_open(int again)
 {
 	long long size;
 	int flags = O_RDWR;
-	if (again || dry_run) {
+	if (again || !backend->be_has_data) {
 		flags = O_RDONLY;
 	}
 #ifdef O_LARGEFILE
@@ -1446,12 +2379,12 @@ void main_open(int again)
 	if (use_o_sync)
 		flags |= O_SYNC;
 
-	main_fd = open(main_name, flags);
+	size = 0;
+	main_fd = backend->be_open(main_name, flags, &size);
 	if (main_fd < 0) {
 		printf("ERROR: cannot open file '%s', errno = %d (%s)\n", main_name, errno, strerror(errno));
 		do_exit(-1);
 	}
-	size = lseek64(main_fd, 0, SEEK_END);
 	if (size <= 0) {
 		printf("ERROR: cannot determine size of device (%d %s)\n", errno, strerror(errno));
 		do_exit(-1);
@@ -1462,14 +2395,49 @@ void main_open(int again)
 	}
 }
 
+/* Open all devices, remember the sizes from the first call.
+ */
 static
-char *mk_temp(const char *basename)
+void devices_open(int again)
 {
-	char *tmpdir = getenv("TMPDIR");
-	char *res = malloc(1024);
-	int len;
-	if (!res) {
-		printf("FATAL ERROR: out of memory for tmp pathname\n");
+	int i;
+
+	for (i = 0; i < device_count; i++) {
+		struct device *dev = &devices[i];
+
+		dev->dev_fd = -1;
+		if (!dev->dev_name[0])
+			continue;
+		main_name = dev->dev_name;
+		main_size = dev->dev_size;
+		main_open(again);
+		dev->dev_fd = main_fd;
+		dev->dev_size = main_size;
+	}
+	select_device(0);
+}
+
+static
+void devices_close(void)
+{
+	int i;
+
+	for (i = 0; i < device_count; i++) {
+		if (devices[i].dev_fd >= 0)
+			backend->be_close(devices[i].dev_fd);
+		devices[i].dev_fd = -1;
+	}
+	main_fd = -1;
+}
+
+static
+char *mk_temp(const char *basename)
+{
+	char *tmpdir = getenv("TMPDIR");
+	char *res = malloc(1024);
+	int len;
+	if (!res) {
+		printf("FATAL ERROR: out of memory for tmp pathname\n");
 		do_exit(-1);
 	}
 	if (!tmpdir)
@@ -1531,9 +2499,7 @@ void do_worker(int in_fd, int back_fd)
 	 * between seek() and read()/write().
 	 * So open it again.
 	 */
-	if (main_name && main_name[0]) {
-		main_open(0);
-	}
+	devices_open(0);
 	for (;;) {
 		struct request rq = {};
 		int status = get_request(in_fd, &rq);
@@ -1790,7 +2756,7 @@ void execute(struct request *rq)
 		}
 
 		if (conflict_mode) {
-			status = fly_check(&fly_hash, rq->sector, rq->length, toupper(rq->rwbs));
+			status = fly_check(&fly_hash, FLY_SECTOR(rq), rq->length, toupper(rq->rwbs));
 		} else if (verify_mode) {
 			unsigned int *now_version = get_blockversion(complete_fd, rq->sector, rq->length);
 			status = compare_blockversion(rq->old_version, now_version, rq->length);
@@ -1804,6 +2770,7 @@ void execute(struct request *rq)
 			printf("INFO: dropping block=%lld len=%d mode=%c\n", rq->sector, rq->length, rq->rwbs);
 			flush_stdout();
 			statist_dropped++;
+			finish_member(rq, 0);
 			return;
 		}
 		if (conflict_mode == 2) { // pushback request
@@ -1857,42 +2824,985 @@ int delay_distance(struct timespec *check)
 
 ///////////////////////////////////////////////////////////////////////
 
-/* Main dispatcher routine.
-*/
+// closed-loop mode
+
+/* Instead of obeying the timestamps, keep exactly closed_loop_qd
+ * requests on the fly (including those waiting on the pushback list).
+ * When closed_loop_max exceeds closed_loop, the queue depth is doubled
+ * after each step of closed_loop_step seconds, and the run stops when
+ * closed_loop_max is exceeded. Otherwise the queue depth stays fixed
+ * until the input ends, and each step only produces a report.
+ * Completions of requests submitted before a step change are not
+ * accounted to the new step.
+ */
+static struct timespec closed_loop_begin = {};
+
 static
-void parse(FILE *inp)
+void closed_loop_report(struct timespec *elapsed)
 {
-	static int first_call = 0;
-	char buffer[4096];
-	struct timespec old_stamp = {};
-	struct request *rq = NULL;
+	struct lat_stat *st = &closed_loop_stat;
+	struct timespec duration;
+	double secs;
+
+	timespec_diff(&duration, &closed_loop_begin, elapsed);
+	secs = duration.tv_nsec * (1.0/(double)NANO) + duration.tv_sec;
+	if (secs <= 0.0)
+		secs = 1.0 / NANO;
+
+	printf("CLOSED_LOOP: queue_depth=%d requests=%lld duration=%lu.%09lu iops=%.3f kb_per_sec=%.3f latency_avg=%.9f latency_p50=%.9f latency_p99=%.9f latency_max=%.9f\n",
+	       closed_loop_qd,
+	       st->ls_count,
+	       duration.tv_sec,
+	       duration.tv_nsec,
+	       st->ls_count / secs,
+	       st->ls_sectors / 2.0 / secs,
+	       st->ls_count ? st->ls_sum / st->ls_count : 0.0,
+	       lat_stat_percentile(st, 50.0),
+	       lat_stat_percentile(st, 99.0),
+	       st->ls_max);
+	flush_stdout();
+
+	lat_stat_reset(st);
+	memcpy(&closed_loop_begin, elapsed, sizeof(closed_loop_begin));
+}
 
-	if (main_name && main_name[0]) { // just determine main_size
-		main_open(0);
-		close(main_fd);
-		main_fd = -1;
+/* Returns 1 when the sweep is finished.
+ */
+static
+int closed_loop_throttle(struct request *rq)
+{
+	struct timespec now;
+	struct timespec elapsed;
+
+	if (!closed_loop_qd)
+		closed_loop_qd = closed_loop;
+
+	while (count_submitted > 0 &&
+	       count_submitted + count_pushback >= closed_loop_qd) {
+		get_answer();
 	}
-	verify_open(0);
 
-	// get start time, but only after opening everything, since open() may produce delays
-	clock_gettime(CLOCK_REALTIME, &start_stamp);
-	
-	if (verbose) {
-		printf("INFO: tag_start=%ld\n", start_stamp.tv_sec);
+	grace_diff(&elapsed, &now);
+	if ((long)elapsed.tv_sec < 0) {
+		// still in the grace period: the workers will wait
+		memset(&elapsed, 0, sizeof(elapsed));
+	} else if (elapsed.tv_sec >= closed_loop_begin.tv_sec + closed_loop_step) {
+		closed_loop_report(&elapsed);
+		closed_loop_first_seqnr = statist_total + 1;
+		if (closed_loop_max > closed_loop) {
+			closed_loop_qd *= 2;
+			if (closed_loop_qd > closed_loop_max)
+				return 1;
+		}
+	}
+	memcpy(&rq->orig_factor_stamp, &elapsed, sizeof(rq->orig_factor_stamp));
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+// dependency-aware replay
+
+/* Replay as fast as possible, but keep the causal structure of the
+ * original load as far as it can be inferred from the input:
+ *  - requests touching the same blocks stay ordered (--with-ordering),
+ *  - when the input has completion times (replay_delay / replay_duration
+ *    of a .replay file), a request issued at most dependency_gap after
+ *    the last completion before it waits for that request,
+ *  - otherwise, a request issued after an idle gap of more than
+ *    dependency_gap waits for all earlier ones.
+ * The issue order of the input is retained.
+ */
+#define DEPS_RECENT 256       // candidates for the completion rule
+#define DEPS_WINDOW (1 << 16) // must be larger than DEPS_RECENT
+
+static long long deps_next_id = 0;
+static long long deps_done[DEPS_WINDOW] = {}; // highest id + 1 completed in this slot
+static struct deps_recent {
+	long long dr_id;      // id + 1, 0 = unused
+	double    dr_done;    // original completion time
+} deps_recent[DEPS_RECENT] = {};
+static double deps_first_issue = 0.0;
+static double deps_last_issue = 0.0;
+static double deps_orig_end = 0.0;
+static struct timespec deps_begin = {};
+static long long deps_completion_count = 0;
+static long long deps_barrier_count = 0;
+static long long deps_wait_count = 0;
+
+static
+void deps_complete(struct request *rq)
+{
+	long long *slot = &deps_done[rq->dep_id % DEPS_WINDOW];
+
+	if (*slot < rq->dep_id + 1)
+		*slot = rq->dep_id + 1;
+}
+
+/* Only ids newer than the current one can share the slot, and these
+ * are not yet submitted.
+ */
+static
+int deps_is_done(long long id)
+{
+	return deps_done[id % DEPS_WINDOW] >= id + 1;
+}
+
+static
+void deps_throttle(struct request *rq)
+{
+	struct deps_recent *dr;
+	struct timespec rel;
+	struct timespec now;
+	struct timespec elapsed;
+	double issue;
+	double done;
+	long long pred = -1;
+	int i;
+
+	// original times, not stretched by --speedup like orig_factor_stamp
+	timespec_diff(&rel, &first_stamp, &rq->orig_stamp);
+	issue = rel.tv_nsec * (1.0/(double)NANO) + rel.tv_sec + rq->orig_delay;
+	done = issue + rq->orig_duration;
+
+	rq->dep_id = deps_next_id++;
+	if (!rq->dep_id)
+		deps_first_issue = issue;
+
+	if (rq->orig_duration > 0.0) {
+		double best = 0.0;
+
+		for (i = 0; i < DEPS_RECENT; i++) {
+			dr = &deps_recent[i];
+			if (!dr->dr_id || dr->dr_done > issue || issue - dr->dr_done > dependency_gap)
+				continue;
+			if (pred < 0 || dr->dr_done > best) {
+				best = dr->dr_done;
+				pred = dr->dr_id - 1;
+			}
+		}
+		if (pred >= 0) {
+			deps_completion_count++;
+			if (!deps_is_done(pred))
+				deps_wait_count++;
+			while (!deps_is_done(pred) && count_submitted > 0)
+				get_answer();
+		}
+	} else if (rq->dep_id && issue - deps_last_issue > dependency_gap) {
+		deps_barrier_count++;
+		if (count_submitted > 0)
+			deps_wait_count++;
+		while (count_submitted > 0)
+			get_answer();
+	}
+
+	dr = &deps_recent[rq->dep_id % DEPS_RECENT];
+	dr->dr_id = rq->dep_id + 1;
+	dr->dr_done = done;
+	deps_last_issue = issue;
+	if (done > deps_orig_end)
+		deps_orig_end = done;
+
+	// avoid flooding the pipelines
+	while (count_submitted > bottleneck) {
+		get_answer();
+	}
+
+	grace_diff(&elapsed, &now);
+	if ((long)elapsed.tv_sec < 0) {
+		// still in the grace period: the workers will wait
+		memset(&elapsed, 0, sizeof(elapsed));
+	}
+	if (!rq->dep_id)
+		memcpy(&deps_begin, &elapsed, sizeof(deps_begin));
+	memcpy(&rq->orig_factor_stamp, &elapsed, sizeof(rq->orig_factor_stamp));
+}
+
+static
+void deps_report(void)
+{
+	struct timespec now;
+	struct timespec elapsed;
+	struct timespec duration;
+	double orig = deps_orig_end - deps_first_issue;
+	double replay;
+
+	grace_diff(&elapsed, &now);
+	timespec_diff(&duration, &deps_begin, &elapsed);
+	replay = duration.tv_nsec * (1.0/(double)NANO) + duration.tv_sec;
+
+	printf("DEPENDENCY: requests=%lld gap=%.6f completion_deps=%lld idle_barriers=%lld dependency_waits=%lld block_waits=%d orig_duration=%.9f replay_duration=%.9f speedup=%.3f\n",
+	       deps_next_id,
+	       (double)dependency_gap,
+	       deps_completion_count,
+	       deps_barrier_count,
+	       deps_wait_count,
+	       statist_ordered,
+	       orig,
+	       replay,
+	       replay > 0.0 ? orig / replay : 0.0);
+	flush_stdout();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+// adaptive speedup search
+
+/* The virtual time is piecewise linear: whenever time_stretch changes,
+ * the mapping is rebased at the current input position.
+ */
+static struct timespec stretch_base_orig = {};
+static struct timespec stretch_base_factor = {};
+
+#define SEARCH_MIN_REQUESTS   100
+#define SEARCH_MIN_SPEEDUP    0.000001
+
+static struct timespec search_begin = {};
+static FLOAT search_lower = 0.0; // highest speedup which was sustainable
+static FLOAT search_upper = 0.0; // lowest speedup which was not, 0 = unknown
+static int search_done = 0;
+
+static
+void search_report(int complete)
+{
+	printf("SEARCH: max_sustainable_speedup=%.6f complete=%d lower=%.6f upper=%.6f percentile=%.3f latency_bound=%.6f lag_bound=%.6f\n",
+	       (double)search_lower,
+	       complete,
+	       (double)search_lower,
+	       (double)search_upper,
+	       (double)search_percentile,
+	       (double)search_latency,
+	       (double)search_lag);
+	flush_stdout();
+}
+
+/* Called for each input request with its original time relative to
+ * first_stamp. Returns 1 when the search has converged.
+ */
+static
+int search_check(struct timespec *orig_rel)
+{
+	struct timespec now;
+	struct timespec elapsed;
+	struct timespec pos;
+	double lat;
+	double lag;
+	FLOAT next;
+	int ok;
+
+	grace_diff(&elapsed, &now);
+	if ((long)elapsed.tv_sec < 0)
+		return 0;
+	if (!search_first_seqnr) {
+		memcpy(&search_begin, &elapsed, sizeof(search_begin));
+		search_first_seqnr = statist_total + 1;
+		return 0;
+	}
+	if (elapsed.tv_sec < search_begin.tv_sec + search_interval ||
+	    search_lat_stat.ls_count < SEARCH_MIN_REQUESTS)
+		return 0;
+
+	lat = lat_stat_percentile(&search_lat_stat, search_percentile);
+	lag = lat_stat_percentile(&search_lag_stat, search_percentile);
+	ok = (lat <= search_latency && lag <= search_lag);
+
+	if (ok) {
+		search_lower = time_factor;
+		next = search_upper > 0.0 ? (search_lower + search_upper) / 2 : time_factor * 2;
+	} else {
+		search_upper = time_factor;
+		next = (search_lower + search_upper) / 2;
+	}
+
+	printf("SEARCH: speedup=%.6f requests=%lld latency_p=%.9f lag_p=%.9f result=%s lower=%.6f upper=%.6f\n",
+	       (double)time_factor,
+	       search_lat_stat.ls_count,
+	       lat,
+	       lag,
+	       ok ? "ok" : "overload",
+	       (double)search_lower,
+	       (double)search_upper);
+	flush_stdout();
+
+	if (search_upper > 0.0 &&
+	    (search_upper - search_lower <= search_precision * search_upper ||
+	     search_upper < SEARCH_MIN_SPEEDUP)) {
+		search_done = 1;
+		search_report(1);
+		return 1;
+	}
+
+	// rebase the virtual time, but don't inherit any backlog
+	memcpy(&pos, orig_rel, sizeof(pos));
+	timespec_diff(&pos, &stretch_base_orig, &pos);
+	timespec_multiply(&pos, time_stretch);
+	timespec_add(&pos, &stretch_base_factor);
+	if (pos.tv_sec < elapsed.tv_sec ||
+	    (pos.tv_sec == elapsed.tv_sec && pos.tv_nsec < elapsed.tv_nsec))
+		memcpy(&pos, &elapsed, sizeof(pos));
+	memcpy(&stretch_base_orig, orig_rel, sizeof(stretch_base_orig));
+	memcpy(&stretch_base_factor, &pos, sizeof(stretch_base_factor));
+
+	time_factor = next;
+	time_stretch = 1.0 / time_factor;
+
+	lat_stat_reset(&search_lat_stat);
+	lat_stat_reset(&search_lag_stat);
+	memcpy(&search_begin, &elapsed, sizeof(search_begin));
+	search_first_seqnr = statist_total + 1;
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+// preconditioning
+
+/* Instead of reading the input, generate a synthetic write load:
+ * first some sequential passes over the whole device, then a mix of
+ * sequential and random writes. The throughput is measured over
+ * windows of fixed length, and the load stops at steady state, i.e.
+ * when over the last `rounds' windows both the range of the IOPS
+ * values and the excursion of their regression line stay within the
+ * given percentage of their average (similar to SNIA PTS).
+ *
+ * Spec: {<param>=<value>}{,<param>=<value>}
+ */
+
+#define PRECOND_MAX_ROUNDS 64
+
+static struct precond {
+	double pc_seq;      // % of sequential requests after the fill
+	double pc_bs;       // request size (sectors)
+	double pc_qd;       // requests on the fly, 0 = --threads
+	double pc_fill;     // sequential passes over the device
+	double pc_fill_bs;  // request size during the fill (sectors)
+	double pc_window;   // measurement window (seconds)
+	double pc_rounds;   // windows for the steady state criterion
+	double pc_range;    // max range in % of the average
+	double pc_slope;    // max excursion of the slope in % of the average
+	double pc_max;      // time limit (seconds), 0 = none
+	double pc_seed;
+} pc = {
+	.pc_bs       = 8,
+	.pc_fill     = 1,
+	.pc_fill_bs  = 256,
+	.pc_window   = 10,
+	.pc_rounds   = 5,
+	.pc_range    = 20,
+	.pc_slope    = 10,
+	.pc_seed     = 1,
+};
+
+static const struct sim_param precond_params[] = {
+	{ "seq",     &pc.pc_seq },
+	{ "bs",      &pc.pc_bs },
+	{ "qd",      &pc.pc_qd },
+	{ "fill",    &pc.pc_fill },
+	{ "fill_bs", &pc.pc_fill_bs },
+	{ "window",  &pc.pc_window },
+	{ "rounds",  &pc.pc_rounds },
+	{ "range",   &pc.pc_range },
+	{ "slope",   &pc.pc_slope },
+	{ "max",     &pc.pc_max },
+	{ "seed",    &pc.pc_seed },
+	{}
+};
+
+static struct timespec precond_begin = {};
+static long long precond_size = 0;      // in sectors
+static long long precond_fill_pos = 0;
+static int precond_fill_pass = 0;
+static int precond_fill_window = 0;     // current window contains fill requests
+static long long precond_seq_pos = 0;
+static int precond_window = 0;
+static double precond_iops[PRECOND_MAX_ROUNDS];
+static int precond_rounds = 0;          // valid entries in precond_iops[]
+
+static
+void precond_error(const char *txt)
+{
+	printf("ERROR: cannot parse --precondition='%s' at '%s'\n", precondition, txt);
+	do_exit(-1);
+}
+
+/* Called after the device sizes are known.
+ */
+static
+void precond_init(void)
+{
+	char *spec = strdup(precondition);
+	char *tmp;
+	int i;
+
+	for (tmp = strtok(spec, ","); tmp; tmp = strtok(NULL, ",")) {
+		const struct sim_param *par;
+		char *val = strchr(tmp, '=');
+
+		if (!val)
+			precond_error(tmp);
+		*val++ = '\0';
+		for (par = precond_params; par->par_name; par++) {
+			if (!strcmp(tmp, par->par_name))
+				break;
+		}
+		if (!par->par_name || sscanf(val, "%lf", par->par_val) != 1 || *par->par_val < 0)
+			precond_error(tmp);
+	}
+	free(spec);
+
+	if (pc.pc_seq > 100)
+		pc.pc_seq = 100;
+	if (pc.pc_bs < 1)
+		pc.pc_bs = 1;
+	if (pc.pc_fill_bs < 1)
+		pc.pc_fill_bs = 1;
+	if (pc.pc_qd < 1 || pc.pc_qd > total_max)
+		pc.pc_qd = total_max;
+	if (pc.pc_window <= 0)
+		pc.pc_window = 1;
+	if (pc.pc_rounds < 2)
+		pc.pc_rounds = 2;
+	if (pc.pc_rounds > PRECOND_MAX_ROUNDS)
+		pc.pc_rounds = PRECOND_MAX_ROUNDS;
+
+	if (stripe_chunk || concat_mode) {
+		precond_size = logical_size;
+	} else {
+		for (i = 0; i < device_count; i++) {
+			if (!precond_size || devices[i].dev_size < precond_size)
+				precond_size = devices[i].dev_size;
+		}
+	}
+	if (precond_size < pc.pc_bs || precond_size < pc.pc_fill_bs) {
+		printf("ERROR: device is too small for preconditioning\n");
+		do_exit(-1);
+	}
+	srandom((unsigned int)pc.pc_seed);
+
+	printf("INFO: precondition size=%lld fill=%d fill_bs=%d seq=%.1f%% bs=%d qd=%d window=%.3f rounds=%d range=%.1f%% slope=%.1f%%\n",
+	       precond_size,
+	       (int)pc.pc_fill,
+	       (int)pc.pc_fill_bs,
+	       pc.pc_seq,
+	       (int)pc.pc_bs,
+	       (int)pc.pc_qd,
+	       pc.pc_window,
+	       (int)pc.pc_rounds,
+	       pc.pc_range,
+	       pc.pc_slope);
+	flush_stdout();
+}
+
+/* Check the last pc_rounds windows. The slope of the least squares
+ * line is multiplied by the width of the windows, giving the
+ * excursion over the whole measurement.
+ */
+static
+int precond_steady(double *avg_res)
+{
+	int n = (int)pc.pc_rounds;
+	double sum_x = 0.0;
+	double sum_y = 0.0;
+	double sum_xy = 0.0;
+	double sum_xx = 0.0;
+	double min = 0.0;
+	double max = 0.0;
+	double avg;
+	double slope;
+	int i;
+
+	if (precond_rounds < n)
+		return 0;
+	for (i = 0; i < n; i++) {
+		double y = precond_iops[(precond_rounds - n + i) % PRECOND_MAX_ROUNDS];
+
+		sum_x += i;
+		sum_y += y;
+		sum_xy += i * y;
+		sum_xx += (double)i * i;
+		if (!i || y < min)
+			min = y;
+		if (!i || y > max)
+			max = y;
+	}
+	avg = sum_y / n;
+	slope = (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+	*avg_res = avg;
+	if (avg <= 0.0)
+		return 0;
+	return max - min <= avg * pc.pc_range / 100.0 &&
+		fabs(slope) * (n - 1) <= avg * pc.pc_slope / 100.0;
+}
+
+/* Returns 1 when the preconditioning is finished.
+ */
+static
+int precond_check(struct timespec *elapsed)
+{
+	struct lat_stat *st = &precond_stat;
+	struct timespec duration;
+	double secs;
+	double iops;
+	double avg = 0.0;
+	int filling = precond_fill_window;
+	int steady = 0;
+
+	timespec_diff(&duration, &precond_begin, elapsed);
+	secs = duration.tv_nsec * (1.0/(double)NANO) + duration.tv_sec;
+	if (secs < pc.pc_window)
+		return 0;
+
+	iops = st->ls_count / secs;
+	if (!filling) {
+		precond_iops[precond_rounds++ % PRECOND_MAX_ROUNDS] = iops;
+		steady = precond_steady(&avg);
+	}
+	printf("PRECONDITION: window=%d phase=%s requests=%lld iops=%.3f kb_per_sec=%.3f latency_avg=%.9f latency_p99=%.9f latency_max=%.9f steady=%d\n",
+	       ++precond_window,
+	       filling ? "fill" : "mix",
+	       st->ls_count,
+	       iops,
+	       st->ls_sectors / 2.0 / secs,
+	       st->ls_count ? st->ls_sum / st->ls_count : 0.0,
+	       lat_stat_percentile(st, 99.0),
+	       st->ls_max,
+	       steady);
+	flush_stdout();
+
+	lat_stat_reset(st);
+	memcpy(&precond_begin, elapsed, sizeof(precond_begin));
+	precond_fill_window = precond_fill_pass < (int)pc.pc_fill;
+
+	if (steady) {
+		printf("PRECONDITION: steady state reached after %lu s, iops_avg=%.3f\n", elapsed->tv_sec, avg);
 		flush_stdout();
+		return 1;
+	}
+	if (pc.pc_max > 0 && elapsed->tv_sec >= pc.pc_max) {
+		printf("WARN: no steady state reached within %.0f s\n", pc.pc_max);
+		flush_stdout();
+		return 1;
 	}
+	return 0;
+}
 
-	for (;;) {
-		int count;
+/* Generates the next request, or NULL at the end. Like in closed-loop
+ * mode, the timestamp is the current time, so the workers don't wait.
+ */
+static
+struct request *precond_next(void)
+{
+	struct request *rq;
+	struct timespec now;
+	struct timespec elapsed;
+	int len;
 
-		if (verbose > 3) {
-			verbose_status(NULL, "wait_for_input");
+	if (!precond_size)
+		precond_init();
+
+	while (count_submitted >= (int)pc.pc_qd) {
+		get_answer();
+	}
+
+	grace_diff(&elapsed, &now);
+	if ((long)elapsed.tv_sec < 0) {
+		// still in the grace period: the workers will wait
+		memset(&elapsed, 0, sizeof(elapsed));
+	} else if (precond_check(&elapsed)) {
+		return NULL;
+	}
+
+	rq = malloc(sizeof(struct request));
+	if (!rq) {
+		printf("FATAL ERROR: out of memory for requests\n");
+		flush_stdout();
+		do_exit(-1);
+	}
+	memset(rq, 0, sizeof(struct request));
+
+	if (precond_fill_pass < (int)pc.pc_fill) {
+		precond_fill_window = 1;
+		len = pc.pc_fill_bs;
+		if (precond_fill_pos + len > precond_size)
+			len = precond_size - precond_fill_pos;
+		rq->sector = precond_fill_pos;
+		precond_fill_pos += len;
+		if (precond_fill_pos >= precond_size) {
+			precond_fill_pos = 0;
+			precond_fill_pass++;
 		}
+	} else {
+		len = pc.pc_bs;
+		if (random() % 10000 < pc.pc_seq * 100) {
+			if (precond_seq_pos + len > precond_size)
+				precond_seq_pos = 0;
+			rq->sector = precond_seq_pos;
+			precond_seq_pos += len;
+		} else {
+			long long slots = precond_size / len;
+			long long rnd = ((long long)random() << 31) ^ random();
 
-		if (!fgets(buffer, sizeof(buffer), inp))
-			break;
+			rq->sector = (rnd % slots) * len;
+		}
+	}
+	rq->length = len;
+	rq->rwbs = 'W';
+	rq->dev = device_count > 1 || stripe_chunk || concat_mode ? -1 : 0;
+	memcpy(&rq->orig_stamp, &elapsed, sizeof(rq->orig_stamp));
+	return rq;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+// input streams
+
+/* Each stream is read ahead by one request, and the streams are
+ * merged by their timestamps on the fly, so no presorting is necessary.
+ * A stream with st_dev < 0 is shared by all devices.
+ */
+struct name_list {
+	char *nl_names[MAX_DEVICES];
+	int   nl_count;
+};
+
+struct name_list input_list = {};
+struct name_list output_list = {};
+struct name_list offset_list = {};
+struct name_list shift_list = {};
+struct name_list speedup_list = {};
+
+///////////////////////////////////////////////////////////////////////
+
+// native input filters
+
+/* Replacements for the gawk stages of scripts/modules/09_pipe_select.sh
+ * until 17_pipe_sample.sh, producing exactly the same results.
+ * They are applied in the same order as the modules are chained:
+ * select, repeat, slip, subst, spread, resize, sample.
+ */
+char *filter_select = NULL;
+char *filter_repeat = NULL;
+char *filter_slip = NULL;
+char *filter_subst = NULL;
+char *filter_spread = NULL;
+char *filter_resize = NULL;
+char *filter_sample = NULL;
+
+static struct filter {
+	int       f_select;
+	double    f_select_from;
+	double    f_select_to;
+	int       f_repeat;
+	long long f_repeat_offset;
+	int       f_slip;
+	int       f_slip_every;
+	long long f_slip_increase;
+	int       f_subst;
+	char      f_subst_from;
+	char      f_subst_to;
+	int       f_spread;
+	double    f_spread_factor;
+	double    f_spread_align;
+	double    f_spread_offset;
+	int       f_resize;
+	double    f_resize_factor;
+	int       f_resize_min;
+	int       f_resize_max;
+	int       f_sample;
+	struct sampler f_sampler;
+} filter = {};
+
+static
+void filter_error(const char *name, const char *val)
+{
+	printf("ERROR: cannot parse --filter-%s='%s'\n", name, val);
+	do_exit(-1);
+}
+
+static
+void filter_init(void)
+{
+	if (filter_select) {
+		filter.f_select = 1;
+		if (sscanf(filter_select, "%lf,%lf", &filter.f_select_from, &filter.f_select_to) != 2)
+			filter_error("select", filter_select);
+	}
+	if (filter_repeat) {
+		filter.f_repeat = 1;
+		if (filter_repeat[0] && sscanf(filter_repeat, "%lld", &filter.f_repeat_offset) != 1)
+			filter_error("repeat", filter_repeat);
+	}
+	if (filter_slip) {
+		filter.f_slip = 1;
+		if (sscanf(filter_slip, "%d,%lld", &filter.f_slip_every, &filter.f_slip_increase) != 2)
+			filter_error("slip", filter_slip);
+	}
+	if (filter_subst) {
+		filter.f_subst = 1;
+		if (sscanf(filter_subst, "%c,%c", &filter.f_subst_from, &filter.f_subst_to) != 2)
+			filter_error("subst", filter_subst);
+	}
+	if (filter_spread) {
+		filter.f_spread = 1;
+		if (sscanf(filter_spread, "%lf,%lf,%lf", &filter.f_spread_factor, &filter.f_spread_align, &filter.f_spread_offset) != 3 ||
+		    filter.f_spread_align < 1.0)
+			filter_error("spread", filter_spread);
+	}
+	if (filter_resize) {
+		filter.f_resize = 1;
+		if (sscanf(filter_resize, "%lf,%d,%d", &filter.f_resize_factor, &filter.f_resize_min, &filter.f_resize_max) != 3)
+			filter_error("resize", filter_resize);
+	}
+	if (filter_sample) {
+		filter.f_sample = 1;
+		sampler_defaults(&filter.f_sampler);
+		if (sampler_parse(&filter.f_sampler, filter_sample) < 0 ||
+		    sampler_init(&filter.f_sampler) < 0)
+			filter_error("sample", filter_sample);
+	}
+}
+
+/* The stages after repeat. Returns 0 when the request is dropped.
+ * Like the gawk scripts, slip / spread / resize drop lines containing
+ * lowercase letters.
+ */
+static
+int filter_request(struct stream *st, struct request *rq)
+{
+	if (filter.f_slip) {
+		if (islower(rq->rwbs))
+			return 0;
+		if (++st->st_slip_step >= filter.f_slip_every) {
+			st->st_slip_offset += filter.f_slip_increase;
+			st->st_slip_step = 0;
+		}
+		rq->sector += st->st_slip_offset;
+	}
+	if (filter.f_subst && toupper(rq->rwbs) == toupper(filter.f_subst_from)) {
+		rq->rwbs = filter.f_subst_to;
+	}
+	if ((filter.f_spread || filter.f_resize) && islower(rq->rwbs))
+		return 0;
+	if (filter.f_spread) {
+		double align = filter.f_spread_align;
+		double sector = rq->sector;
+		double newpos = (long long)(sector * filter.f_spread_factor / align) * align + fmod(sector, align) + filter.f_spread_offset;
+		rq->sector = (long long)newpos;
+	}
+	if (filter.f_resize) {
+		long long newsize = (long long)(rq->length * filter.f_resize_factor);
+		if (newsize < filter.f_resize_min)
+			newsize = filter.f_resize_min;
+		if (newsize > filter.f_resize_max)
+			newsize = filter.f_resize_max;
+		rq->length = newsize;
+	}
+	return 1;
+}
+
+
+static
+void stream_open(struct stream *st, char *name)
+{
+	int len = strlen(name);
+
+	st->st_name = name;
+	if (!strcmp(name, "-")) {
+		st->st_inp = stdin;
+	} else if (len > 3 && !strcmp(name + len - 3, ".gz")) {
+		char cmd[4096];
+		if (strchr(name, '\'')) {
+			printf("ERROR: bad input filename '%s'\n", name);
+			do_exit(-1);
+		}
+		snprintf(cmd, sizeof(cmd), "gzip -cd '%s'", name);
+		st->st_inp = popen(cmd, "r");
+		st->st_is_pipe = 1;
+	} else {
+		st->st_inp = fopen(name, "r");
+	}
+	if (!st->st_inp) {
+		printf("ERROR: cannot open input '%s' (%d %s)\n", name, errno, strerror(errno));
+		do_exit(-1);
+	}
+	// non-seekable inputs are repeated from memory
+	if (filter.f_repeat && !st->st_is_pipe && fseek(st->st_inp, 0, SEEK_CUR) < 0)
+		st->st_record = 1;
+}
+
+static
+void stream_close(struct stream *st);
+
+static
+void stream_record(struct stream *st, struct request *rq)
+{
+	struct raw_request *raw;
+
+	if (st->st_buf_count >= st->st_buf_alloc) {
+		int new_alloc = st->st_buf_alloc ? st->st_buf_alloc * 2 : 4096;
+		struct raw_request *new_buf = realloc(st->st_buf, new_alloc * sizeof(struct raw_request));
+		if (!new_buf) {
+			printf("FATAL ERROR: out of memory for repeating input '%s'\n", st->st_name);
+			flush_stdout();
+			do_exit(-1);
+		}
+		st->st_buf = new_buf;
+		st->st_buf_alloc = new_alloc;
+	}
+	raw = &st->st_buf[st->st_buf_count++];
+	memcpy(&raw->raw_stamp, &rq->orig_stamp, sizeof(raw->raw_stamp));
+	raw->raw_sector = rq->sector;
+	raw->raw_length = rq->length;
+	raw->raw_rwbs = rq->rwbs;
+	raw->raw_delay = rq->orig_delay;
+	raw->raw_duration = rq->orig_duration;
+}
+
+/* The last stage: spatial and temporal sampling, by the same code as
+ * sample_load.exe. A request touching several runs of kept blocks is
+ * split, the remaining pieces are delivered by stream_piece().
+ * Returns 0 when the request is dropped.
+ */
+static
+int stream_sample(struct stream *st, struct request *rq)
+{
+	struct sampler *s = &filter.f_sampler;
+	long long stamp_ns = (long long)rq->orig_stamp.tv_sec * 1000000000LL + rq->orig_stamp.tv_nsec;
+	long long new_ns;
+	int count;
+
+	if (!sample_time(s, stamp_ns, &new_ns))
+		return 0;
+	count = sample_space(s, rq->sector, rq->length, st->st_piece, SAMPLE_MAX_PIECES);
+	if (!count)
+		return 0;
+	rq->orig_stamp.tv_sec = new_ns / 1000000000LL;
+	rq->orig_stamp.tv_nsec = new_ns % 1000000000LL;
+	rq->sector = st->st_piece[0].sp_sector;
+	rq->length = st->st_piece[0].sp_length;
+	memcpy(&st->st_piece_rq, rq, sizeof(st->st_piece_rq));
+	st->st_piece_count = count;
+	st->st_piece_pos = 1;
+	return 1;
+}
+
+static
+void stream_piece(struct stream *st, struct request *rq)
+{
+	struct sample_piece *piece = &st->st_piece[st->st_piece_pos++];
+
+	memcpy(rq, &st->st_piece_rq, sizeof(*rq));
+	rq->sector = piece->sp_sector;
+	rq->length = piece->sp_length;
+}
+
+/* Get the next raw request, after the select and repeat stages.
+ * Returns 1 on success, 0 for skipped lines, -1 at the end.
+ */
+static
+int stream_fetch(struct stream *st, struct request *rq)
+{
+	char buffer[4096];
+	int count;
+
+	if (st->st_replaying) {
+		struct raw_request *raw;
+
+		if (st->st_buf_pos >= st->st_buf_count) {
+			st->st_buf_pos = 0;
+			st->st_pass++;
+		}
+		raw = &st->st_buf[st->st_buf_pos++];
+		memcpy(&rq->orig_stamp, &raw->raw_stamp, sizeof(rq->orig_stamp));
+		rq->sector = raw->raw_sector + st->st_pass * filter.f_repeat_offset;
+		rq->length = raw->raw_length;
+		rq->rwbs = raw->raw_rwbs;
+		rq->orig_delay = raw->raw_delay;
+		rq->orig_duration = raw->raw_duration;
+		return 1;
+	}
+	if (!st->st_inp)
+		return -1;
+
+	if (verbose > 3) {
+		verbose_status(NULL, "wait_for_input");
+	}
+
+	if (!fgets(buffer, sizeof(buffer), st->st_inp)) {
+		if (!filter.f_repeat)
+			return -1;
+		if (!st->st_pass_count) {
+			printf("WARN: nothing to repeat from input '%s'\n", st->st_name);
+			flush_stdout();
+			return -1;
+		}
+		st->st_pass_count = 0;
+		st->st_pass++;
+		if (st->st_record) {
+			stream_close(st);
+			st->st_replaying = 1;
+			st->st_buf_pos = 0;
+		} else if (st->st_is_pipe) {
+			stream_close(st);
+			stream_open(st, st->st_name);
+		} else if (fseek(st->st_inp, 0, SEEK_SET) < 0) {
+			printf("ERROR: cannot rewind input '%s' (%d %s)\n", st->st_name, errno, strerror(errno));
+			flush_stdout();
+			return -1;
+		}
+		return 0;
+	}
 		
-		statist_lines++;
+	statist_lines++;
+
+	if (dependency_mode) {
+		// the original timing, if present (e.g. when replaying .replay files)
+		count = sscanf(buffer, "%ld.%ld ; %lld ; %d ; %c ; %lf ; %lf", &rq->orig_stamp.tv_sec, &rq->orig_stamp.tv_nsec, &rq->sector, &rq->length, &rq->rwbs, &rq->orig_delay, &rq->orig_duration);
+		if (count > 5 && count < 7)
+			count = 5;
+	} else {
+		count = sscanf(buffer, "%ld.%ld ; %lld ; %d ; %c", &rq->orig_stamp.tv_sec, &rq->orig_stamp.tv_nsec, &rq->sector, &rq->length, &rq->rwbs);
+	}
+	if (count != 5 && count != 7) {
+		printf("ERROR: bad input count=%d, line='%s'\n", count, buffer);
+		flush_stdout();
+		return 0;
+	}
+
+	if (filter.f_select) {
+		double stamp = strtod(buffer, NULL);
+		if (!(stamp >= filter.f_select_from && stamp < filter.f_select_to))
+			return 0;
+	}
+	st->st_pass_count++;
+	if (st->st_record)
+		stream_record(st, rq);
+	rq->sector += st->st_pass * filter.f_repeat_offset;
+	return 1;
+}
+
+static
+void stream_close(struct stream *st)
+{
+	if (!st->st_inp)
+		return;
+	if (st->st_is_pipe)
+		pclose(st->st_inp);
+	else if (st->st_inp != stdin)
+		fclose(st->st_inp);
+	st->st_inp = NULL;
+}
+
+/* Returns the next request within the replay time window,
+ * or NULL at the end of the stream.
+ */
+static
+struct request *stream_read(struct stream *st)
+{
+	struct request *rq = NULL;
+
+	for (;;) {
+		int status;
 
 		if (!rq)
 			rq = malloc(sizeof(struct request));
@@ -1903,86 +3813,380 @@ void parse(FILE *inp)
 		}
 		memset(rq, 0, sizeof(struct request));
 
-		count = sscanf(buffer, "%ld.%ld ; %lld ; %d ; %c", &rq->orig_stamp.tv_sec, &rq->orig_stamp.tv_nsec, &rq->sector, &rq->length, &rq->rwbs);
-		if (count != 5) {
-			printf("ERROR: bad input count=%d, line='%s'\n", count, buffer);
-			flush_stdout();
-			continue;
+		if (st->st_piece_pos < st->st_piece_count) {
+			stream_piece(st, rq);
+		} else {
+			status = stream_fetch(st, rq);
+			if (status < 0)
+				break;
+			if (!status || !filter_request(st, rq))
+				continue;
+			if (filter.f_sample && !stream_sample(st, rq))
+				continue;
 		}
 
 		// treat backshifts in time (caused by repeated input files)
-		timespec_add(&rq->orig_stamp, &timeshift);
-		if (rq->orig_stamp.tv_sec < old_stamp.tv_sec) {
+		timespec_add(&rq->orig_stamp, &st->st_timeshift);
+		if (rq->orig_stamp.tv_sec < st->st_old_stamp.tv_sec) {
 			struct timespec delta = {};
-			timespec_diff(&delta, &rq->orig_stamp, &old_stamp);
-			timespec_add(&timeshift, &delta);
+			timespec_diff(&delta, &rq->orig_stamp, &st->st_old_stamp);
+			timespec_add(&st->st_timeshift, &delta);
 			timespec_add(&rq->orig_stamp, &delta);
 			printf("INFO: backshift at time=%ld.%09ld s detected (delta=%ld.%09ld s, total timeshift=%ld.%09ld s)\n",
 			       rq->orig_stamp.tv_sec, rq->orig_stamp.tv_nsec,
 			       delta.tv_sec, delta.tv_nsec,
-			       timeshift.tv_sec, timeshift.tv_nsec);
+			       st->st_timeshift.tv_sec, st->st_timeshift.tv_nsec);
+			flush_stdout();
+		}
+		memcpy(&st->st_old_stamp, &rq->orig_stamp, sizeof(st->st_old_stamp));
+
+		// relocate in time and space
+		if (!st->st_has_first) {
+			memcpy(&st->st_first_stamp, &rq->orig_stamp, sizeof(st->st_first_stamp));
+			st->st_has_first = 1;
+		}
+		if (st->st_speedup != 1.0) {
+			timespec_diff(&rq->orig_stamp, &st->st_first_stamp, &rq->orig_stamp);
+			timespec_multiply(&rq->orig_stamp, 1.0 / st->st_speedup);
+			timespec_add(&rq->orig_stamp, &st->st_first_stamp);
+			rq->orig_delay /= st->st_speedup;
+			rq->orig_duration /= st->st_speedup;
+		}
+		timespec_add(&rq->orig_stamp, &st->st_shift);
+		rq->sector += st->st_offset;
+		rq->stream = st - streams;
+
+		if (verbose) {
+			verbose_status(rq, "got_input");
+		}
+
+		// check replay time window
+		if (rq->orig_stamp.tv_sec < replay_start) {
+			continue;
+		}
+		if (replay_end && rq->orig_stamp.tv_sec >= replay_end) {
+			break;
+		}
+		rq->rwbs = toupper(rq->rwbs);
+		if (rq->rwbs != 'R' && rq->rwbs != 'W') {
+			printf("ERROR: bad character '%c'\n", rq->rwbs);
+			continue;
+		}
+		rq->dev = st->st_dev;
+		st->st_total++;
+		return rq;
+	}
+	free(rq);
+	stream_close(st);
+	st->st_replaying = 0;
+	free(st->st_buf);
+	st->st_buf = NULL;
+	return NULL;
+}
+
+/* k-way merge of all streams by timestamp.
+ */
+static
+struct request *stream_next(void)
+{
+	static int primed = 0;
+	struct stream *best = NULL;
+	struct request *rq;
+	int i;
+
+	if (stream_count == 1) // no lookahead necessary
+		return stream_read(&streams[0]);
+
+	if (!primed) {
+		primed++;
+		for (i = 0; i < stream_count; i++)
+			streams[i].st_next = stream_read(&streams[i]);
+	}
+	for (i = 0; i < stream_count; i++) {
+		struct stream *st = &streams[i];
+		if (!st->st_next)
+			continue;
+		if (!best ||
+		    st->st_next->orig_stamp.tv_sec < best->st_next->orig_stamp.tv_sec ||
+		    (st->st_next->orig_stamp.tv_sec == best->st_next->orig_stamp.tv_sec &&
+		     st->st_next->orig_stamp.tv_nsec < best->st_next->orig_stamp.tv_nsec))
+			best = st;
+	}
+	if (!best)
+		return NULL;
+	rq = best->st_next;
+	best->st_next = stream_read(best);
+	return rq;
+}
+
+static
+void streams_close(void)
+{
+	int i;
+
+	for (i = 0; i < stream_count; i++) {
+		free(streams[i].st_next);
+		streams[i].st_next = NULL;
+		stream_close(&streams[i]);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+
+static
+void dispatch_request(struct request *rq)
+{
+	struct device *dev = &devices[rq->dev];
+
+	rq->seqnr = ++statist_total;
+	dev->dev_total++;
+	if (rq->rwbs != 'R') {
+		statist_writes++;
+		dev->dev_writes++;
+	}
+
+	if (rq->sector + rq->length > max_size)
+		max_size = rq->sector + rq->length;
+	if (rq->sector + rq->length > dev->dev_max_size)
+		dev->dev_max_size = rq->sector + rq->length;
+
+	if (rq->sector + rq->length > dev->dev_size && dev->dev_size) {
+		if (!dev->dev_overflow) {
+			printf("INFO: sector %lld+%d exceeds %lld, turning on wraparound.\n", rq->sector, rq->length, dev->dev_size);
 			flush_stdout();
+			dev->dev_overflow++;
 		}
-		memcpy(&old_stamp, &rq->orig_stamp, sizeof(old_stamp));
+		rq->sector %= dev->dev_size;
+		if (rq->sector + rq->length > dev->dev_size) { // damn, it spans the border
+			printf("WARN: cannot process sector %lld+%d at border %lld, please use a larger device\n", rq->sector, rq->length, dev->dev_size);
+			flush_stdout();
+			finish_member(rq, 0);
+			free(rq);
+			return;
+		}
+	}
+
+	// add new element
+	execute(rq);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+// striping / concatenation of the devices
+
+static
+void mapper_init(void)
+{
+	long long min_size = 0;
+	int i;
+
+	if (!stripe_chunk && !concat_mode)
+		return;
+	for (i = 0; i < device_count; i++) {
+		if (!devices[i].dev_size) { // no size => no wraparound
+			logical_size = 0;
+			return;
+		}
+		if (!min_size || devices[i].dev_size < min_size)
+			min_size = devices[i].dev_size;
+		logical_size += devices[i].dev_size;
+	}
+	if (stripe_chunk)
+		logical_size = (min_size / stripe_chunk) * stripe_chunk * device_count;
+	printf("INFO: %s over %d devices, logical size=%lld blocks (%lld kB)\n",
+	       stripe_chunk ? "striping" : "concatenation",
+	       device_count,
+	       logical_size,
+	       logical_size / 2);
+	flush_stdout();
+}
+
+/* Returns the length of the piece which fits onto a single device.
+ */
+static
+int map_sector(long long sector, int len, int *dev_nr, long long *dev_sector)
+{
+	int max_len;
+
+	if (stripe_chunk) {
+		long long stripe_nr = sector / stripe_chunk;
+		int offset = sector % stripe_chunk;
+
+		*dev_nr = stripe_nr % device_count;
+		*dev_sector = (stripe_nr / device_count) * stripe_chunk + offset;
+		max_len = stripe_chunk - offset;
+	} else {
+		int i;
+
+		for (i = 0; i < device_count - 1; i++) {
+			if (sector < devices[i].dev_size)
+				break;
+			sector -= devices[i].dev_size;
+		}
+		*dev_nr = i;
+		*dev_sector = sector;
+		max_len = len;
+		if (devices[i].dev_size && sector + len > devices[i].dev_size)
+			max_len = devices[i].dev_size - sector;
+	}
+	return len < max_len ? len : max_len;
+}
+
+/* Split a logical request into members, one per device piece.
+ */
+static
+void map_request(struct request *rq)
+{
+	static int overflow = 0;
+	long long sector;
+	int len = rq->length;
+
+	if (logical_size && rq->sector + rq->length > logical_size) {
+		if (!overflow) {
+			printf("INFO: sector %lld+%d exceeds logical size %lld, turning on wraparound.\n", rq->sector, rq->length, logical_size);
+			flush_stdout();
+			overflow++;
+		}
+		rq->sector %= logical_size;
+	}
+	rq->dev = -1;
+	rq->pending = 1; // guard until all members are dispatched
+	rq->replay_stamp.tv_sec = -1;
+	sector = rq->sector;
+
+	while (len > 0) {
+		struct request *member = malloc(sizeof(struct request));
+		long long dev_sector;
+		int dev_nr;
+		int this_len;
+
+		if (!member) {
+			printf("FATAL ERROR: out of memory for requests\n");
+			flush_stdout();
+			do_exit(-1);
+		}
+		this_len = map_sector(sector, len, &dev_nr, &dev_sector);
+		memcpy(member, rq, sizeof(struct request));
+		member->dev = dev_nr;
+		member->sector = dev_sector;
+		member->length = this_len;
+		member->next = NULL;
+		member->parent = rq;
+		member->pending = 0;
+		rq->pending++;
+
+		dispatch_request(member);
+
+		sector += this_len;
+		if (logical_size && sector >= logical_size)
+			sector = 0;
+		len -= this_len;
+	}
+
+	// drop the guard
+	{
+		struct request guard = { .parent = rq };
+		finish_member(&guard, 0);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+
+static
+void device_summary(FILE *out, struct device *dev)
+{
+	fprintf(out, "device                        : %s\n", dev->dev_name);
+	fprintf(out, "# total     requests          : %6d\n", dev->dev_total);
+	fprintf(out, "# completed requests          : %6d\n", dev->dev_completed);
+	fprintf(out, "# write     requests          : %6d\n", dev->dev_writes);
+	fprintf(out, "size of device:      %12lld blocks (%lld kB)\n", dev->dev_size, dev->dev_size/2);
+	fprintf(out, "max block# occurred: %12lld blocks (%lld kB)\n", dev->dev_max_size, dev->dev_max_size/2);
+	fprintf(out, "wraparound factor:   %6.3f\n", (double)dev->dev_max_size / (double)dev->dev_size);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+/* Main dispatcher routine.
+*/
+static
+void parse(void)
+{
+	static int first_call = 0;
+	struct request *rq;
+	int i;
 
-		if (verbose) {
-			verbose_status(rq, "got_input");
-		}
+	// just determine the device sizes
+	devices_open(0);
+	devices_close();
+	mapper_init();
+	verify_open(0);
 
-		// check replay time window
-		if (rq->orig_stamp.tv_sec < replay_start) {
-			continue;
-		}
-		if (replay_end && rq->orig_stamp.tv_sec >= replay_end) {
-			break;
-		}
-		rq->rwbs = toupper(rq->rwbs);
-		if (rq->rwbs != 'R' && rq->rwbs != 'W') {
-			printf("ERROR: bad character '%c'\n", rq->rwbs);
-			continue;
-		}
+	// get start time, but only after opening everything, since open() may produce delays
+	clock_gettime(CLOCK_REALTIME, &start_stamp);
+	
+	if (verbose) {
+		printf("INFO: tag_start=%ld\n", start_stamp.tv_sec);
+		flush_stdout();
+	}
 
+	while ((rq = precondition ? precond_next() : stream_next())) {
 		// compute virtual start time
 		if (!first_call) {
 			first_call++;
 			memcpy(&first_stamp, &rq->orig_stamp, sizeof(first_stamp));
 		}
 		timespec_diff(&rq->orig_factor_stamp, &first_stamp, &rq->orig_stamp);
-		timespec_multiply(&rq->orig_factor_stamp, time_stretch);
-
-		// avoid flooding the pipelines too much
-		while (count_submitted > bottleneck ||
-		       ((conflict_mode == 1 || count_pushback > 0) &&
-			count_submitted > 1 &&
-			delay_distance(&rq->orig_factor_stamp))) {
-			get_answer();
+		if (search_mode && search_check(&rq->orig_factor_stamp)) {
+			free(rq);
+			break;
 		}
+		timespec_diff(&rq->orig_factor_stamp, &stretch_base_orig, &rq->orig_factor_stamp);
+		timespec_multiply(&rq->orig_factor_stamp, time_stretch);
+		timespec_add(&rq->orig_factor_stamp, &stretch_base_factor);
 
-		rq->seqnr = ++statist_total;
-		if (rq->rwbs != 'R')
-			statist_writes++;
-
-		if (rq->sector + rq->length > max_size)
-			max_size = rq->sector + rq->length;
-
-		if (rq->sector + rq->length > main_size && main_size) {
-			if (!overflow) {
-				printf("INFO: sector %lld+%d exceeds %lld, turning on wraparound.\n", rq->sector, rq->length, main_size);
-				flush_stdout();
-				overflow++;
+		if (closed_loop) {
+			// ignore the timestamps, keep the queue depth
+			if (closed_loop_throttle(rq)) {
+				free(rq);
+				break;
 			}
-			rq->sector %= main_size;
-			if (rq->sector + rq->length > main_size) { // damn, it spans the border
-				printf("WARN: cannot process sector %lld+%d at border %lld, please use a larger device\n", rq->sector, rq->length, main_size);
-				flush_stdout();
-				continue;
+		} else if (dependency_mode) {
+			// ignore the timestamps, wait for the predecessors
+			deps_throttle(rq);
+		} else if (precondition) {
+			// already throttled, the timestamp is the current time
+			memcpy(&rq->orig_factor_stamp, &rq->orig_stamp, sizeof(rq->orig_factor_stamp));
+		} else {
+			// avoid flooding the pipelines too much
+			while (count_submitted > bottleneck ||
+			       ((conflict_mode == 1 || count_pushback > 0) &&
+				count_submitted > 1 &&
+				delay_distance(&rq->orig_factor_stamp))) {
+				get_answer();
 			}
 		}
 
-		// add new element
-		execute(rq);
-		rq = NULL;
+		if (rq->dev < 0 && (stripe_chunk || concat_mode)) {
+			map_request(rq);
+			continue;
+		}
+		if (rq->dev < 0) { // shared stream: replay on all devices
+			for (i = 1; i < device_count; i++) {
+				struct request *copy = malloc(sizeof(struct request));
+				if (!copy) {
+					printf("FATAL ERROR: out of memory for requests\n");
+					flush_stdout();
+					do_exit(-1);
+				}
+				memcpy(copy, rq, sizeof(struct request));
+				copy->dev = i;
+				dispatch_request(copy);
+			}
+			rq->dev = 0;
+		}
+		dispatch_request(rq);
 	}
+	streams_close();
 
 	printf("--------------------------------------\n");
 	flush_stdout();
@@ -1993,6 +4197,20 @@ void parse(FILE *inp)
 	printf("--------------------------------------\n");
 	flush_stdout();
 
+	if (closed_loop && closed_loop_qd <= closed_loop_max) {
+		// input exhausted before the step was finished
+		struct timespec now;
+		struct timespec elapsed;
+		grace_diff(&elapsed, &now);
+		closed_loop_report(&elapsed);
+	}
+	if (dependency_mode)
+		deps_report();
+	if (search_mode && !search_done) {
+		printf("WARN: input exhausted before the speedup search has converged\n");
+		search_report(0);
+	}
+
 	// close all pipes => leads to EOF at childs
 	close_all_queues(queue, sub_max, 1, -1);
 
@@ -2009,6 +4227,8 @@ void parse(FILE *inp)
 	printf("# dropped   requests          : %6d\n", statist_dropped);
 	printf("# pushback  requests          : %6d\n", statist_pushback);
 	printf("# ordered   requests (waits)  : %6d\n", statist_ordered);
+	if (stripe_chunk || concat_mode)
+		printf("# logical   requests          : %6d\n", statist_logical);
 	printf("# verify errors during replay : %6lld\n", verify_errors);
 	printf("conflict_mode                 : %6d\n", conflict_mode);
 	printf("strong_mode                   : %6d\n", strong_mode);
@@ -2028,7 +4248,36 @@ void parse(FILE *inp)
 	printf("size of device:      %12lld blocks (%lld kB)\n", main_size, main_size/2);
 	printf("max block# occurred: %12lld blocks (%lld kB)\n", max_size, max_size/2);
 	printf("wraparound factor:   %6.3f\n", (double)max_size / (double)main_size);
+
+	for (i = 0; i < device_count && device_count > 1; i++) {
+		printf("\n");
+		device_summary(stdout, &devices[i]);
+	}
+	for (i = 0; i < stream_count && consolidate_mode; i++) {
+		struct lat_stat *st = &streams[i].st_lat;
+		if (!i)
+			printf("\n");
+		printf("STREAM: stream=%d input=%s requests=%d completed=%lld kb=%lld latency_avg=%.9f latency_p50=%.9f latency_p99=%.9f latency_max=%.9f\n",
+		       i,
+		       streams[i].st_name,
+		       streams[i].st_total,
+		       st->ls_count,
+		       st->ls_sectors / 2,
+		       st->ls_count ? st->ls_sum / st->ls_count : 0.0,
+		       lat_stat_percentile(st, 50.0),
+		       lat_stat_percentile(st, 99.0),
+		       st->ls_max);
+	}
 	flush_stdout();
+
+	for (i = 0; i < device_count; i++) {
+		FILE *out = devices[i].dev_out;
+		if (!out)
+			continue;
+		fprintf(out, "=======================================\n\n");
+		device_summary(out, &devices[i]);
+		fflush(out);
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -2039,6 +4288,8 @@ void parse(FILE *inp)
 #define ARG_INT		-1
 #define ARG_FLOAT	-2
 #define ARG_TIMESPEC	-3
+#define ARG_STRING	-4
+#define ARG_LIST	-5
 
 #define ARG_ADD		-10
 #define ARG_SUB		-11
@@ -2144,6 +4395,253 @@ const struct arg arg_table[] = {
 
 
 
+	{
+		.arg_name  = "|",
+		.arg_descr = "Closed-loop benchmarking (ignores timestamps):",
+	},
+	{
+		.arg_name  = "closed-loop-max",
+		.arg_descr = "sweep by doubling the queue depth up to this value",
+		.arg_const = ARG_INT,
+		.arg_val   = &closed_loop_max,
+	},
+	{
+		.arg_name  = "closed-loop-step",
+		.arg_descr = "duration of each sweep step (in seconds, default=10)",
+		.arg_const = ARG_INT,
+		.arg_val   = &closed_loop_step,
+	},
+	{
+		.arg_name  = "closed-loop",
+		.arg_descr = "keep this number of requests on the fly (0=open loop)",
+		.arg_const = ARG_INT,
+		.arg_val   = &closed_loop,
+	},
+
+
+
+	{
+		.arg_name  = "|",
+		.arg_descr = "Dependency-aware replay (ignores timestamps):",
+	},
+	{
+		.arg_name  = "dependency-replay",
+		.arg_descr = "as fast as possible, keeping dependencies inferred from the input",
+		.arg_const = 1,
+		.arg_val   = &dependency_mode,
+	},
+	{
+		.arg_name  = "dependency-gap",
+		.arg_descr = "max think time of a dependency (in seconds, default=0.001)",
+		.arg_const = ARG_FLOAT,
+		.arg_val   = &dependency_gap,
+	},
+
+
+
+	{
+		.arg_name  = "|",
+		.arg_descr = "Adaptive search for the max sustainable speedup:",
+	},
+	{
+		.arg_name  = "search-speedup",
+		.arg_descr = "adjust the speedup continuously, starting at --speedup",
+		.arg_const = 1,
+		.arg_val   = &search_mode,
+	},
+	{
+		.arg_name  = "search-interval",
+		.arg_descr = "measurement interval per speedup (in seconds, default=10)",
+		.arg_const = ARG_INT,
+		.arg_val   = &search_interval,
+	},
+	{
+		.arg_name  = "search-percentile",
+		.arg_descr = "latency / lag percentile to check (default=99)",
+		.arg_const = ARG_FLOAT,
+		.arg_val   = &search_percentile,
+	},
+	{
+		.arg_name  = "search-latency",
+		.arg_descr = "bound for the latency percentile (in seconds, default=0.05)",
+		.arg_const = ARG_FLOAT,
+		.arg_val   = &search_latency,
+	},
+	{
+		.arg_name  = "search-lag",
+		.arg_descr = "bound for the replay_delay percentile (in seconds, default=1)",
+		.arg_const = ARG_FLOAT,
+		.arg_val   = &search_lag,
+	},
+	{
+		.arg_name  = "search-precision",
+		.arg_descr = "stop at this relative distance of the bounds (default=0.02)",
+		.arg_const = ARG_FLOAT,
+		.arg_val   = &search_precision,
+	},
+
+
+
+	{
+		.arg_name  = "|",
+		.arg_descr = "Preconditioning (ignores the input):",
+	},
+	{
+		.arg_name  = "precondition",
+		.arg_descr = "write until steady state ({<param>=<val>}{,<param>=<val>}, params seq bs qd fill fill_bs window rounds range slope max seed)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &precondition,
+	},
+
+
+
+	{
+		.arg_name  = "|",
+		.arg_descr = "Multiple devices:",
+	},
+	{
+		.arg_name  = "input-offset",
+		.arg_descr = "sector offset for the corresponding --input (repeatable)",
+		.arg_const = ARG_LIST,
+		.arg_val   = &offset_list,
+	},
+	{
+		.arg_name  = "input-shift",
+		.arg_descr = "time offset for the corresponding --input (in seconds)",
+		.arg_const = ARG_LIST,
+		.arg_val   = &shift_list,
+	},
+	{
+		.arg_name  = "input-speedup",
+		.arg_descr = "speedup factor for the corresponding --input",
+		.arg_const = ARG_LIST,
+		.arg_val   = &speedup_list,
+	},
+	{
+		.arg_name  = "input",
+		.arg_descr = "read the load from file (repeatable, paired with <device>s)",
+		.arg_const = ARG_LIST,
+		.arg_val   = &input_list,
+	},
+	{
+		.arg_name  = "consolidate",
+		.arg_descr = "replay all --input files concurrently, tag output by stream",
+		.arg_const = 1,
+		.arg_val   = &consolidate_mode,
+	},
+	{
+		.arg_name  = "output",
+		.arg_descr = "write the results to file (repeatable, paired with <device>s)",
+		.arg_const = ARG_LIST,
+		.arg_val   = &output_list,
+	},
+	{
+		.arg_name  = "stripe",
+		.arg_descr = "stripe the load over all <device>s (chunk size in sectors)",
+		.arg_const = ARG_INT,
+		.arg_val   = &stripe_chunk,
+	},
+	{
+		.arg_name  = "concat",
+		.arg_descr = "concatenate all <device>s to one logical device",
+		.arg_const = 1,
+		.arg_val   = &concat_mode,
+	},
+
+
+
+	{
+		.arg_name  = "|",
+		.arg_descr = "Native input filters (same as the pipe_* modules):",
+	},
+	{
+		.arg_name  = "filter-select",
+		.arg_descr = "only timestamps in [<from>,<to>) (format <from>,<to>)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &filter_select,
+	},
+	{
+		.arg_name  = "filter-repeat",
+		.arg_descr = "repeat the input forever (format [<sector_offset>])",
+		.arg_const = ARG_STRING,
+		.arg_val   = &filter_repeat,
+	},
+	{
+		.arg_name  = "filter-slip",
+		.arg_descr = "slip sectors (format <every>,<increase>)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &filter_slip,
+	},
+	{
+		.arg_name  = "filter-subst",
+		.arg_descr = "substitute the operation (format <from>,<to>)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &filter_subst,
+	},
+	{
+		.arg_name  = "filter-spread",
+		.arg_descr = "spread sectors (format <factor>,<align>,<offset>)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &filter_spread,
+	},
+	{
+		.arg_name  = "filter-resize",
+		.arg_descr = "resize requests (format <factor>,<min>,<max>)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &filter_resize,
+	},
+	{
+		.arg_name  = "filter-sample",
+		.arg_descr = "sample blocks / time windows (format space=<rate>,time=<rate>,...)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &filter_sample,
+	},
+
+
+
+	{
+		.arg_name  = "|",
+		.arg_descr = "CPU and NUMA placement:",
+	},
+	{
+		.arg_name  = "cpus-main",
+		.arg_descr = "pin the main process to CPU list (e.g. 0-3,8)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &cpus_main,
+	},
+	{
+		.arg_name  = "cpus-submit",
+		.arg_descr = "pin the submit dispatchers to CPU list",
+		.arg_const = ARG_STRING,
+		.arg_val   = &cpus_submit,
+	},
+	{
+		.arg_name  = "cpus-answer",
+		.arg_descr = "pin the answer dispatchers to CPU list",
+		.arg_const = ARG_STRING,
+		.arg_val   = &cpus_answer,
+	},
+	{
+		.arg_name  = "cpus-worker",
+		.arg_descr = "pin the workers to CPU list",
+		.arg_const = ARG_STRING,
+		.arg_val   = &cpus_worker,
+	},
+	{
+		.arg_name  = "numa-node",
+		.arg_descr = "default CPUs and memory from this NUMA node",
+		.arg_const = ARG_INT,
+		.arg_val   = &numa_node,
+	},
+	{
+		.arg_name  = "numa-auto",
+		.arg_descr = "use the NUMA node where <device> is attached",
+		.arg_const = 1,
+		.arg_val   = &numa_auto,
+	},
+
+
+
 	{
 		.arg_name  = "|",
 		.arg_descr = "Verification modes:",
@@ -2233,7 +4731,19 @@ const struct arg arg_table[] = {
 		.arg_const = ARG_TIMESPEC,
 		.arg_val   = &simulate_io,
 	},
+	{
+		.arg_name  = "sim-device",
+		.arg_descr = "simulate a device model (format {hdd|ssd|raid0}{,<param>=<val>})",
+		.arg_const = ARG_STRING,
+		.arg_val   = &sim_device,
+	},
 #endif
+	{
+		.arg_name  = "io-backend",
+		.arg_descr = "IO engine (sync|null|delay|model|<file.so>, default=sync)",
+		.arg_const = ARG_STRING,
+		.arg_val   = &io_backend,
+	},
 	{
 		.arg_name  = "ahead-limit",
 		.arg_descr = "limit pipe fillahead (realtime <sec>.<nsec>)",
@@ -2278,7 +4788,7 @@ void usage(void)
 {
 	const struct arg *tmp;
 
-	printf("usage: blkreplay {--<option>[=<value>]} <device>\n");
+	printf("usage: blkreplay {--<option>[=<value>]} <device> {<device>}\n");
 
 	for (tmp = arg_table; tmp->arg_name; tmp++) {
 		int len;
@@ -2313,11 +4823,13 @@ void parse_args(int argc, char *argv[])
 		int count = 1;
 
 		if (this[0] != '-') {
-			if (main_name) {
-				printf("<device> must not be set twice\n");
+			if (device_count >= MAX_DEVICES) {
+				printf("too many <device>s\n");
 				usage();
 			}
-			main_name = this;
+			devices[device_count++].dev_name = this;
+			if (!main_name)
+				main_name = this;
 			continue;
 		}
 		this++;
@@ -2356,6 +4868,19 @@ void parse_args(int argc, char *argv[])
 		case ARG_FLOAT:
 			*(FLOAT*)tmp->arg_val = atof(this);
 			break;
+		case ARG_STRING:
+			*(char**)tmp->arg_val = this;
+			break;
+		case ARG_LIST:
+		{
+			struct name_list *list = tmp->arg_val;
+			if (list->nl_count >= MAX_DEVICES) {
+				printf("too many values for '%s'\n", tmp->arg_name);
+				usage();
+			}
+			list->nl_names[list->nl_count++] = this;
+			break;
+		}
 		case ARG_TIMESPEC:
 			count = sscanf(this, "%lu.%lu",
 				       &((struct timespec*)tmp->arg_val)->tv_sec,
@@ -2388,24 +4913,168 @@ void parse_args(int argc, char *argv[])
 	}
 }
 
-void print_fake(void)
+void print_fake(FILE *out)
 {
-	printf("INFO: use_o_direct=%d\n", use_o_direct);
-	printf("INFO: use_o_sync=%d\n", use_o_sync);
-	printf("INFO: fill_random=%d\n", fill_random);
-	printf("INFO: ahead_limit=%lu.%09lu\n", ahead_limit.tv_sec, ahead_limit.tv_nsec);
-	printf("INFO: simulate_io=%lu.%09lu\n", simulate_io.tv_sec, simulate_io.tv_nsec);
-	printf("INFO: dry_run=%d\n", dry_run);
+	fprintf(out, "INFO: use_o_direct=%d\n", use_o_direct);
+	fprintf(out, "INFO: use_o_sync=%d\n", use_o_sync);
+	fprintf(out, "INFO: fill_random=%d\n", fill_random);
+	fprintf(out, "INFO: ahead_limit=%lu.%09lu\n", ahead_limit.tv_sec, ahead_limit.tv_nsec);
+	fprintf(out, "INFO: simulate_io=%lu.%09lu\n", simulate_io.tv_sec, simulate_io.tv_nsec);
+	if (sim_device)
+		fprintf(out, "INFO: sim_device=%s\n", sim_device);
+	fprintf(out, "INFO: io_backend=%s\n", backend->be_name);
+	fprintf(out, "INFO: dry_run=%d\n", dry_run);
+	if (closed_loop)
+		fprintf(out, "INFO: closed_loop=%d closed_loop_max=%d closed_loop_step=%d\n", closed_loop, closed_loop_max, closed_loop_step);
+	if (precondition)
+		fprintf(out, "INFO: precondition=%s\n", precondition);
+	if (search_mode)
+		fprintf(out, "INFO: search_interval=%d search_percentile=%.3f search_latency=%.6f search_lag=%.6f search_precision=%.6f\n", search_interval, (double)search_percentile, (double)search_latency, (double)search_lag, (double)search_precision);
 
 	if (dry_run || !use_o_direct) {
-		printf("\n"
+		fprintf(out, "\n"
 		       "INFO: measurement results are thus FAKE results!!!\n"
 		       "\n"
 		       );
 	}
+	if (out == stdout)
+		flush_stdout();
+}
+
+static
+void print_header(FILE *out, char *name, time_t *now)
+{
+	/* Notice: the following GNU all-permissive license applies
+	 * to the generated DATA file only, and does not change
+	 * the GPL of this program.
+	 */
+
+	fprintf(out,
+		"Copyright Thomas Schoebel-Theuer /  1&1 Internet AG\n"
+		"\n"
+		"This file was automatically generated by blkreplay\n"
+		"\n"
+		"Copying and distribution of this file, with or without modification,\n"
+		"are permitted in any medium without royalty provided the copyright\n"
+		"notice and this notice are preserved.  This file is offered as-is,\n"
+		"without any warranty.\n"
+		"\n"
+		"\n"
+		"blkreplay on %s started at %s\n"
+		"\n",
+		name,
+		ctime(now));
+}
+
+/* Pair the devices with --output files and --input streams.
+ */
+static
+void devices_init(time_t *now)
+{
+	int i;
+
+	if (output_list.nl_count && output_list.nl_count != device_count) {
+		printf("ERROR: %d --output files for %d devices\n", output_list.nl_count, device_count);
+		do_exit(-1);
+	}
+	if ((device_count > 1 || stripe_chunk || concat_mode) && !output_list.nl_count) {
+		printf("ERROR: please give one --output file per <device>\n");
+		do_exit(-1);
+	}
+	if ((stripe_chunk || concat_mode) && input_list.nl_count > 1 && !consolidate_mode) {
+		printf("ERROR: striping / concatenation needs a single input\n");
+		do_exit(-1);
+	}
+	if (input_list.nl_count > 1 && input_list.nl_count != device_count && !consolidate_mode) {
+		printf("ERROR: %d --input files for %d devices\n", input_list.nl_count, device_count);
+		do_exit(-1);
+	}
+	if (device_count > 1 && verify_mode) {
+		printf("ERROR: verify modes are only possible with a single <device>\n");
+		do_exit(-1);
+	}
+	filter_init();
+	if (offset_list.nl_count > input_list.nl_count ||
+	    shift_list.nl_count > input_list.nl_count ||
+	    speedup_list.nl_count > input_list.nl_count) {
+		printf("ERROR: more --input-* options than --input files\n");
+		do_exit(-1);
+	}
+
+	for (i = 0; i < output_list.nl_count; i++) {
+		struct device *dev = &devices[i];
+
+		dev->dev_output = output_list.nl_names[i];
+		dev->dev_out = fopen(dev->dev_output, "w");
+		if (!dev->dev_out) {
+			printf("ERROR: cannot create output '%s' (%d %s)\n", dev->dev_output, errno, strerror(errno));
+			do_exit(-1);
+		}
+		print_header(dev->dev_out, dev->dev_name, now);
+		print_fake(dev->dev_out);
+		// don't duplicate the buffer contents when forking
+		fflush(dev->dev_out);
+		printf("INFO: device[%d]=%s output=%s\n", i, dev->dev_name, dev->dev_output);
+	}
+
+	if (!input_list.nl_count) {
+		streams[0].st_name = "-";
+		streams[0].st_inp = stdin;
+		streams[0].st_dev = device_count > 1 || stripe_chunk || concat_mode ? -1 : 0;
+		streams[0].st_speedup = 1.0;
+		streams[0].st_record = filter.f_repeat && fseek(stdin, 0, SEEK_CUR) < 0;
+		stream_count = 1;
+	}
+	for (i = 0; i < input_list.nl_count; i++) {
+		struct stream *st = &streams[stream_count++];
+		FLOAT shift = 0.0;
+
+		stream_open(st, input_list.nl_names[i]);
+		if (input_list.nl_count > 1 && !consolidate_mode)
+			st->st_dev = i;
+		else
+			st->st_dev = device_count > 1 || stripe_chunk || concat_mode ? -1 : 0;
+
+		st->st_speedup = 1.0;
+		if (i < offset_list.nl_count)
+			st->st_offset = atoll(offset_list.nl_names[i]);
+		if (i < shift_list.nl_count)
+			shift = atof(shift_list.nl_names[i]);
+		if (i < speedup_list.nl_count)
+			st->st_speedup = atof(speedup_list.nl_names[i]);
+		if (st->st_offset < 0 || shift < 0.0 || st->st_speedup <= 0.0) {
+			printf("ERROR: bad relocation of input '%s'\n", st->st_name);
+			do_exit(-1);
+		}
+		st->st_shift.tv_sec = 1;
+		timespec_multiply(&st->st_shift, shift);
+
+		printf("INFO: input[%d]=%s device=%s offset=%lld shift=%.6f speedup=%.6f\n",
+		       i,
+		       st->st_name,
+		       st->st_dev < 0 ? (stripe_chunk || concat_mode ? "logical" : "all") : devices[st->st_dev].dev_name,
+		       st->st_offset,
+		       (double)shift,
+		       (double)st->st_speedup);
+	}
 	flush_stdout();
 }
 
+static
+void devices_finish(time_t *now)
+{
+	int i;
+
+	for (i = 0; i < device_count; i++) {
+		FILE *out = devices[i].dev_out;
+		if (!out)
+			continue;
+		fprintf(out, "blkreplay on %s ended at %s\n", devices[i].dev_name, ctime(now));
+		fclose(out);
+		devices[i].dev_out = NULL;
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	int max_threads;
@@ -2419,6 +5088,53 @@ int main(int argc, char *argv[])
 	if (verify_mode >= 2)
 		final_verify_mode++;
 
+	if (closed_loop > 0) {
+		if (closed_loop_max < closed_loop)
+			closed_loop_max = closed_loop;
+		if (closed_loop_step < 1)
+			closed_loop_step = 1;
+		if (total_max < closed_loop_max) {
+			printf("INFO: raising threads=%d to closed_loop_max=%d\n", total_max, closed_loop_max);
+			total_max = closed_loop_max;
+		}
+	} else {
+		closed_loop = 0;
+	}
+	if (precondition && (closed_loop || search_mode)) {
+		printf("ERROR: --precondition cannot be combined with --closed-loop or --search-speedup\n");
+		do_exit(-1);
+	}
+	if (dependency_mode) {
+		if (closed_loop || search_mode || precondition) {
+			printf("ERROR: --dependency-replay cannot be combined with --closed-loop, --search-speedup or --precondition\n");
+			do_exit(-1);
+		}
+		if (conflict_mode != 3) {
+			printf("INFO: --dependency-replay implies --with-ordering\n");
+			conflict_mode = 3;
+		}
+		if (dependency_gap < 0.0)
+			dependency_gap = 0.0;
+	}
+	if (stripe_chunk < 0)
+		stripe_chunk = 0;
+	if (stripe_chunk && concat_mode) {
+		printf("ERROR: --stripe and --concat are mutually exclusive\n");
+		do_exit(-1);
+	}
+	if (search_mode) {
+		if (closed_loop) {
+			printf("ERROR: --search-speedup cannot be combined with --closed-loop\n");
+			do_exit(-1);
+		}
+		if (search_interval < 1)
+			search_interval = 1;
+		if (search_percentile <= 0.0 || search_percentile > 100.0)
+			search_percentile = 99.0;
+		if (search_precision <= 0.0)
+			search_precision = 0.02;
+	}
+
 	max_threads = MAX_THREADS;
 	if (conflict_mode == 2)
 		max_threads /= 2;
@@ -2426,6 +5142,10 @@ int main(int argc, char *argv[])
 		total_max = max_threads;
 	if (total_max < 1)
 		total_max = 1;
+	if (closed_loop_max > total_max)
+		closed_loop_max = total_max;
+	if (closed_loop > closed_loop_max)
+		closed_loop = closed_loop_max;
 	table_max = total_max;
 	if (conflict_mode == 2)
 		table_max *= 2;
@@ -2441,10 +5161,7 @@ int main(int argc, char *argv[])
 	if (replay_duration > 0)
 		replay_end = replay_start + replay_duration;
 
-	if (fake_io)
-		dry_run = 1;
-	if (simulate_io.tv_sec || simulate_io.tv_nsec)
-		dry_run = 1;
+	backend_init();
 
 	if (ahead_limit.tv_sec <= 0 && ahead_limit.tv_nsec <= 0)
 		ahead_limit.tv_sec = 1;
@@ -2452,36 +5169,26 @@ int main(int argc, char *argv[])
 	if (time_factor != 0.0) {
 		time_stretch = 1.0 / time_factor;
 
-		/* Notice: the following GNU all-permissive license applies
-		 * to the generated DATA file only, and does not change
-		 * the GPL of this program.
-		 */
-
-		printf(
-			"Copyright Thomas Schoebel-Theuer /  1&1 Internet AG\n"
-			"\n"
-			"This file was automatically generated by blkreplay\n"
-			"\n"
-			"Copying and distribution of this file, with or without modification,\n"
-			"are permitted in any medium without royalty provided the copyright\n"
-			"notice and this notice are preserved.  This file is offered as-is,\n"
-			"without any warranty.\n"
-			"\n"
-			"\n"
-			"blkreplay on %s started at %s\n"
-			"\n",
-			main_name,
-			ctime(&now));
+		print_header(stdout, main_name, &now);
 		flush_stdout();
 
-		print_fake();
+		print_fake(stdout);
 
-		parse(stdin);
+		devices_init(&now);
+
+		if (backend == &backends[BACKEND_MODEL])
+			sim_init();
+
+		placement_init();
+
+		parse();
 
 		printf("blkreplay on %s ended at %s\n",
 		       main_name,
 		       ctime(&now));
 		flush_stdout();
+
+		devices_finish(&now);
 	}
 
 	// verify the end result
@@ -2495,7 +5202,7 @@ int main(int argc, char *argv[])
 		check_all_tags();
 	}
 
-	print_fake();
+	print_fake(stdout);
 
 	do_exit(0);
 	return 0;
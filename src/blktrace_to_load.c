@@ -0,0 +1,578 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Native replacement for the blkparse(1) pipeline of
+ * scripts/conv_blktrace_to_load.sh.
+ *
+ * Reads the per-cpu binary files <prefix>.blktrace.N written by
+ * blktrace(8) directly, and produces exactly the same .load format
+ * as the script, in a single streaming pass.
+ *
+ * Each per-cpu file is decoded by a separate child process which
+ * filters the events and sends compact records through a pipe.
+ * The parent merges them by timestamp. Thus decoding runs on
+ * multiple cores, while the output remains globally sorted.
+ *
+ * Usage: blktrace_to_load.exe [--action=<char>] [--header=<file>]
+ *                             <prefix> [<output>]
+ *
+ * The copyright header is supplied by the calling script via --header.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_CPUS 4096
+#define BUF_SIZE (1024 * 1024)
+
+/////////////////////////////////////////////////////////////////
+
+// binary blktrace format, see <linux/blktrace_api.h>
+
+#define BLK_IO_TRACE_MAGIC	0x65617400
+#define BLK_IO_TRACE_VERSION	0x07
+
+#define BLK_TC_SHIFT		16
+#define BLK_TC_ACT(act)		((act) << BLK_TC_SHIFT)
+
+#define BLK_TC_WRITE		(1 << 1)
+#define BLK_TC_FLUSH		(1 << 2)
+#define BLK_TC_NOTIFY		(1 << 10)
+#define BLK_TC_DISCARD		(1 << 13)
+
+#define __BLK_TA_QUEUE		1
+#define __BLK_TA_GETRQ		4
+#define __BLK_TA_ISSUE		7
+#define __BLK_TA_COMPLETE	8
+#define __BLK_TA_INSERT		12
+
+struct blk_io_trace {
+	unsigned int magic;
+	unsigned int sequence;
+	unsigned long long time;
+	unsigned long long sector;
+	unsigned int bytes;
+	unsigned int action;
+	unsigned int pid;
+	unsigned int device;
+	unsigned int cpu;
+	unsigned short error;
+	unsigned short pdu_len;
+};
+
+// compact record sent from the decoders to the merger
+struct event {
+	unsigned long long ev_time;
+	unsigned long long ev_sector;
+	unsigned int ev_sequence;
+	unsigned int ev_sectors;
+	char ev_op;
+};
+
+// candidates for the starting points, in the order the script
+// would prefer them when the counts are equal
+static const char action_chars[] = "QIGD";
+
+char *prefix = NULL;
+char *output = NULL;
+char *header_file = NULL;
+char action_char = 0;
+int cpu_count = 0;
+int cpu_nr[MAX_CPUS];
+
+char *header = NULL;
+size_t header_len = 0;
+
+/////////////////////////////////////////////////////////////////
+
+// decoding of a single per-cpu file
+
+struct trace_file {
+	FILE *tf_inp;
+	int tf_swap;
+	int tf_checked;
+};
+
+static
+unsigned short swap16(unsigned short x)
+{
+	return (x >> 8) | (x << 8);
+}
+
+static
+unsigned int swap32(unsigned int x)
+{
+	return __builtin_bswap32(x);
+}
+
+static
+unsigned long long swap64(unsigned long long x)
+{
+	return __builtin_bswap64(x);
+}
+
+static
+void trace_open(struct trace_file *tf, int cpu)
+{
+	char name[4096];
+
+	snprintf(name, sizeof(name), "%s.blktrace.%d", prefix, cpu);
+	tf->tf_inp = fopen(name, "r");
+	if (!tf->tf_inp) {
+		printf("FATAL ERROR: cannot open '%s' (errno=%d)\n", name, errno);
+		exit(-1);
+	}
+	setvbuf(tf->tf_inp, NULL, _IOFBF, BUF_SIZE);
+	tf->tf_swap = 0;
+	tf->tf_checked = 0;
+}
+
+static
+int trace_read(struct trace_file *tf, struct blk_io_trace *t)
+{
+	char skip[4096];
+	int len;
+
+	if (fread(t, sizeof(*t), 1, tf->tf_inp) != 1)
+		return 0;
+
+	if (!tf->tf_checked) {
+		if ((t->magic & 0xffffff00) != BLK_IO_TRACE_MAGIC) {
+			if ((swap32(t->magic) & 0xffffff00) != BLK_IO_TRACE_MAGIC) {
+				printf("FATAL ERROR: bad magic 0x%08x, this is no blktrace file\n", t->magic);
+				exit(-1);
+			}
+			tf->tf_swap = 1;
+		}
+		tf->tf_checked = 1;
+	}
+	if (tf->tf_swap) {
+		t->magic = swap32(t->magic);
+		t->sequence = swap32(t->sequence);
+		t->time = swap64(t->time);
+		t->sector = swap64(t->sector);
+		t->bytes = swap32(t->bytes);
+		t->action = swap32(t->action);
+		t->pid = swap32(t->pid);
+		t->device = swap32(t->device);
+		t->cpu = swap32(t->cpu);
+		t->error = swap16(t->error);
+		t->pdu_len = swap16(t->pdu_len);
+	}
+	if ((t->magic & 0xffffff00) != BLK_IO_TRACE_MAGIC) {
+		printf("FATAL ERROR: lost synchronization (magic 0x%08x)\n", t->magic);
+		exit(-1);
+	}
+	if ((t->magic & 0xff) != BLK_IO_TRACE_VERSION) {
+		printf("FATAL ERROR: unsupported blktrace version %d\n", t->magic & 0xff);
+		exit(-1);
+	}
+
+	// skip the payload (process names, SCSI commands, messages...)
+	for (len = t->pdu_len; len > 0; ) {
+		int chunk = len < sizeof(skip) ? len : sizeof(skip);
+		if (fread(skip, chunk, 1, tf->tf_inp) != 1)
+			return 0;
+		len -= chunk;
+	}
+	return 1;
+}
+
+static
+char trace_action(struct blk_io_trace *t)
+{
+	switch (t->action & 0xffff) {
+	case __BLK_TA_QUEUE:
+		return 'Q';
+	case __BLK_TA_GETRQ:
+		return 'G';
+	case __BLK_TA_INSERT:
+		return 'I';
+	case __BLK_TA_ISSUE:
+		return 'D';
+	case __BLK_TA_COMPLETE:
+		return 'C';
+	}
+	return 0;
+}
+
+/* Same classification as the RWBS field of blkparse, reduced to
+ * what the script keeps: flushes, discards and requests without
+ * data are dropped.
+ */
+static
+char trace_op(struct blk_io_trace *t)
+{
+	if (t->action & BLK_TC_ACT(BLK_TC_FLUSH))
+		return 0;
+	if (t->action & BLK_TC_ACT(BLK_TC_DISCARD))
+		return 0;
+	if (t->action & BLK_TC_ACT(BLK_TC_WRITE))
+		return 'W';
+	if (t->bytes)
+		return 'R';
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// decoder processes
+
+static
+pid_t decoder_start(int cpu, FILE **pipe_inp, void (*fn)(struct trace_file *tf, FILE *out))
+{
+	struct trace_file tf;
+	FILE *out;
+	int fd[2];
+	pid_t pid;
+
+	if (pipe(fd) < 0) {
+		printf("FATAL ERROR: cannot create pipe (errno=%d)\n", errno);
+		exit(-1);
+	}
+	fflush(NULL);
+	pid = fork();
+	if (pid < 0) {
+		printf("FATAL ERROR: cannot fork (errno=%d)\n", errno);
+		exit(-1);
+	}
+	if (pid) {
+		close(fd[1]);
+		*pipe_inp = fdopen(fd[0], "r");
+		return pid;
+	}
+
+	close(fd[0]);
+	out = fdopen(fd[1], "w");
+	setvbuf(out, NULL, _IOFBF, BUF_SIZE);
+	trace_open(&tf, cpu);
+	fn(&tf, out);
+	if (fclose(out) < 0)
+		exit(-1);
+	exit(0);
+}
+
+static
+void decoder_wait(pid_t pid)
+{
+	int status = 0;
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+		printf("FATAL ERROR: decoder process %d failed\n", pid);
+		exit(-1);
+	}
+}
+
+static
+void count_actions(struct trace_file *tf, FILE *out)
+{
+	struct blk_io_trace t;
+	long long count[sizeof(action_chars)] = {};
+
+	while (trace_read(tf, &t)) {
+		char *pos;
+		char c;
+
+		if (t.action & BLK_TC_ACT(BLK_TC_NOTIFY))
+			continue;
+		c = trace_action(&t);
+		if (!c)
+			continue;
+		pos = strchr(action_chars, c);
+		if (pos)
+			count[pos - action_chars]++;
+	}
+	fwrite(count, sizeof(count), 1, out);
+}
+
+static
+void filter_events(struct trace_file *tf, FILE *out)
+{
+	struct blk_io_trace t;
+	struct event ev;
+	int first = 1;
+
+	while (trace_read(tf, &t)) {
+		if (t.action & BLK_TC_ACT(BLK_TC_NOTIFY))
+			continue;
+		// the first record only carries the genesis time of this cpu
+		if (first) {
+			memset(&ev, 0, sizeof(ev));
+			ev.ev_time = t.time;
+			fwrite(&ev, sizeof(ev), 1, out);
+			first = 0;
+		}
+		if (trace_action(&t) != action_char)
+			continue;
+		ev.ev_op = trace_op(&t);
+		if (!ev.ev_op)
+			continue;
+		ev.ev_time = t.time;
+		ev.ev_sector = t.sector;
+		ev.ev_sequence = t.sequence;
+		ev.ev_sectors = t.bytes >> 9;
+		fwrite(&ev, sizeof(ev), 1, out);
+	}
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main conversion
+
+static
+void compute_action_char(void)
+{
+	FILE *inp[MAX_CPUS];
+	pid_t pid[MAX_CPUS];
+	long long total[sizeof(action_chars)] = {};
+	int i;
+	int j;
+
+	fprintf(stderr, "Computing $action_char ...\n");
+	for (i = 0; i < cpu_count; i++) {
+		pid[i] = decoder_start(cpu_nr[i], &inp[i], count_actions);
+	}
+	for (i = 0; i < cpu_count; i++) {
+		long long count[sizeof(action_chars)];
+		if (fread(count, sizeof(count), 1, inp[i]) != 1) {
+			printf("FATAL ERROR: cannot read statistics for cpu %d\n", cpu_nr[i]);
+			exit(-1);
+		}
+		for (j = 0; j < sizeof(action_chars) - 1; j++)
+			total[j] += count[j];
+		fclose(inp[i]);
+		decoder_wait(pid[i]);
+	}
+
+	fprintf(stderr, "Statistics:\n");
+	for (i = 0; i < sizeof(action_chars) - 1; i++) {
+		int best = -1;
+		for (j = 0; j < sizeof(action_chars) - 1; j++) {
+			if (total[j] >= 0 && (best < 0 || total[j] > total[best]))
+				best = j;
+		}
+		if (!total[best])
+			break;
+		fprintf(stderr, "%c:%lld\n", action_chars[best], total[best]);
+		if (!action_char)
+			action_char = action_chars[best];
+		total[best] = -1;
+	}
+
+	if (!action_char) {
+		fprintf(stderr, "Sorry, cannot determine the right action character.\n"
+			"In case absolutely nothing else is available for determining\n"
+			"the starting points, try the completion points by setting\n"
+			"--action=C as a last resort. But check the output\n"
+			"for plausibility then...\n");
+		exit(-1);
+	}
+}
+
+static
+void read_header(void)
+{
+	FILE *f;
+	size_t alloc = 0;
+	size_t len;
+	char chunk[4096];
+
+	if (!header_file) {
+		header = "";
+		return;
+	}
+	f = fopen(header_file, "r");
+	if (!f) {
+		printf("FATAL ERROR: cannot open header file '%s'\n", header_file);
+		exit(-1);
+	}
+	while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+		if (header_len + len > alloc) {
+			alloc = (header_len + len) * 2;
+			header = realloc(header, alloc);
+			if (!header) {
+				printf("FATAL ERROR: out of memory\n");
+				exit(-1);
+			}
+		}
+		memcpy(header + header_len, chunk, len);
+		header_len += len;
+	}
+	fclose(f);
+}
+
+static
+long long convert(FILE *out)
+{
+	FILE *inp[MAX_CPUS];
+	pid_t pid[MAX_CPUS];
+	struct event head[MAX_CPUS];
+	int valid[MAX_CPUS];
+	unsigned long long genesis = 0;
+	int have_genesis = 0;
+	long long count = 0;
+	int i;
+
+	for (i = 0; i < cpu_count; i++) {
+		pid[i] = decoder_start(cpu_nr[i], &inp[i], filter_events);
+	}
+
+	// the genesis is the earliest trace of any cpu, as in blkparse
+	for (i = 0; i < cpu_count; i++) {
+		valid[i] = fread(&head[i], sizeof(struct event), 1, inp[i]) == 1;
+		if (!valid[i])
+			continue;
+		if (!have_genesis || head[i].ev_time < genesis)
+			genesis = head[i].ev_time;
+		have_genesis = 1;
+		valid[i] = fread(&head[i], sizeof(struct event), 1, inp[i]) == 1;
+	}
+
+	fwrite(header, 1, header_len, out);
+	fprintf(out, "INFO: action_char=%c\n", action_char);
+	fprintf(out, "start ; sector; length ; op ;  replay_delay=0 ; replay_duration=0\n");
+
+	for (;;) {
+		struct event *ev;
+		unsigned long long rel;
+		int best = -1;
+
+		for (i = 0; i < cpu_count; i++) {
+			if (!valid[i])
+				continue;
+			if (best < 0 ||
+			    head[i].ev_time < head[best].ev_time ||
+			    (head[i].ev_time == head[best].ev_time && head[i].ev_sequence < head[best].ev_sequence))
+				best = i;
+		}
+		if (best < 0)
+			break;
+
+		ev = &head[best];
+		rel = ev->ev_time - genesis;
+		fprintf(out, " %6llu.%09llu ; %12llu ; %4u ; %c ; 0.0 ; 0.0\n",
+			rel / 1000000000, rel % 1000000000,
+			ev->ev_sector, ev->ev_sectors, ev->ev_op);
+		count++;
+
+		valid[best] = fread(&head[best], sizeof(struct event), 1, inp[best]) == 1;
+	}
+
+	for (i = 0; i < cpu_count; i++) {
+		fclose(inp[i]);
+		decoder_wait(pid[i]);
+	}
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	struct stat st;
+	char name[4096];
+	FILE *out;
+	long long count;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strncmp(argv[i], "--action=", 9) && argv[i][9]) {
+			action_char = argv[i][9];
+		} else if (!strncmp(argv[i], "--header=", 9)) {
+			header_file = argv[i] + 9;
+		} else if (argv[i][0] == '-' && argv[i][1]) {
+			printf("ERROR: unknown option '%s'\n", argv[i]);
+			exit(-1);
+		} else if (!prefix) {
+			prefix = argv[i];
+		} else if (!output) {
+			output = argv[i];
+		} else {
+			printf("ERROR: too many arguments\n");
+			exit(-1);
+		}
+	}
+	if (!prefix) {
+		printf("usage: %s [--action=<char>] [--header=<file>] <prefix> [<output>]\n", argv[0]);
+		exit(-1);
+	}
+	read_header();
+	if (!output) {
+		char *base = strrchr(prefix, '/');
+		snprintf(name, sizeof(name), "%s.load.gz", base ? base + 1 : prefix);
+		output = name;
+	}
+
+	// per-cpu files may have gaps when cpus were offline
+	for (i = 0; i < MAX_CPUS; i++) {
+		char file[4096];
+		snprintf(file, sizeof(file), "%s.blktrace.%d", prefix, i);
+		if (!stat(file, &st))
+			cpu_nr[cpu_count++] = i;
+	}
+	if (!cpu_count || cpu_nr[0]) {
+		printf("Input file '%s.blktrace.0' does not exist\n", prefix);
+		exit(-1);
+	}
+
+	if (!action_char)
+		compute_action_char();
+	fprintf(stderr, "Using action_char='%c'\n", action_char);
+	fprintf(stderr, "Starting main conversion to '%s'...\n", output);
+
+	if (!strcmp(output, "-")) {
+		out = stdout;
+	} else if (strlen(output) > 3 && !strcmp(output + strlen(output) - 3, ".gz")) {
+		char cmd[8192];
+		snprintf(cmd, sizeof(cmd), "gzip -9 > '%s'", output);
+		out = popen(cmd, "w");
+	} else {
+		out = fopen(output, "w");
+	}
+	if (!out) {
+		printf("FATAL ERROR: cannot create '%s' (errno=%d)\n", output, errno);
+		exit(-1);
+	}
+	setvbuf(out, NULL, _IOFBF, BUF_SIZE);
+
+	count = convert(out);
+
+	if (out == stdout) {
+		fflush(out);
+	} else if (strlen(output) > 3 && !strcmp(output + strlen(output) - 3, ".gz")) {
+		if (pclose(out)) {
+			printf("FATAL ERROR: gzip failed\n");
+			exit(-1);
+		}
+	} else if (fclose(out) < 0) {
+		printf("FATAL ERROR: cannot write '%s' (errno=%d)\n", output, errno);
+		exit(-1);
+	}
+
+	fprintf(stderr, "INFO: converted %lld requests\n", count);
+	fprintf(stderr, "Done. Please consider renaming the output file to something better.\n");
+	return 0;
+}
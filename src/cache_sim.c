@@ -0,0 +1,887 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Static cache analysis of a .load / .replay file.
+ *
+ * The miss-ratio curve is computed from the exact LRU reuse distances
+ * of all cache blocks (Olken's algorithm, using a Fenwick tree over
+ * the access times). With --sample=<rate>, only a spatially sampled
+ * subset of the blocks is considered (selected by a hash of the block
+ * number), and the distances are scaled accordingly. This is much
+ * faster and needs much less memory, at the price of some accuracy.
+ *
+ * In addition, LRU and ARC caches of the given sizes can be simulated,
+ * with write-back, write-through or write-around handling of writes.
+ *
+ * Usage: zcat -f *.load.gz | cache_sim.exe [options]
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define MAX_SIZES 64
+#define SAMPLE_BITS 24
+
+enum {
+	POLICY_LRU,
+	POLICY_ARC,
+	POLICY_MAX,
+};
+
+const char *policy_names[POLICY_MAX] = {
+	"lru",
+	"arc",
+};
+
+enum {
+	WRITE_BACK,
+	WRITE_THROUGH,
+	WRITE_AROUND,
+	WRITE_MAX,
+};
+
+const char *write_names[WRITE_MAX] = {
+	"back",
+	"through",
+	"around",
+};
+
+// one request, covering a range of cache blocks
+struct access {
+	unsigned long long a_block;
+	unsigned int a_count;
+	char a_write;
+};
+
+struct access *accesses = NULL;
+long long access_count = 0;
+long long access_alloc = 0;
+long long block_accesses = 0;
+
+long long block_size = 8; // sectors
+double sample_rate = 1.0;
+unsigned long long sample_limit = 1ULL << SAMPLE_BITS;
+char *mrc_file = NULL;
+long long sizes[MAX_SIZES]; // in blocks
+int size_count = 0;
+int use_policy[POLICY_MAX] = { 1, 1 };
+int write_policy = WRITE_BACK;
+int thread_count = 0;
+
+unsigned long long mrc_distinct = 0;
+double mrc_cold_ratio = 0.0;
+
+static
+void *xrealloc(void *ptr, size_t size)
+{
+	void *res = realloc(ptr, size);
+
+	if (!res && size) {
+		printf("FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	return res;
+}
+
+static
+unsigned long long hash_block(unsigned long long block)
+{
+	block ^= block >> 33;
+	block *= 0xff51afd7ed558ccdULL;
+	block ^= block >> 33;
+	block *= 0xc4ceb9fe1a85ec53ULL;
+	block ^= block >> 33;
+	return block;
+}
+
+static
+int is_sampled(unsigned long long block)
+{
+	return (hash_block(block) & ((1ULL << SAMPLE_BITS) - 1)) < sample_limit;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// block -> value map, open addressing with backward shift deletion
+
+struct map {
+	unsigned long long *m_key; // key + 1, 0 means empty
+	long long *m_val;
+	size_t m_size;
+	size_t m_count;
+};
+
+static
+size_t map_pos(struct map *m, unsigned long long key)
+{
+	return (size_t)(hash_block(key) & (m->m_size - 1));
+}
+
+static
+long long *map_get(struct map *m, unsigned long long key, int create)
+{
+	size_t pos;
+
+	if (create && m->m_count * 2 >= m->m_size) {
+		struct map new = {};
+		size_t i;
+
+		new.m_size = m->m_size ? m->m_size * 2 : 1024;
+		new.m_key = calloc(new.m_size, sizeof(unsigned long long));
+		new.m_val = calloc(new.m_size, sizeof(long long));
+		if (!new.m_key || !new.m_val) {
+			printf("FATAL ERROR: out of memory\n");
+			exit(-1);
+		}
+		for (i = 0; i < m->m_size; i++) {
+			if (m->m_key[i])
+				*map_get(&new, m->m_key[i] - 1, 1) = m->m_val[i];
+		}
+		free(m->m_key);
+		free(m->m_val);
+		*m = new;
+	}
+	if (!m->m_size)
+		return NULL;
+
+	pos = map_pos(m, key);
+	while (m->m_key[pos] && m->m_key[pos] != key + 1)
+		pos = (pos + 1) & (m->m_size - 1);
+	if (!m->m_key[pos]) {
+		if (!create)
+			return NULL;
+		m->m_key[pos] = key + 1;
+		m->m_val[pos] = -1;
+		m->m_count++;
+	}
+	return &m->m_val[pos];
+}
+
+static
+void map_del(struct map *m, unsigned long long key)
+{
+	size_t pos;
+	size_t next;
+
+	if (!m->m_size)
+		return;
+	pos = map_pos(m, key);
+	while (m->m_key[pos] && m->m_key[pos] != key + 1)
+		pos = (pos + 1) & (m->m_size - 1);
+	if (!m->m_key[pos])
+		return;
+	m->m_count--;
+	// move back all following entries which would become unreachable
+	for (next = (pos + 1) & (m->m_size - 1); m->m_key[next]; next = (next + 1) & (m->m_size - 1)) {
+		size_t home = map_pos(m, m->m_key[next] - 1);
+		if (((next - home) & (m->m_size - 1)) >= ((next - pos) & (m->m_size - 1))) {
+			m->m_key[pos] = m->m_key[next];
+			m->m_val[pos] = m->m_val[next];
+			pos = next;
+		}
+	}
+	m->m_key[pos] = 0;
+}
+
+static
+void map_free(struct map *m)
+{
+	free(m->m_key);
+	free(m->m_val);
+	memset(m, 0, sizeof(*m));
+}
+
+/////////////////////////////////////////////////////////////////
+
+// input
+
+static
+void read_input(FILE *inp)
+{
+	char line[4096];
+	long long count_lines = 0;
+	long long count_ignored = 0;
+
+	while (fgets(line, sizeof(line), inp)) {
+		unsigned long long sector;
+		unsigned int length;
+		char op;
+		unsigned long long first;
+		unsigned long long last;
+		unsigned long long block;
+
+		if (!strchr(line, ';') || strstr(line, "replay_"))
+			continue;
+		count_lines++;
+		if (sscanf(line, "%*f ; %llu ; %u ; %c", &sector, &length, &op) != 3 || !length) {
+			count_ignored++;
+			continue;
+		}
+		op = toupper(op);
+		if (op != 'R' && op != 'W') {
+			count_ignored++;
+			continue;
+		}
+
+		first = sector / block_size;
+		last = (sector + length - 1) / block_size;
+		for (block = first; block <= last; block++) {
+			unsigned long long end = block;
+			if (!is_sampled(block))
+				continue;
+			// merge runs of sampled blocks into one access
+			while (end + 1 <= last && is_sampled(end + 1))
+				end++;
+			if (access_count >= access_alloc) {
+				access_alloc = access_alloc ? access_alloc * 2 : 65536;
+				accesses = xrealloc(accesses, sizeof(struct access) * access_alloc);
+			}
+			accesses[access_count].a_block = block;
+			accesses[access_count].a_count = end - block + 1;
+			accesses[access_count].a_write = (op == 'W');
+			access_count++;
+			block_accesses += end - block + 1;
+			block = end;
+		}
+	}
+	if (count_ignored)
+		printf("WARN: ignored %lld of %lld input lines\n", count_ignored, count_lines);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// miss-ratio curve from the LRU reuse distances
+
+static
+void fenwick_add(int *tree, long long size, long long pos, int delta)
+{
+	for (pos++; pos <= size; pos += pos & -pos)
+		tree[pos] += delta;
+}
+
+static
+long long fenwick_sum(int *tree, long long pos)
+{
+	long long sum = 0;
+
+	for (pos++; pos > 0; pos -= pos & -pos)
+		sum += tree[pos];
+	return sum;
+}
+
+static
+void task_mrc(void)
+{
+	struct map last_time = {};
+	int *tree = calloc(block_accesses + 2, sizeof(int));
+	// distance histograms of all accesses, and of reads only
+	long long *hist[2] = {};
+	long long hist_alloc = 0;
+	long long cold[2] = {};
+	long long total[2] = {};
+	long long hits[2];
+	long long max_dist = 0;
+	long long dist;
+	long long now = 0;
+	long long i;
+	FILE *out = stdout;
+	double step;
+	double size;
+
+	if (!tree) {
+		printf("FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+
+	for (i = 0; i < access_count; i++) {
+		struct access *acc = &accesses[i];
+		unsigned int j;
+
+		for (j = 0; j < acc->a_count; j++, now++) {
+			long long *prev = map_get(&last_time, acc->a_block + j, 1);
+
+			total[0]++;
+			if (!acc->a_write)
+				total[1]++;
+			if (*prev < 0) {
+				cold[0]++;
+				if (!acc->a_write)
+					cold[1]++;
+			} else {
+				dist = fenwick_sum(tree, now - 1) - fenwick_sum(tree, *prev);
+				if (dist >= hist_alloc) {
+					long long new_alloc = hist_alloc ? hist_alloc : 1024;
+					while (new_alloc <= dist)
+						new_alloc *= 2;
+					int k;
+					for (k = 0; k < 2; k++) {
+						hist[k] = xrealloc(hist[k], sizeof(long long) * new_alloc);
+						memset(hist[k] + hist_alloc, 0, sizeof(long long) * (new_alloc - hist_alloc));
+					}
+					hist_alloc = new_alloc;
+				}
+				hist[0][dist]++;
+				if (!acc->a_write)
+					hist[1][dist]++;
+				if (dist > max_dist)
+					max_dist = dist;
+				fenwick_add(tree, block_accesses + 1, *prev, -1);
+			}
+			fenwick_add(tree, block_accesses + 1, now, 1);
+			*prev = now;
+		}
+	}
+	mrc_distinct = last_time.m_count / sample_rate;
+	mrc_cold_ratio = total[0] ? (double)cold[0] / total[0] : 0.0;
+	map_free(&last_time);
+	free(tree);
+
+	if (strcmp(mrc_file, "-")) {
+		out = fopen(mrc_file, "w");
+		if (!out) {
+			printf("ERROR: cannot create '%s'\n", mrc_file);
+			exit(-1);
+		}
+	}
+
+	/* A LRU cache of size C hits exactly the accesses with
+	 * a reuse distance below C. Print 4 points per power of 2,
+	 * with the cache size in MiB.
+	 */
+	hits[0] = 0;
+	hits[1] = 0;
+	dist = 0;
+	step = 1.189207115; // 2^(1/4)
+	for (size = 1.0; ; size *= step) {
+		long long limit = size * sample_rate;
+
+		for (; dist < limit && dist < hist_alloc; dist++) {
+			hits[0] += hist[0][dist];
+			hits[1] += hist[1][dist];
+		}
+		fprintf(out, "%14.3f %9.6f %9.6f\n",
+			size * block_size * 512.0 / (1024.0 * 1024.0),
+			total[0] ? (double)(total[0] - hits[0]) / total[0] : 0.0,
+			total[1] ? (double)(total[1] - hits[1]) / total[1] : 0.0);
+		if (limit > max_dist)
+			break;
+	}
+	if (out != stdout)
+		fclose(out);
+	free(hist[0]);
+	free(hist[1]);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// cache simulation
+
+enum {
+	LIST_NONE,
+	LIST_T1, // cached, seen once (the only list for LRU)
+	LIST_T2, // cached, seen at least twice
+	LIST_B1, // ghosts evicted from T1
+	LIST_B2, // ghosts evicted from T2
+	LIST_MAX,
+};
+
+struct node {
+	unsigned long long n_block;
+	long long n_prev;
+	long long n_next;
+	char n_list;
+	char n_dirty;
+};
+
+struct list {
+	long long l_head; // MRU
+	long long l_tail; // LRU
+	long long l_count;
+};
+
+struct cache {
+	int c_policy;
+	long long c_size;
+	long long c_target; // ARC: target size of T1
+	struct map c_map;
+	struct node *c_nodes;
+	long long c_alloc;
+	long long c_used;
+	long long c_free;
+	struct list c_list[LIST_MAX];
+	// statistics, in blocks
+	long long c_reads;
+	long long c_read_hits;
+	long long c_writes;
+	long long c_write_hits;
+	long long c_dev_reads;
+	long long c_dev_writes;
+	long long c_dirty_end;
+};
+
+static
+void list_remove(struct cache *c, long long nr)
+{
+	struct node *n = &c->c_nodes[nr];
+	struct list *l = &c->c_list[(int)n->n_list];
+
+	if (n->n_prev >= 0)
+		c->c_nodes[n->n_prev].n_next = n->n_next;
+	else
+		l->l_head = n->n_next;
+	if (n->n_next >= 0)
+		c->c_nodes[n->n_next].n_prev = n->n_prev;
+	else
+		l->l_tail = n->n_prev;
+	l->l_count--;
+	n->n_list = LIST_NONE;
+}
+
+static
+void list_push(struct cache *c, long long nr, int list)
+{
+	struct node *n = &c->c_nodes[nr];
+	struct list *l = &c->c_list[list];
+
+	n->n_list = list;
+	n->n_prev = -1;
+	n->n_next = l->l_head;
+	if (l->l_head >= 0)
+		c->c_nodes[l->l_head].n_prev = nr;
+	else
+		l->l_tail = nr;
+	l->l_head = nr;
+	l->l_count++;
+}
+
+static
+void list_move(struct cache *c, long long nr, int list)
+{
+	list_remove(c, nr);
+	list_push(c, nr, list);
+}
+
+static
+long long node_alloc(struct cache *c, unsigned long long block)
+{
+	long long nr;
+
+	if (c->c_free >= 0) {
+		nr = c->c_free;
+		c->c_free = c->c_nodes[nr].n_next;
+	} else {
+		if (c->c_used >= c->c_alloc) {
+			c->c_alloc = c->c_alloc ? c->c_alloc * 2 : 1024;
+			c->c_nodes = xrealloc(c->c_nodes, sizeof(struct node) * c->c_alloc);
+		}
+		nr = c->c_used++;
+	}
+	c->c_nodes[nr].n_block = block;
+	c->c_nodes[nr].n_list = LIST_NONE;
+	c->c_nodes[nr].n_dirty = 0;
+	*map_get(&c->c_map, block, 1) = nr;
+	return nr;
+}
+
+static
+void node_free(struct cache *c, long long nr)
+{
+	if (c->c_nodes[nr].n_list != LIST_NONE)
+		list_remove(c, nr);
+	map_del(&c->c_map, c->c_nodes[nr].n_block);
+	c->c_nodes[nr].n_next = c->c_free;
+	c->c_free = nr;
+}
+
+/* Drop a block from the cache, either entirely or into a ghost list.
+ */
+static
+void evict(struct cache *c, long long nr, int ghost_list)
+{
+	if (c->c_nodes[nr].n_dirty) {
+		c->c_dev_writes++;
+		c->c_nodes[nr].n_dirty = 0;
+	}
+	if (ghost_list != LIST_NONE)
+		list_move(c, nr, ghost_list);
+	else
+		node_free(c, nr);
+}
+
+// ARC: make room in T1 + T2
+static
+void arc_replace(struct cache *c, int in_b2)
+{
+	long long t1 = c->c_list[LIST_T1].l_count;
+
+	if (t1 > 0 && (t1 > c->c_target || (in_b2 && t1 == c->c_target)))
+		evict(c, c->c_list[LIST_T1].l_tail, LIST_B1);
+	else if (c->c_list[LIST_T2].l_count > 0)
+		evict(c, c->c_list[LIST_T2].l_tail, LIST_B2);
+}
+
+/* Returns 1 on a hit. A missing block is inserted (clean).
+ */
+static
+int cache_lookup(struct cache *c, unsigned long long block)
+{
+	long long *pos = map_get(&c->c_map, block, 0);
+	long long nr = pos ? *pos : -1;
+	int list = nr >= 0 ? c->c_nodes[nr].n_list : LIST_NONE;
+
+	if (c->c_policy == POLICY_LRU) {
+		if (nr >= 0) {
+			list_move(c, nr, LIST_T1);
+			return 1;
+		}
+		if (c->c_list[LIST_T1].l_count >= c->c_size)
+			evict(c, c->c_list[LIST_T1].l_tail, LIST_NONE);
+		list_push(c, node_alloc(c, block), LIST_T1);
+		return 0;
+	}
+
+	// ARC, see Megiddo/Modha, FAST 2003
+	if (list == LIST_T1 || list == LIST_T2) {
+		list_move(c, nr, LIST_T2);
+		return 1;
+	}
+	if (list == LIST_B1 || list == LIST_B2) {
+		long long b1 = c->c_list[LIST_B1].l_count;
+		long long b2 = c->c_list[LIST_B2].l_count;
+		if (list == LIST_B1) {
+			long long delta = b2 > b1 ? b2 / b1 : 1;
+			c->c_target = c->c_target + delta < c->c_size ? c->c_target + delta : c->c_size;
+		} else {
+			long long delta = b1 > b2 ? b1 / b2 : 1;
+			c->c_target = c->c_target - delta > 0 ? c->c_target - delta : 0;
+		}
+		arc_replace(c, list == LIST_B2);
+		list_move(c, nr, LIST_T2);
+		return 0;
+	}
+	{
+		long long t1 = c->c_list[LIST_T1].l_count;
+		long long l1 = t1 + c->c_list[LIST_B1].l_count;
+		long long all = l1 + c->c_list[LIST_T2].l_count + c->c_list[LIST_B2].l_count;
+		if (l1 >= c->c_size) {
+			if (t1 < c->c_size) {
+				node_free(c, c->c_list[LIST_B1].l_tail);
+				arc_replace(c, 0);
+			} else {
+				evict(c, c->c_list[LIST_T1].l_tail, LIST_NONE);
+			}
+		} else if (all >= c->c_size) {
+			if (all >= 2 * c->c_size)
+				node_free(c, c->c_list[LIST_B2].l_tail);
+			arc_replace(c, 0);
+		}
+	}
+	list_push(c, node_alloc(c, block), LIST_T1);
+	return 0;
+}
+
+static
+void cache_access(struct cache *c, unsigned long long block, int write)
+{
+	long long *pos;
+	int hit;
+
+	if (!write) {
+		c->c_reads++;
+		hit = cache_lookup(c, block);
+		if (hit)
+			c->c_read_hits++;
+		else
+			c->c_dev_reads++;
+		return;
+	}
+
+	c->c_writes++;
+	if (write_policy == WRITE_AROUND) {
+		// only blocks already in the cache are updated
+		pos = map_get(&c->c_map, block, 0);
+		if (pos && c->c_nodes[*pos].n_list != LIST_B1 && c->c_nodes[*pos].n_list != LIST_B2) {
+			cache_lookup(c, block);
+			c->c_write_hits++;
+		}
+		c->c_dev_writes++;
+		return;
+	}
+	hit = cache_lookup(c, block);
+	if (hit)
+		c->c_write_hits++;
+	if (write_policy == WRITE_THROUGH) {
+		c->c_dev_writes++;
+		return;
+	}
+	pos = map_get(&c->c_map, block, 0);
+	c->c_nodes[*pos].n_dirty = 1;
+}
+
+struct task {
+	int t_policy;
+	long long t_size;
+	struct cache *t_result;
+};
+
+struct task tasks[POLICY_MAX * MAX_SIZES + 1];
+int task_count = 0;
+int task_next = 0;
+pthread_mutex_t task_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static
+void run_simulation(struct task *task)
+{
+	struct cache *c = calloc(1, sizeof(struct cache));
+	long long i;
+	int k;
+
+	if (!c) {
+		printf("FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	c->c_policy = task->t_policy;
+	// a sampled trace sees a proportionally smaller cache
+	c->c_size = task->t_size * sample_rate;
+	if (c->c_size < 1)
+		c->c_size = 1;
+	c->c_free = -1;
+	for (k = 0; k < LIST_MAX; k++) {
+		c->c_list[k].l_head = -1;
+		c->c_list[k].l_tail = -1;
+	}
+
+	for (i = 0; i < access_count; i++) {
+		struct access *acc = &accesses[i];
+		unsigned int j;
+
+		for (j = 0; j < acc->a_count; j++)
+			cache_access(c, acc->a_block + j, acc->a_write);
+	}
+	for (k = LIST_T1; k <= LIST_T2; k++) {
+		long long nr;
+		for (nr = c->c_list[k].l_head; nr >= 0; nr = c->c_nodes[nr].n_next)
+			c->c_dirty_end += c->c_nodes[nr].n_dirty;
+	}
+	map_free(&c->c_map);
+	free(c->c_nodes);
+	c->c_nodes = NULL;
+	task->t_result = c;
+}
+
+static
+void *worker(void *arg)
+{
+	for (;;) {
+		struct task *task;
+
+		pthread_mutex_lock(&task_mutex);
+		task = task_next < task_count ? &tasks[task_next++] : NULL;
+		pthread_mutex_unlock(&task_mutex);
+		if (!task)
+			break;
+		if (task->t_policy < 0)
+			task_mrc();
+		else
+			run_simulation(task);
+	}
+	return NULL;
+}
+
+static
+void run_tasks(void)
+{
+	pthread_t threads[256];
+	int count = thread_count;
+	int i;
+
+	if (count > task_count)
+		count = task_count;
+	if (count > 256)
+		count = 256;
+	for (i = 0; i < count; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL)) {
+			printf("FATAL ERROR: cannot create thread\n");
+			exit(-1);
+		}
+	}
+	for (i = 0; i < count; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static
+void print_result(struct task *task)
+{
+	struct cache *c = task->t_result;
+	double scale = 1.0 / sample_rate;
+
+	printf("INFO: policy=%s size=%.3fMiB write=%s"
+	       " reads=%lld read_hit_ratio=%f writes=%lld write_hit_ratio=%f"
+	       " device_reads=%lld device_writes=%lld dirty_at_end=%lld\n",
+	       policy_names[task->t_policy],
+	       task->t_size * block_size / 2048.0,
+	       write_names[write_policy],
+	       (long long)(c->c_reads * scale),
+	       c->c_reads ? (double)c->c_read_hits / c->c_reads : 0.0,
+	       (long long)(c->c_writes * scale),
+	       c->c_writes ? (double)c->c_write_hits / c->c_writes : 0.0,
+	       (long long)(c->c_dev_reads * scale),
+	       (long long)(c->c_dev_writes * scale),
+	       (long long)(c->c_dirty_end * scale));
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+static
+void usage(const char *name)
+{
+	printf("usage: zcat -f <load> | %s [options]\n"
+	       "  --block=<sectors>      cache block size (default 8)\n"
+	       "  --sample=<rate>        spatial sampling rate, 0 < rate <= 1 (default 1 = exact)\n"
+	       "  --mrc=<file>           write the miss-ratio curve to <file> ('-' for stdout)\n"
+	       "  --sizes=<size>,...     simulate these cache sizes (MiB, or with suffix k/m/g/t)\n"
+	       "  --policy=<lru|arc|all> (default all)\n"
+	       "  --write=<back|through|around> handling of writes (default back)\n"
+	       "  --threads=<count>\n",
+	       name);
+	exit(-1);
+}
+
+static
+long long parse_size(const char *str)
+{
+	char *end;
+	double val = strtod(str, &end);
+
+	switch (tolower(*end)) {
+	case 'k':
+		val /= 1024;
+		break;
+	case 'g':
+		val *= 1024;
+		break;
+	case 't':
+		val *= 1024 * 1024;
+		break;
+	}
+	// MiB -> blocks
+	return val * 2048 / block_size;
+}
+
+int main(int argc, char *argv[])
+{
+	char *size_list = NULL;
+	char *tmp_str;
+	int i;
+	int k;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (!strncmp(arg, "--block=", 8)) {
+			block_size = atoll(arg + 8);
+		} else if (!strncmp(arg, "--sample=", 9)) {
+			sample_rate = atof(arg + 9);
+		} else if (!strncmp(arg, "--mrc=", 6)) {
+			mrc_file = arg + 6;
+		} else if (!strncmp(arg, "--sizes=", 8)) {
+			size_list = arg + 8;
+		} else if (!strncmp(arg, "--policy=", 9)) {
+			for (k = 0; k < POLICY_MAX; k++)
+				use_policy[k] = !strcmp(arg + 9, "all") || !strcmp(arg + 9, policy_names[k]);
+			if (!use_policy[POLICY_LRU] && !use_policy[POLICY_ARC]) {
+				printf("ERROR: unknown policy '%s'\n", arg + 9);
+				usage(argv[0]);
+			}
+		} else if (!strncmp(arg, "--write=", 8)) {
+			for (write_policy = 0; write_policy < WRITE_MAX; write_policy++) {
+				if (!strcmp(arg + 8, write_names[write_policy]))
+					break;
+			}
+			if (write_policy >= WRITE_MAX) {
+				printf("ERROR: unknown write policy '%s'\n", arg + 8);
+				usage(argv[0]);
+			}
+		} else if (!strncmp(arg, "--threads=", 10)) {
+			thread_count = atoi(arg + 10);
+		} else {
+			printf("ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		}
+	}
+	if (block_size <= 0 || sample_rate <= 0.0 || sample_rate > 1.0)
+		usage(argv[0]);
+	if (!mrc_file && !size_list)
+		mrc_file = "-";
+	if (thread_count <= 0)
+		thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (thread_count <= 0)
+		thread_count = 1;
+	sample_limit = sample_rate * (1ULL << SAMPLE_BITS);
+
+	if (size_list) {
+		for (tmp_str = strtok(size_list, ","); tmp_str && size_count < MAX_SIZES; tmp_str = strtok(NULL, ",")) {
+			sizes[size_count] = parse_size(tmp_str);
+			if (sizes[size_count] <= 0) {
+				printf("ERROR: bad cache size '%s'\n", tmp_str);
+				exit(-1);
+			}
+			size_count++;
+		}
+	}
+
+	read_input(stdin);
+	printf("INFO: block_size=%lld sample_rate=%f requests=%lld block_accesses=%lld\n", block_size, sample_rate, access_count, block_accesses);
+
+	if (mrc_file) {
+		tasks[task_count].t_policy = -1;
+		task_count++;
+	}
+	for (k = 0; k < POLICY_MAX; k++) {
+		if (!use_policy[k])
+			continue;
+		for (i = 0; i < size_count; i++) {
+			tasks[task_count].t_policy = k;
+			tasks[task_count].t_size = sizes[i];
+			task_count++;
+		}
+	}
+	run_tasks();
+
+	// the curve may go to stdout, so don't mix it with the results
+	if (mrc_file)
+		printf("INFO: distinct_blocks=%llu cold_miss_ratio=%f\n", mrc_distinct, mrc_cold_ratio);
+
+	for (i = 0; i < task_count; i++) {
+		if (tasks[i].t_result) {
+			print_result(&tasks[i]);
+			free(tasks[i].t_result);
+		}
+	}
+	free(accesses);
+	return 0;
+}
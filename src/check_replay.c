@@ -0,0 +1,740 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Streaming comparison of a .replay file against a blktrace capture
+ * of the same replay, converted to .load format by blktrace_to_load.exe.
+ * This quantifies how faithfully blkreplay reproduced the load on
+ * the device.
+ *
+ * Both inputs are processed in time order: the replay by the real
+ * submission time start+delay (restored by a small heap, since
+ * blkreplay prints the requests in completion order), the trace as
+ * produced. The offset between both clocks is calibrated from the
+ * median time difference of the first exact matches.
+ *
+ * Inside a sliding time window, requests are matched
+ *  - exactly by sector, length and direction,
+ *  - as kernel merges: one trace request covering several adjacent
+ *    replay requests,
+ *  - as kernel splits: one replay request covered by several adjacent
+ *    trace requests.
+ * Whatever is still unmatched when it leaves the window is counted
+ * as missing (replay only) or extra (trace only).
+ *
+ * The reorder distance of a trace request is how many requests
+ * submitted later by the replay have been seen on the device before it.
+ *
+ * Usage: check_replay.exe [options] <replay> <trace.load>
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "histogram.h"
+
+#define HASH_BITS  20
+#define HASH_SIZE  (1 << HASH_BITS)
+#define MAX_PIECES 256
+#define LINE_LEN   4096
+
+enum {
+	SIDE_REPLAY,
+	SIDE_TRACE,
+	SIDE_MAX,
+};
+
+const char *side_names[SIDE_MAX] = {
+	"replay",
+	"trace",
+};
+
+struct req {
+	double       r_time;    // replay: submission, trace: aligned to the replay clock
+	double       r_done;    // replay only: completion
+	long long    r_sector;
+	int          r_len;
+	char         r_op;
+	long long    r_rank;    // position in its own stream
+	long long    r_peer;    // rank of the matching request on the other side, or -1
+	struct req  *r_next;    // hash chain of unmatched requests
+};
+
+// FIFO of requests, growing as needed
+struct queue {
+	struct req **q_buf;
+	long long    q_alloc;
+	long long    q_head;
+	long long    q_count;
+};
+
+struct side {
+	FILE        *s_file;
+	int          s_popen;
+	int          s_eof;
+	long long    s_lines;
+	long long    s_errors;
+	long long    s_count;   // requests delivered in time order
+	struct queue s_input;   // read ahead, not yet processed
+	struct queue s_window;  // processed, in time order
+	long long    s_checked; // s_window entries already checked for merges / splits
+	struct req **s_hash;
+	// replay only: heap for restoring the submission order
+	struct req **s_heap;
+	int          s_heap_count;
+	int          s_heap_alloc;
+	double       s_max_done;
+};
+
+struct side sides[SIDE_MAX];
+
+double window = 1.0;
+double sort_window = 10.0;
+double offset = 0.0;
+int have_offset = 0;
+int calibrate_count = 1000;
+char *hist_name = NULL;
+
+// statistics
+long long exact = 0;
+long long merges = 0;
+long long merged_requests = 0;
+long long splits = 0;
+long long split_pieces = 0;
+long long missing = 0;
+long long extra = 0;
+long long in_order = 0;
+long long out_of_order = 0;
+long long max_reorder = 0;
+long long max_peer = -1;
+double error_sum = 0.0;
+double error_max = 0.0;
+long long error_count = 0;
+struct histogram timing_hist;
+struct histogram reorder_hist;
+
+/////////////////////////////////////////////////////////////////
+
+// helpers
+
+static
+void *xmalloc(size_t size)
+{
+	void *res = malloc(size);
+
+	if (!res) {
+		printf("FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	return res;
+}
+
+static
+void q_push(struct queue *q, struct req *req)
+{
+	if (q->q_count >= q->q_alloc) {
+		long long new_alloc = q->q_alloc ? q->q_alloc * 2 : 1024;
+		struct req **new_buf = xmalloc(new_alloc * sizeof(struct req *));
+		long long i;
+
+		for (i = 0; i < q->q_count; i++)
+			new_buf[i] = q->q_buf[(q->q_head + i) & (q->q_alloc - 1)];
+		free(q->q_buf);
+		q->q_buf = new_buf;
+		q->q_alloc = new_alloc;
+		q->q_head = 0;
+	}
+	q->q_buf[(q->q_head + q->q_count++) & (q->q_alloc - 1)] = req;
+}
+
+static
+struct req *q_get(struct queue *q, long long index)
+{
+	return q->q_buf[(q->q_head + index) & (q->q_alloc - 1)];
+}
+
+static
+struct req *q_pop(struct queue *q)
+{
+	struct req *res = q->q_buf[q->q_head];
+
+	q->q_head = (q->q_head + 1) & (q->q_alloc - 1);
+	q->q_count--;
+	return res;
+}
+
+static
+unsigned int hash_of(long long sector, char op)
+{
+	unsigned long long key = (unsigned long long)sector * 2 + (op == 'W');
+
+	return (key * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS);
+}
+
+static
+void hash_insert(struct side *s, struct req *req)
+{
+	unsigned int h = hash_of(req->r_sector, req->r_op);
+
+	req->r_next = s->s_hash[h];
+	s->s_hash[h] = req;
+}
+
+static
+void hash_remove(struct side *s, struct req *req)
+{
+	struct req **ptr = &s->s_hash[hash_of(req->r_sector, req->r_op)];
+
+	while (*ptr) {
+		if (*ptr == req) {
+			*ptr = req->r_next;
+			req->r_next = NULL;
+			return;
+		}
+		ptr = &(*ptr)->r_next;
+	}
+}
+
+/////////////////////////////////////////////////////////////////
+
+// input
+
+static
+struct req *read_request(int nr)
+{
+	struct side *s = &sides[nr];
+	char line[LINE_LEN];
+
+	while (!s->s_eof && fgets(line, sizeof(line), s->s_file)) {
+		struct req *req;
+		double start;
+		double delay = 0.0;
+		double duration = 0.0;
+		long long sector;
+		int len;
+		char op;
+		int count;
+
+		s->s_lines++;
+		if (strstr(line, "ERROR")) {
+			s->s_errors++;
+			continue;
+		}
+		count = sscanf(line, "%lf ; %lld ; %d ; %c ; %lf ; %lf", &start, &sector, &len, &op, &delay, &duration);
+		if (count < 4 || len <= 0 || (nr == SIDE_REPLAY && count < 6))
+			continue;
+		req = xmalloc(sizeof(struct req));
+		memset(req, 0, sizeof(struct req));
+		req->r_time = start + delay;
+		req->r_done = req->r_time + duration;
+		req->r_sector = sector;
+		req->r_len = len;
+		req->r_op = (op == 'W' || op == 'w') ? 'W' : 'R';
+		req->r_peer = -1;
+		return req;
+	}
+	s->s_eof = 1;
+	return NULL;
+}
+
+static
+void heap_push(struct side *s, struct req *req)
+{
+	int i;
+
+	if (s->s_heap_count >= s->s_heap_alloc) {
+		s->s_heap_alloc = s->s_heap_alloc ? s->s_heap_alloc * 2 : 1024;
+		s->s_heap = realloc(s->s_heap, s->s_heap_alloc * sizeof(struct req *));
+		if (!s->s_heap) {
+			printf("FATAL ERROR: out of memory\n");
+			exit(-1);
+		}
+	}
+	for (i = s->s_heap_count++; i > 0; i = (i - 1) / 2) {
+		struct req *parent = s->s_heap[(i - 1) / 2];
+		if (parent->r_time <= req->r_time)
+			break;
+		s->s_heap[i] = parent;
+	}
+	s->s_heap[i] = req;
+}
+
+static
+struct req *heap_pop(struct side *s)
+{
+	struct req *res = s->s_heap[0];
+	struct req *last = s->s_heap[--s->s_heap_count];
+	int i = 0;
+
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= s->s_heap_count)
+			break;
+		if (child + 1 < s->s_heap_count && s->s_heap[child + 1]->r_time < s->s_heap[child]->r_time)
+			child++;
+		if (last->r_time <= s->s_heap[child]->r_time)
+			break;
+		s->s_heap[i] = s->s_heap[child];
+		i = child;
+	}
+	if (s->s_heap_count)
+		s->s_heap[i] = last;
+	return res;
+}
+
+/* Deliver the requests in time order. The replay is printed in
+ * completion order, so a request submitted at t can only show up
+ * before all requests completed until t + sort_window.
+ */
+static
+struct req *next_request(int nr)
+{
+	struct side *s = &sides[nr];
+	struct req *req;
+
+	if (nr == SIDE_TRACE) {
+		req = read_request(nr);
+	} else {
+		while (!s->s_eof &&
+		       (!s->s_heap_count || s->s_heap[0]->r_time >= s->s_max_done - sort_window)) {
+			req = read_request(nr);
+			if (!req)
+				break;
+			if (req->r_done > s->s_max_done)
+				s->s_max_done = req->r_done;
+			heap_push(s, req);
+		}
+		req = s->s_heap_count ? heap_pop(s) : NULL;
+	}
+	if (req)
+		req->r_rank = s->s_count++;
+	return req;
+}
+
+static
+struct req *peek_request(int nr)
+{
+	struct side *s = &sides[nr];
+
+	if (!s->s_input.q_count) {
+		struct req *req = next_request(nr);
+		if (!req)
+			return NULL;
+		if (nr == SIDE_TRACE)
+			req->r_time -= offset;
+		q_push(&s->s_input, req);
+	}
+	return q_get(&s->s_input, 0);
+}
+
+static
+int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Determine the clock offset by the median time difference of
+ * the exact matches among the first requests of both sides.
+ */
+static
+void calibrate(void)
+{
+	struct side *r = &sides[SIDE_REPLAY];
+	struct side *t = &sides[SIDE_TRACE];
+	double *diffs;
+	int count = 0;
+	int i;
+
+	for (i = 0; i < calibrate_count; i++) {
+		struct req *req = next_request(SIDE_REPLAY);
+		if (!req)
+			break;
+		q_push(&r->s_input, req);
+	}
+	for (i = 0; i < calibrate_count; i++) {
+		struct req *req = next_request(SIDE_TRACE);
+		if (!req)
+			break;
+		q_push(&t->s_input, req);
+	}
+	if (!have_offset) {
+		diffs = xmalloc((r->s_input.q_count + 1) * sizeof(double));
+		for (i = t->s_input.q_count - 1; i >= 0; i--)
+			hash_insert(t, q_get(&t->s_input, i));
+		for (i = 0; i < r->s_input.q_count; i++) {
+			struct req *req = q_get(&r->s_input, i);
+			struct req *x;
+			for (x = t->s_hash[hash_of(req->r_sector, req->r_op)]; x; x = x->r_next) {
+				if (x->r_sector == req->r_sector && x->r_op == req->r_op && x->r_len == req->r_len) {
+					diffs[count++] = x->r_time - req->r_time;
+					hash_remove(t, x);
+					break;
+				}
+			}
+		}
+		for (i = 0; i < t->s_input.q_count; i++)
+			hash_remove(t, q_get(&t->s_input, i));
+		if (!count) {
+			printf("ERROR: no common requests among the first %d, please use --offset\n", calibrate_count);
+			exit(-1);
+		}
+		qsort(diffs, count, sizeof(double), cmp_double);
+		offset = diffs[count / 2];
+		free(diffs);
+	}
+	for (i = 0; i < t->s_input.q_count; i++)
+		q_get(&t->s_input, i)->r_time -= offset;
+	printf("INFO: offset=%.9f calibrated from %d matches\n", offset, count);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// matching
+
+static
+void timing_error(double error)
+{
+	hist_put(&timing_hist, fabs(error));
+	error_sum += error;
+	error_count++;
+	if (fabs(error) > error_max)
+		error_max = fabs(error);
+}
+
+static
+struct req *find_piece(struct side *s, long long sector, char op, int max_len, double time)
+{
+	struct req *best = NULL;
+	struct req *x;
+
+	for (x = s->s_hash[hash_of(sector, op)]; x; x = x->r_next) {
+		if (x->r_sector != sector || x->r_op != op || x->r_len > max_len ||
+		    fabs(x->r_time - time) > window)
+			continue;
+		if (!best || fabs(x->r_time - time) < fabs(best->r_time - time))
+			best = x;
+	}
+	return best;
+}
+
+static
+void match_exact(struct req *r, struct req *t)
+{
+	r->r_peer = t->r_rank;
+	t->r_peer = r->r_rank;
+	timing_error(t->r_time - r->r_time);
+	exact++;
+}
+
+/* The container request c of side nr is covered by adjacent unmatched
+ * requests of the other side: a kernel merge when c is from the trace,
+ * a kernel split when c is from the replay.
+ */
+static
+void try_cover(int nr, struct req *c)
+{
+	struct side *o = &sides[!nr];
+	struct req *pieces[MAX_PIECES];
+	long long sector = c->r_sector;
+	int rest = c->r_len;
+	int count = 0;
+	int i;
+
+	while (rest > 0 && count < MAX_PIECES) {
+		struct req *piece = find_piece(o, sector, c->r_op, rest, c->r_time);
+		if (!piece)
+			return;
+		pieces[count++] = piece;
+		sector += piece->r_len;
+		rest -= piece->r_len;
+	}
+	if (rest)
+		return;
+
+	hash_remove(&sides[nr], c);
+	for (i = 0; i < count; i++)
+		hash_remove(o, pieces[i]);
+	if (count == 1) {
+		if (nr == SIDE_REPLAY)
+			match_exact(c, pieces[0]);
+		else
+			match_exact(pieces[0], c);
+		return;
+	}
+	c->r_peer = pieces[0]->r_rank;
+	for (i = 0; i < count; i++) {
+		pieces[i]->r_peer = c->r_rank;
+		if (nr == SIDE_REPLAY)
+			timing_error(pieces[i]->r_time - c->r_time);
+		else
+			timing_error(c->r_time - pieces[i]->r_time);
+	}
+	if (nr == SIDE_REPLAY) {
+		splits++;
+		split_pieces += count;
+	} else {
+		merges++;
+		merged_requests += count;
+	}
+}
+
+static
+void arrive(int nr, struct req *req)
+{
+	struct side *s = &sides[nr];
+	struct req *peer = find_piece(&sides[!nr], req->r_sector, req->r_op, req->r_len, req->r_time);
+
+	q_push(&s->s_window, req);
+	if (peer && peer->r_len == req->r_len) {
+		hash_remove(&sides[!nr], peer);
+		if (nr == SIDE_REPLAY)
+			match_exact(req, peer);
+		else
+			match_exact(peer, req);
+		return;
+	}
+	hash_insert(s, req);
+}
+
+static
+void leave(int nr, struct req *req)
+{
+	struct side *s = &sides[nr];
+
+	if (req->r_peer < 0) {
+		hash_remove(s, req);
+		if (nr == SIDE_REPLAY)
+			missing++;
+		else
+			extra++;
+	} else if (nr == SIDE_TRACE) {
+		// the trace is in device order, the peer ranks in submission order
+		if (req->r_peer < max_peer) {
+			long long dist = max_peer - req->r_peer;
+			hist_put(&reorder_hist, dist);
+			if (dist > max_reorder)
+				max_reorder = dist;
+			out_of_order++;
+		} else {
+			max_peer = req->r_peer;
+			in_order++;
+		}
+	}
+	free(req);
+}
+
+/* Unmatched requests are checked for merges / splits once all their
+ * potential pieces must have arrived, i.e. after one window. They
+ * finally leave after three windows, when they can no longer be
+ * a piece of some other request.
+ */
+static
+void advance(double now)
+{
+	int nr;
+
+	for (nr = 0; nr < SIDE_MAX; nr++) {
+		struct side *s = &sides[nr];
+		while (s->s_checked < s->s_window.q_count) {
+			struct req *req = q_get(&s->s_window, s->s_checked);
+			if (req->r_time >= now - window)
+				break;
+			if (req->r_peer < 0)
+				try_cover(nr, req);
+			s->s_checked++;
+		}
+	}
+	for (nr = 0; nr < SIDE_MAX; nr++) {
+		struct side *s = &sides[nr];
+		while (s->s_checked > 0 && q_get(&s->s_window, 0)->r_time < now - 3 * window) {
+			leave(nr, q_pop(&s->s_window));
+			s->s_checked--;
+		}
+	}
+}
+
+static
+void compare(void)
+{
+	for (;;) {
+		struct req *r = peek_request(SIDE_REPLAY);
+		struct req *t = peek_request(SIDE_TRACE);
+		int nr;
+		struct req *req;
+
+		if (!r && !t)
+			break;
+		nr = (!t || (r && r->r_time <= t->r_time)) ? SIDE_REPLAY : SIDE_TRACE;
+		req = q_pop(&sides[nr].s_input);
+		arrive(nr, req);
+		advance(req->r_time);
+	}
+	advance(HUGE_VAL);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+static
+void usage(const char *name)
+{
+	printf("usage: %s [options] <replay> <trace.load>\n"
+	       "  inputs may be '-' for stdin, *.gz files are uncompressed\n"
+	       "  --window=<sec>       max timing difference of matching requests (default 1)\n"
+	       "  --sort-window=<sec>  max latency for restoring the replay order (default 10)\n"
+	       "  --offset=<sec>       trace clock minus replay clock (default: calibrated)\n"
+	       "  --calibrate=<count>  requests used for calibration (default 1000)\n"
+	       "  --hist=<prefix>      write <prefix>.timing.bins and <prefix>.reorder.bins\n",
+	       name);
+	exit(-1);
+}
+
+static
+void open_side(int nr, const char *name)
+{
+	struct side *s = &sides[nr];
+	int len = strlen(name);
+
+	if (!strcmp(name, "-")) {
+		s->s_file = stdin;
+	} else if (len > 3 && !strcmp(name + len - 3, ".gz")) {
+		char cmd[LINE_LEN + 32];
+		snprintf(cmd, sizeof(cmd), "gzip -dc '%s'", name);
+		s->s_file = popen(cmd, "r");
+		s->s_popen = 1;
+	} else {
+		s->s_file = fopen(name, "r");
+	}
+	if (!s->s_file) {
+		printf("FATAL ERROR: cannot open %s file '%s'\n", side_names[nr], name);
+		exit(-1);
+	}
+	s->s_hash = calloc(HASH_SIZE, sizeof(struct req *));
+	if (!s->s_hash) {
+		printf("FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+}
+
+static
+void write_hist(const char *suffix, struct histogram *h)
+{
+	char name[LINE_LEN];
+	FILE *out;
+
+	snprintf(name, sizeof(name), "%s.%s.bins", hist_name, suffix);
+	out = fopen(name, "w");
+	if (!out) {
+		printf("ERROR: cannot create '%s'\n", name);
+		return;
+	}
+	hist_print(h, out);
+	fclose(out);
+}
+
+int main(int argc, char *argv[])
+{
+	char *names[SIDE_MAX] = {};
+	long long replay_count;
+	long long matched;
+	int count = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (!strncmp(arg, "--window=", 9)) {
+			window = atof(arg + 9);
+		} else if (!strncmp(arg, "--sort-window=", 14)) {
+			sort_window = atof(arg + 14);
+		} else if (!strncmp(arg, "--offset=", 9)) {
+			offset = atof(arg + 9);
+			have_offset = 1;
+		} else if (!strncmp(arg, "--calibrate=", 12)) {
+			calibrate_count = atoi(arg + 12);
+		} else if (!strncmp(arg, "--hist=", 7)) {
+			hist_name = arg + 7;
+		} else if (arg[0] == '-' && arg[1]) {
+			printf("ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		} else if (count < SIDE_MAX) {
+			names[count++] = arg;
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (count != SIDE_MAX || window <= 0.0 || sort_window < 0.0 || calibrate_count <= 0)
+		usage(argv[0]);
+	if (!strcmp(names[SIDE_REPLAY], "-") && !strcmp(names[SIDE_TRACE], "-")) {
+		printf("ERROR: only one input can be read from stdin\n");
+		exit(-1);
+	}
+
+	hist_init(&timing_hist, HIST_DEFAULT_SUBDIV);
+	hist_init(&reorder_hist, HIST_DEFAULT_SUBDIV);
+	for (i = 0; i < SIDE_MAX; i++)
+		open_side(i, names[i]);
+
+	calibrate();
+	compare();
+
+	for (i = 0; i < SIDE_MAX; i++) {
+		if (sides[i].s_popen)
+			pclose(sides[i].s_file);
+		else if (sides[i].s_file != stdin)
+			fclose(sides[i].s_file);
+		if (sides[i].s_errors)
+			printf("WARN: %lld ERROR lines in the %s input\n", sides[i].s_errors, side_names[i]);
+	}
+
+	replay_count = sides[SIDE_REPLAY].s_count;
+	matched = exact + merged_requests + splits;
+	printf("INFO: window=%.6f replay_requests=%lld trace_requests=%lld\n",
+	       window, replay_count, sides[SIDE_TRACE].s_count);
+	printf("INFO: exact=%lld merges=%lld merged_requests=%lld splits=%lld split_pieces=%lld missing=%lld extra=%lld\n",
+	       exact, merges, merged_requests, splits, split_pieces, missing, extra);
+	printf("INFO: timing_error mean=%.9f p50=%.9f p90=%.9f p99=%.9f p99.9=%.9f max=%.9f\n",
+	       error_count ? error_sum / error_count : 0.0,
+	       hist_percentile(&timing_hist, 50.0),
+	       hist_percentile(&timing_hist, 90.0),
+	       hist_percentile(&timing_hist, 99.0),
+	       hist_percentile(&timing_hist, 99.9),
+	       error_max);
+	printf("INFO: reorder in_order=%lld out_of_order=%lld p50=%.0f p99=%.0f max=%lld\n",
+	       in_order, out_of_order,
+	       hist_percentile(&reorder_hist, 50.0),
+	       hist_percentile(&reorder_hist, 99.0),
+	       max_reorder);
+	printf("INFO: fidelity exact=%.6f matched=%.6f\n",
+	       replay_count ? (double)exact / replay_count : 0.0,
+	       replay_count ? (double)matched / replay_count : 0.0);
+
+	if (hist_name) {
+		write_hist("timing", &timing_hist);
+		write_hist("reorder", &reorder_hist);
+	}
+	return 0;
+}
@@ -0,0 +1,513 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Native replacement for the snippet machinery of
+ * scripts/create_derived_load.sh, producing identical output.
+ *
+ * The input load (uncompressed, on stdin) is pasted together and cut
+ * into snippets of --window seconds in a single streaming pass. The
+ * re-timed snippets are spooled into one temporary file. Then all
+ * derived loads of all --splits are written in parallel, each one
+ * by its own gzip process.
+ *
+ * Usage: gunzip -f < <load> | derive_load.exe [options]
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define LINE_LEN  4096
+#define BUF_SIZE  (1024 * 1024)
+#define MAX_SPLITS 64
+
+struct snippet {
+	long long sn_count;
+	long long sn_nr;
+	char      sn_name[64];  // "<count>.<nr>" as the script named its files
+	off_t     sn_start;     // range in the spool file
+	off_t     sn_len;
+};
+
+struct job {
+	const char *j_split;
+	int         j_max;
+	int         j_index;
+};
+
+long long window = 300;
+char *split_list = "001 002 004 008 016 032 064 128";
+char *base = NULL;
+char *header_file = NULL;
+char *tmp_dir = NULL;
+int thread_count = 0;
+
+char *splits[MAX_SPLITS];
+int split_count = 0;
+
+int spool_fd = -1;
+FILE *spool;
+off_t spool_pos = 0;
+
+struct snippet *snippets = NULL;
+long long snippet_count = 0;
+long long snippet_alloc = 0;
+struct snippet **sorted;
+
+char *header = NULL;
+size_t header_len = 0;
+
+struct job *jobs = NULL;
+int job_count = 0;
+int job_next = 0;
+int job_errors = 0;
+pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/////////////////////////////////////////////////////////////////
+
+// snippet extraction
+
+static
+void add_snippet(long long count, off_t start)
+{
+	struct snippet *sn;
+
+	if (snippet_count >= snippet_alloc) {
+		snippet_alloc = snippet_alloc ? snippet_alloc * 2 : 1024;
+		snippets = realloc(snippets, snippet_alloc * sizeof(struct snippet));
+		if (!snippets) {
+			fprintf(stderr, "FATAL ERROR: out of memory\n");
+			exit(-1);
+		}
+	}
+	sn = &snippets[snippet_count];
+	sn->sn_count = count;
+	sn->sn_nr = snippet_count;
+	snprintf(sn->sn_name, sizeof(sn->sn_name), "%lld.%lld", count, snippet_count);
+	sn->sn_start = start;
+	sn->sn_len = spool_pos - start;
+	snippet_count++;
+}
+
+/* Equivalent to
+ *   grep ";" | grep -v "[a-z]" | paste_together
+ * followed by the snippet loop and from_start of the script.
+ */
+static
+void extract(FILE *inp)
+{
+	char line[LINE_LEN];
+	char formatted[64];
+	double old = 0.0;
+	double offset = 0.0;
+	double first = 0.0;
+	long long limit = window;
+	long long count = 0;
+	long long total = 0;
+	off_t start = 0;
+
+	while (fgets(line, sizeof(line), inp)) {
+		char *field[6] = {};
+		char *pos;
+		double val;
+		double rel;
+		long long time;
+		int i;
+
+		if (!strchr(line, ';'))
+			continue;
+		for (pos = line; *pos; pos++) {
+			if (*pos >= 'a' && *pos <= 'z')
+				break;
+		}
+		if (*pos)
+			continue;
+		pos = strchr(line, '\n');
+		if (pos)
+			*pos = '\0';
+		// split like gawk -F";"
+		pos = line;
+		for (i = 0; i < 6 && pos; i++) {
+			field[i] = pos;
+			pos = strchr(pos, ';');
+			if (pos)
+				*pos++ = '\0';
+		}
+		for (; i < 6; i++)
+			field[i] = "";
+
+		// paste_together
+		val = strtod(field[0], NULL);
+		if (val < old)
+			offset += old;
+		old = val;
+		snprintf(formatted, sizeof(formatted), "%17.9f", val + offset);
+		// the bash loop only looks at the integer part
+		time = strtoll(formatted, NULL, 10);
+		val = strtod(formatted, NULL);
+
+		if (time >= limit) {
+			fprintf(stderr, "  snippet %lld at %lld has %lld requests (%lld IOPS)\n",
+				snippet_count, limit, count, count / window);
+			total += count;
+			add_snippet(count, start);
+			limit += window;
+			start = spool_pos;
+			count = 0;
+		}
+		// from_start
+		if (!count)
+			first = val;
+		rel = val - first;
+		spool_pos += fprintf(spool, "%17.9f ;%s;%s;%s;0;0\n", rel, field[1], field[2], field[3]);
+		count++;
+	}
+	fflush(spool);
+	if (ferror(spool)) {
+		fprintf(stderr, "FATAL ERROR: cannot write the spool file (errno=%d)\n", errno);
+		exit(-1);
+	}
+	fprintf(stderr, "------------------------------------------------\n");
+	fprintf(stderr, "snippets      : %lld\n", snippet_count);
+	fprintf(stderr, "reworked lines: %lld\n", total);
+	fprintf(stderr, "rest     lines: %lld\n", count);
+	fprintf(stderr, "sum      lines: %lld\n", total + count);
+	if (snippet_count)
+		fprintf(stderr, "average  IOPS : %lld\n", total / snippet_count / window);
+	fprintf(stderr, "------------------------------------------------\n");
+}
+
+/* Same order as ls | sort -n -r on the snippet names: numerically
+ * as a decimal fraction "<count>.<nr>", ties reversed bytewise.
+ */
+static
+int cmp_snippets(const void *_a, const void *_b)
+{
+	const struct snippet *a = *(const struct snippet **)_a;
+	const struct snippet *b = *(const struct snippet **)_b;
+	const char *fa;
+	const char *fb;
+
+	if (a->sn_count != b->sn_count)
+		return a->sn_count < b->sn_count ? 1 : -1;
+	fa = strchr(a->sn_name, '.') + 1;
+	fb = strchr(b->sn_name, '.') + 1;
+	while (*fa || *fb) {
+		char ca = *fa ? *fa++ : '0';
+		char cb = *fb ? *fb++ : '0';
+		if (ca != cb)
+			return ca < cb ? 1 : -1;
+	}
+	return strcmp(b->sn_name, a->sn_name);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// output
+
+/* Equivalent to
+ *   cat <snippets> | paste_together | gzip -8
+ * The spooled lines are already formatted except for the time.
+ */
+static
+int write_output(struct job *job)
+{
+	char dir[LINE_LEN];
+	char name[LINE_LEN * 2 + 64];
+	char cmd[LINE_LEN * 3];
+	char *buf;
+	char *line;
+	double old = 0.0;
+	double offset = 0.0;
+	long long k;
+	FILE *out;
+	int res = 0;
+
+	snprintf(dir, sizeof(dir), "%s.derived.split.%s", base, job->j_split);
+	snprintf(name, sizeof(name), "%s/%s.derived.%03d.of.%d.load.gz", dir, base, job->j_index, job->j_max);
+	snprintf(cmd, sizeof(cmd), "gzip -8 > '%s'", name);
+	out = popen(cmd, "we");
+	buf = malloc(BUF_SIZE + LINE_LEN);
+	line = malloc(LINE_LEN + 64);
+	if (!out || !buf || !line) {
+		fprintf(stderr, "ERROR: cannot create '%s'\n", name);
+		free(buf);
+		free(line);
+		if (out)
+			pclose(out);
+		return -1;
+	}
+	setvbuf(out, NULL, _IOFBF, BUF_SIZE);
+	fwrite(header, 1, header_len, out);
+
+	// the snippets of this output are every j_max'th of the sorted list
+	for (k = job->j_index; k < snippet_count; k += job->j_max) {
+		struct snippet *sn = sorted[k];
+		off_t done = 0;
+		size_t fill = 0;
+
+		while (done < sn->sn_len || fill) {
+			char *pos;
+			char *nl;
+			ssize_t status = 0;
+
+			if (done < sn->sn_len) {
+				size_t want = BUF_SIZE - fill;
+				if (want > sn->sn_len - done)
+					want = sn->sn_len - done;
+				status = pread(spool_fd, buf + fill, want, sn->sn_start + done);
+				if (status <= 0) {
+					fprintf(stderr, "ERROR: cannot read the spool file (errno=%d)\n", errno);
+					res = -1;
+					goto done;
+				}
+				done += status;
+				fill += status;
+			}
+			pos = buf;
+			while ((nl = memchr(pos, '\n', buf + fill - pos))) {
+				double val = strtod(pos, NULL);
+				char *rest = memchr(pos, ';', nl - pos);
+				int len;
+
+				if (val < old)
+					offset += old;
+				old = val;
+				len = snprintf(line, 64, "%17.9f ", val + offset);
+				fwrite(line, 1, len, out);
+				fwrite(rest, 1, nl + 1 - rest, out);
+				pos = nl + 1;
+			}
+			fill -= pos - buf;
+			memmove(buf, pos, fill);
+			if (!status && fill) {
+				// cannot happen: every spooled line has a newline
+				fill = 0;
+			}
+		}
+	}
+
+done:
+	if (pclose(out))
+		res = -1;
+	free(buf);
+	free(line);
+	return res;
+}
+
+static
+void *worker(void *arg)
+{
+	for (;;) {
+		struct job *job;
+
+		pthread_mutex_lock(&job_mutex);
+		job = job_next < job_count ? &jobs[job_next++] : NULL;
+		pthread_mutex_unlock(&job_mutex);
+		if (!job)
+			break;
+		if (write_output(job) < 0) {
+			pthread_mutex_lock(&job_mutex);
+			job_errors++;
+			pthread_mutex_unlock(&job_mutex);
+		}
+	}
+	return NULL;
+}
+
+static
+void run_jobs(void)
+{
+	pthread_t threads[256];
+	int count = thread_count;
+	int i;
+
+	if (count > job_count)
+		count = job_count;
+	if (count > 256)
+		count = 256;
+	for (i = 0; i < count; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL)) {
+			fprintf(stderr, "FATAL ERROR: cannot create thread\n");
+			exit(-1);
+		}
+	}
+	for (i = 0; i < count; i++)
+		pthread_join(threads[i], NULL);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr, "usage: gunzip -f < <load> | %s --base=<name> [options]\n"
+		"  --window=<sec>      snippet length (default 300)\n"
+		"  --splits=<list>     numbers of output files (default \"%s\")\n"
+		"  --header=<file>     copyright header prepended to each output\n"
+		"  --tmp=<dir>         for the spool file (default $TMPDIR or /tmp)\n"
+		"  --threads=<count>   parallel gzip processes (default all CPUs)\n",
+		name, split_list);
+	exit(-1);
+}
+
+static
+void read_header(void)
+{
+	FILE *f;
+	size_t alloc = 0;
+	size_t len;
+	char chunk[LINE_LEN];
+
+	if (!header_file) {
+		header = "";
+		return;
+	}
+	f = fopen(header_file, "r");
+	if (!f) {
+		fprintf(stderr, "FATAL ERROR: cannot open header file '%s'\n", header_file);
+		exit(-1);
+	}
+	while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+		if (header_len + len > alloc) {
+			alloc = (header_len + len) * 2;
+			header = realloc(header, alloc);
+			if (!header) {
+				fprintf(stderr, "FATAL ERROR: out of memory\n");
+				exit(-1);
+			}
+		}
+		memcpy(header + header_len, chunk, len);
+		header_len += len;
+	}
+	fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+	char spool_name[LINE_LEN];
+	char *tmp_str;
+	long long k;
+	int i;
+	int j;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (!strncmp(arg, "--window=", 9)) {
+			window = atoll(arg + 9);
+		} else if (!strncmp(arg, "--splits=", 9)) {
+			split_list = arg + 9;
+		} else if (!strncmp(arg, "--base=", 7)) {
+			base = arg + 7;
+		} else if (!strncmp(arg, "--header=", 9)) {
+			header_file = arg + 9;
+		} else if (!strncmp(arg, "--tmp=", 6)) {
+			tmp_dir = arg + 6;
+		} else if (!strncmp(arg, "--threads=", 10)) {
+			thread_count = atoi(arg + 10);
+		} else {
+			fprintf(stderr, "ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		}
+	}
+	if (!base || window <= 0)
+		usage(argv[0]);
+	split_list = strdup(split_list);
+	for (tmp_str = strtok(split_list, " ,"); tmp_str && split_count < MAX_SPLITS; tmp_str = strtok(NULL, " ,")) {
+		if (atoi(tmp_str) <= 0) {
+			fprintf(stderr, "ERROR: bad split '%s'\n", tmp_str);
+			exit(-1);
+		}
+		splits[split_count++] = tmp_str;
+	}
+	if (thread_count <= 0)
+		thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (thread_count <= 0)
+		thread_count = 1;
+	if (!tmp_dir)
+		tmp_dir = getenv("TMPDIR");
+	if (!tmp_dir)
+		tmp_dir = "/tmp";
+	read_header();
+
+	snprintf(spool_name, sizeof(spool_name), "%s/snippets.XXXXXX", tmp_dir);
+	spool_fd = mkstemp(spool_name);
+	if (spool_fd < 0 || !(spool = fdopen(dup(spool_fd), "w"))) {
+		fprintf(stderr, "FATAL ERROR: cannot create spool file in '%s'\n", tmp_dir);
+		exit(-1);
+	}
+	unlink(spool_name);
+	setvbuf(spool, NULL, _IOFBF, BUF_SIZE);
+
+	fprintf(stderr, "Creating snippets....\n");
+	extract(stdin);
+	fclose(spool);
+
+	sorted = malloc((snippet_count + 1) * sizeof(struct snippet *));
+	if (!sorted) {
+		fprintf(stderr, "FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	for (k = 0; k < snippet_count; k++)
+		sorted[k] = &snippets[k];
+	qsort(sorted, snippet_count, sizeof(struct snippet *), cmp_snippets);
+
+	for (i = 0; i < split_count; i++) {
+		char dir[LINE_LEN];
+		int max = atoi(splits[i]);
+
+		snprintf(dir, sizeof(dir), "%s.derived.split.%s", base, splits[i]);
+		if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+			fprintf(stderr, "FATAL ERROR: cannot create directory '%s'\n", dir);
+			exit(-1);
+		}
+		fprintf(stderr, "Splitting into %s: %d outputs\n", splits[i], max < snippet_count ? max : (int)snippet_count);
+		for (j = 0; j < max && j < snippet_count; j++) {
+			if (job_count % 1024 == 0)
+				jobs = realloc(jobs, (job_count + 1024) * sizeof(struct job));
+			if (!jobs) {
+				fprintf(stderr, "FATAL ERROR: out of memory\n");
+				exit(-1);
+			}
+			jobs[job_count].j_split = splits[i];
+			jobs[job_count].j_max = max;
+			jobs[job_count].j_index = j;
+			job_count++;
+		}
+	}
+	fprintf(stderr, "Writing %d outputs with %d threads....\n", job_count, thread_count);
+	run_jobs();
+	close(spool_fd);
+	if (job_errors) {
+		fprintf(stderr, "ERROR: %d outputs failed\n", job_errors);
+		exit(-1);
+	}
+	return 0;
+}
@@ -0,0 +1,269 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Fits the statistical model of src/load_model.h to a .load / .replay
+ * file. The model is written to stdout, a summary of the load goes to
+ * stderr. Running the summary over a load made by gen_load.exe allows
+ * checking the generator against the original.
+ *
+ * Usage: zcat -f <load> | fit_load.exe > <model>
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "load_model.h"
+
+static struct load_model model;
+
+/////////////////////////////////////////////////////////////////
+
+// start sector -> index of its last request
+
+struct sector_map {
+	unsigned long long *sm_key;  // sector + 1, 0 = empty
+	long long          *sm_index;
+	long long           sm_size;
+	long long           sm_count;
+};
+
+static struct sector_map sector_map = {};
+
+static
+void map_alloc(struct sector_map *map, long long size)
+{
+	map->sm_key = calloc(size, sizeof(*map->sm_key));
+	map->sm_index = calloc(size, sizeof(*map->sm_index));
+	if (!map->sm_key || !map->sm_index) {
+		fprintf(stderr, "FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	map->sm_size = size;
+	map->sm_count = 0;
+}
+
+static
+long long *map_find(struct sector_map *map, unsigned long long key)
+{
+	unsigned long long mask = map->sm_size - 1;
+	unsigned long long pos = key * 0x9e3779b97f4a7c15ULL;
+
+	for (pos = (pos ^ (pos >> 29)) & mask; map->sm_key[pos]; pos = (pos + 1) & mask) {
+		if (map->sm_key[pos] == key)
+			return &map->sm_index[pos];
+	}
+	map->sm_key[pos] = key;
+	map->sm_index[pos] = -1;
+	map->sm_count++;
+	return &map->sm_index[pos];
+}
+
+/* Returns the previous index of the sector, or -1.
+ */
+static
+long long map_swap(struct sector_map *map, long long sector, long long index)
+{
+	long long *slot;
+	long long old;
+
+	if (map->sm_count * 2 >= map->sm_size) {
+		struct sector_map old_map = *map;
+		long long i;
+
+		map_alloc(map, old_map.sm_size ? old_map.sm_size * 2 : 65536);
+		for (i = 0; i < old_map.sm_size; i++) {
+			if (old_map.sm_key[i])
+				*map_find(map, old_map.sm_key[i]) = old_map.sm_index[i];
+		}
+		free(old_map.sm_key);
+		free(old_map.sm_index);
+	}
+	slot = map_find(map, sector + 1);
+	old = *slot;
+	*slot = index;
+	return old;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// region histogram, doubling the region size when necessary
+
+static long long regions[MODEL_REGIONS] = {};
+
+static
+void region_add(long long sector)
+{
+	while ((sector >> model.m_region_shift) >= MODEL_REGIONS) {
+		int i;
+
+		for (i = 0; i < MODEL_REGIONS / 2; i++)
+			regions[i] = regions[2 * i] + regions[2 * i + 1];
+		memset(regions + MODEL_REGIONS / 2, 0, sizeof(regions) / 2);
+		model.m_region_shift++;
+	}
+	regions[sector >> model.m_region_shift]++;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// fitting
+
+static
+void fit_input(FILE *inp)
+{
+	char line[4096];
+	double prev_stamp = 0.0;
+	long long prev_end = -1;
+	int prev_write = 0;
+	int prev_seq = 0;
+	int prev_class = 0;
+	long long index = 0;
+	long long ignored = 0;
+	int i;
+
+	while (fgets(line, sizeof(line), inp)) {
+		double stamp;
+		long long sector;
+		int length;
+		char op;
+		int is_write;
+		int is_seq;
+
+		if (!strchr(line, ';') || strstr(line, "replay_"))
+			continue;
+		if (sscanf(line, "%lf ; %lld ; %d ; %c", &stamp, &sector, &length, &op) != 4 || sector < 0) {
+			ignored++;
+			continue;
+		}
+		op = toupper(op);
+		if (op != 'R' && op != 'W') {
+			ignored++;
+			continue;
+		}
+		is_write = op == 'W';
+		is_seq = index && sector == prev_end && is_write == prev_write;
+
+		if (index) {
+			double gap = stamp - prev_stamp;
+			// backshifts of repeated inputs don't count
+			if (gap >= 0.0) {
+				int cls = model_gap_class(gap);
+				dist_add(&model.m_gap[prev_class], cls, 1);
+				prev_class = cls;
+				model.m_duration += gap;
+			}
+			model.m_seq[prev_write][prev_seq][is_seq]++;
+		}
+		dist_add(&model.m_size[is_write], length, 1);
+		if (is_seq) {
+			map_swap(&sector_map, sector, index);
+		} else {
+			long long last = map_swap(&sector_map, sector, index);
+			int is_reuse = last >= 0 && index - last <= MODEL_REUSE_MAX;
+
+			if (index)
+				model.m_op[prev_write][is_write]++;
+			model.m_reuse[is_write][is_reuse]++;
+			if (is_reuse) {
+				dist_add(&model.m_reuse_dist, model_log_bucket(index - last), 1);
+			} else {
+				region_add(sector);
+				model.m_align[!(sector % 8)]++;
+			}
+		}
+		if (sector + length - 1 > model.m_max_sector)
+			model.m_max_sector = sector + length - 1;
+
+		prev_stamp = stamp;
+		prev_end = sector + length;
+		prev_write = is_write;
+		prev_seq = is_seq;
+		index++;
+	}
+	model.m_requests = index;
+	for (i = 0; i < MODEL_REGIONS; i++) {
+		if (regions[i])
+			dist_add(&model.m_region, i, regions[i]);
+	}
+	if (ignored)
+		fprintf(stderr, "WARN: %lld lines ignored\n", ignored);
+}
+
+static
+double ratio(long long part, long long total)
+{
+	return total ? part * 100.0 / total : 0.0;
+}
+
+static
+void print_summary(void)
+{
+	struct load_model *m = &model;
+	long long reads = m->m_size[0].d_total;
+	long long writes = m->m_size[1].d_total;
+	long long nonseq = m->m_reuse[0][0] + m->m_reuse[0][1] + m->m_reuse[1][0] + m->m_reuse[1][1];
+	double size[2] = {};
+	int k;
+	int i;
+
+	for (k = 0; k < 2; k++) {
+		const struct model_dist *d = &m->m_size[k];
+		for (i = 0; i < d->d_count; i++)
+			size[k] += (double)d->d_value[i] * (d->d_weight[i] - (i ? d->d_weight[i - 1] : 0));
+		if (d->d_total)
+			size[k] /= d->d_total * 2.0;
+	}
+	fprintf(stderr, "INFO: requests=%lld duration=%.3f s iops=%.3f\n",
+		m->m_requests, m->m_duration, m->m_duration > 0.0 ? m->m_requests / m->m_duration : 0.0);
+	fprintf(stderr, "INFO: reads=%.3f %% avg_size=%.3f KiB, writes=%.3f %% avg_size=%.3f KiB\n",
+		ratio(reads, m->m_requests), size[0], ratio(writes, m->m_requests), size[1]);
+	fprintf(stderr, "INFO: sequential=%.3f %% reuse=%.3f %% new=%.3f %%\n",
+		ratio(m->m_requests - nonseq, m->m_requests),
+		ratio(m->m_reuse[0][1] + m->m_reuse[1][1], m->m_requests),
+		ratio(m->m_reuse[0][0] + m->m_reuse[1][0], m->m_requests));
+	fprintf(stderr, "INFO: distinct_start_sectors=%lld max_sector=%lld region_size=%lld sectors\n",
+		sector_map.sm_count, m->m_max_sector, 1LL << m->m_region_shift);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1) {
+		fprintf(stderr, "usage: zcat -f <load> | %s > <model>\n", argv[0]);
+		exit(-1);
+	}
+	model_init(&model);
+	fit_input(stdin);
+	if (!model.m_requests) {
+		fprintf(stderr, "ERROR: no requests in the input\n");
+		exit(-1);
+	}
+	model_finish(&model);
+	print_summary();
+	if (model_save(&model, stdout) < 0) {
+		fprintf(stderr, "ERROR: cannot write the model\n");
+		exit(-1);
+	}
+	model_free(&model);
+	return 0;
+}
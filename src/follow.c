@@ -0,0 +1,426 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Incremental statistics of a running replay, for live graphs.
+ *
+ * Reads the output of blkreplay (as it is produced, e.g. via tail -F)
+ * and aggregates the requests into fixed time slots by their real
+ * start time. Only the per-slot aggregates are kept in memory, so a
+ * refresh costs O(slots) regardless of how long the replay has been
+ * running already.
+ *
+ * Every --interval seconds (and at EOF) the following files are
+ * rewritten atomically, then "REFRESH <n> <requests>" is printed:
+ *
+ *   <out>.thrp            time reads/s writes/s
+ *   <out>.thrs            time read_sectors/s write_sectors/s
+ *   <out>.latency         time avg_read avg_write max p99
+ *   <out>.delay           time avg max p99
+ *   <out>.latency.raster  time log10(latency) log10(1+count)
+ *   <out>.status          summary of all requests and errors seen so far
+ *
+ * Usage: tail -c +1 -F <file.replay> | follow.exe [options]
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <sys/time.h>
+
+#define LOG_MIN       -6      // 1 us
+#define LOG_MAX       3       // 1000 s
+#define PER_DECADE    10
+#define BUCKETS       ((LOG_MAX - LOG_MIN) * PER_DECADE)
+#define LINE_MAX_LEN  4096
+#define SLOTS_GROW    1024
+
+struct slot {
+	int          s_count[2];      // reads, writes
+	long long    s_sectors[2];
+	double       s_latency_sum[2];
+	double       s_latency_max;
+	double       s_delay_sum;
+	double       s_delay_max;
+	unsigned int s_latency_bins[BUCKETS];
+	unsigned int s_delay_bins[BUCKETS];
+};
+
+double slot_len = 1.0;
+int interval = 10;
+int raster_width = 400;
+char *out_name = "live";
+
+struct slot *slots = NULL;
+int slot_alloc = 0;
+int slot_count = 0;
+
+long long requests = 0;
+long long errors = 0;
+long long bad_lines = 0;
+double last_stamp = 0.0;
+int refresh_count = 0;
+
+/////////////////////////////////////////////////////////////////
+
+// aggregation
+
+static
+int bucket_of(double val)
+{
+	int res;
+
+	if (val <= 0.0)
+		return 0;
+	res = floor((log10(val) - LOG_MIN) * PER_DECADE);
+	if (res < 0)
+		return 0;
+	if (res >= BUCKETS)
+		return BUCKETS - 1;
+	return res;
+}
+
+static
+double bucket_value(int bucket)
+{
+	return pow(10.0, LOG_MIN + (double)(bucket + 1) / PER_DECADE);
+}
+
+static
+double bins_percentile(const unsigned int *bins, long long total, double percent)
+{
+	long long limit = ceil(total * percent / 100.0);
+	long long sum = 0;
+	int i;
+
+	if (!total)
+		return 0.0;
+	for (i = 0; i < BUCKETS; i++) {
+		sum += bins[i];
+		if (sum >= limit)
+			break;
+	}
+	return bucket_value(i < BUCKETS ? i : BUCKETS - 1);
+}
+
+static
+struct slot *get_slot(int nr)
+{
+	if (nr >= slot_alloc) {
+		int new_alloc = (nr / SLOTS_GROW + 1) * SLOTS_GROW;
+		slots = realloc(slots, new_alloc * sizeof(struct slot));
+		if (!slots) {
+			printf("FATAL ERROR: out of memory\n");
+			exit(-1);
+		}
+		memset(slots + slot_alloc, 0, (new_alloc - slot_alloc) * sizeof(struct slot));
+		slot_alloc = new_alloc;
+	}
+	if (nr >= slot_count)
+		slot_count = nr + 1;
+	return &slots[nr];
+}
+
+static
+void parse_line(const char *line)
+{
+	double start;
+	double delay;
+	double latency;
+	long long sector;
+	int length;
+	char op;
+	int is_write;
+	struct slot *s;
+	int nr;
+
+	if (strstr(line, "ERROR")) {
+		errors++;
+		return;
+	}
+	if (sscanf(line, "%lf ; %lld ; %d ; %c ; %lf ; %lf", &start, &sector, &length, &op, &delay, &latency) != 6) {
+		// headers, INFO lines, etc
+		bad_lines++;
+		return;
+	}
+	is_write = (op == 'W' || op == 'w');
+	start += delay;
+	if (start < 0.0)
+		start = 0.0;
+	nr = start / slot_len;
+	s = get_slot(nr);
+	s->s_count[is_write]++;
+	s->s_sectors[is_write] += length;
+	s->s_latency_sum[is_write] += latency;
+	if (latency > s->s_latency_max)
+		s->s_latency_max = latency;
+	s->s_delay_sum += delay;
+	if (delay > s->s_delay_max)
+		s->s_delay_max = delay;
+	s->s_latency_bins[bucket_of(latency)]++;
+	s->s_delay_bins[bucket_of(delay)]++;
+	requests++;
+	if (start > last_stamp)
+		last_stamp = start;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// output
+
+static
+FILE *open_tmp(const char *suffix, char *tmp_name, char *final_name)
+{
+	FILE *f;
+
+	sprintf(final_name, "%s.%s", out_name, suffix);
+	sprintf(tmp_name, "%s.tmp", final_name);
+	f = fopen(tmp_name, "w");
+	if (!f) {
+		printf("ERROR: cannot create '%s', errno=%d\n", tmp_name, errno);
+	}
+	return f;
+}
+
+static
+void close_tmp(FILE *f, const char *tmp_name, const char *final_name)
+{
+	fclose(f);
+	if (rename(tmp_name, final_name) < 0) {
+		printf("ERROR: cannot rename '%s', errno=%d\n", tmp_name, errno);
+	}
+}
+
+static
+void write_thrp(int sectors)
+{
+	char tmp_name[LINE_MAX_LEN];
+	char final_name[LINE_MAX_LEN];
+	FILE *f = open_tmp(sectors ? "thrs" : "thrp", tmp_name, final_name);
+	int i;
+
+	if (!f)
+		return;
+	for (i = 0; i < slot_count; i++) {
+		struct slot *s = &slots[i];
+		if (sectors)
+			fprintf(f, "%.3f %.3f %.3f\n", i * slot_len, s->s_sectors[0] / slot_len, s->s_sectors[1] / slot_len);
+		else
+			fprintf(f, "%.3f %.3f %.3f\n", i * slot_len, s->s_count[0] / slot_len, s->s_count[1] / slot_len);
+	}
+	close_tmp(f, tmp_name, final_name);
+}
+
+static
+void write_latency(int is_delay)
+{
+	char tmp_name[LINE_MAX_LEN];
+	char final_name[LINE_MAX_LEN];
+	FILE *f = open_tmp(is_delay ? "delay" : "latency", tmp_name, final_name);
+	int i;
+
+	if (!f)
+		return;
+	for (i = 0; i < slot_count; i++) {
+		struct slot *s = &slots[i];
+		long long total = s->s_count[0] + s->s_count[1];
+		if (!total)
+			continue;
+		if (is_delay) {
+			fprintf(f, "%.3f %.9f %.9f %.9f\n",
+				i * slot_len,
+				s->s_delay_sum / total,
+				s->s_delay_max,
+				bins_percentile(s->s_delay_bins, total, 99.0));
+		} else {
+			fprintf(f, "%.3f %.9f %.9f %.9f %.9f\n",
+				i * slot_len,
+				s->s_count[0] ? s->s_latency_sum[0] / s->s_count[0] : 0.0,
+				s->s_count[1] ? s->s_latency_sum[1] / s->s_count[1] : 0.0,
+				s->s_latency_max,
+				bins_percentile(s->s_latency_bins, total, 99.0));
+		}
+	}
+	close_tmp(f, tmp_name, final_name);
+}
+
+static
+void write_raster(void)
+{
+	char tmp_name[LINE_MAX_LEN];
+	char final_name[LINE_MAX_LEN];
+	FILE *f = open_tmp("latency.raster", tmp_name, final_name);
+	unsigned int col[BUCKETS];
+	int group;
+	int i;
+	int j;
+	int k;
+
+	if (!f)
+		return;
+	// merge adjacent slots when there are more than raster_width of them
+	group = (slot_count + raster_width - 1) / raster_width;
+	if (group < 1)
+		group = 1;
+	for (i = 0; i < slot_count; i += group) {
+		memset(col, 0, sizeof(col));
+		for (j = i; j < i + group && j < slot_count; j++) {
+			for (k = 0; k < BUCKETS; k++)
+				col[k] += slots[j].s_latency_bins[k];
+		}
+		for (k = 0; k < BUCKETS; k++)
+			fprintf(f, "%.3f %.2f %.4f\n", i * slot_len, LOG_MIN + (k + 0.5) / PER_DECADE, log10(1.0 + col[k]));
+		fprintf(f, "\n");
+	}
+	close_tmp(f, tmp_name, final_name);
+}
+
+static
+void write_status(int at_eof)
+{
+	char tmp_name[LINE_MAX_LEN];
+	char final_name[LINE_MAX_LEN];
+	FILE *f = open_tmp("status", tmp_name, final_name);
+
+	if (!f)
+		return;
+	fprintf(f, "requests=%lld errors=%lld replay_time=%.3f refresh=%d%s\n",
+		requests, errors, last_stamp, refresh_count, at_eof ? " finished" : "");
+	close_tmp(f, tmp_name, final_name);
+}
+
+static
+void refresh(int at_eof)
+{
+	refresh_count++;
+	write_thrp(0);
+	write_thrp(1);
+	write_latency(0);
+	write_latency(1);
+	write_raster();
+	write_status(at_eof);
+	printf("REFRESH %d %lld\n", refresh_count, requests);
+	fflush(stdout);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+static
+double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static
+void usage(const char *name)
+{
+	printf("usage: tail -c +1 -F <replay> | %s [options]\n"
+	       "  --interval=<sec>   refresh period in wallclock seconds (default 10)\n"
+	       "  --slot=<sec>       aggregation slot of the replay time (default 1)\n"
+	       "  --width=<cols>     max columns of the latency raster (default 400)\n"
+	       "  --out=<prefix>     prefix of the output files (default 'live')\n",
+	       name);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	static char buf[LINE_MAX_LEN * 16];
+	int fill = 0;
+	double next_refresh;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (!strncmp(arg, "--interval=", 11)) {
+			interval = atoi(arg + 11);
+		} else if (!strncmp(arg, "--slot=", 7)) {
+			slot_len = atof(arg + 7);
+		} else if (!strncmp(arg, "--width=", 8)) {
+			raster_width = atoi(arg + 8);
+		} else if (!strncmp(arg, "--out=", 6)) {
+			out_name = arg + 6;
+		} else {
+			printf("ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		}
+	}
+	if (interval <= 0 || slot_len <= 0.0 || raster_width <= 0 || strlen(out_name) > LINE_MAX_LEN - 32)
+		usage(argv[0]);
+
+	/* Use raw read() instead of stdio, such that poll() tells
+	 * the truth about pending input.
+	 */
+	next_refresh = now() + interval;
+	for (;;) {
+		struct pollfd pfd = { .fd = 0, .events = POLLIN };
+		double timeout = next_refresh - now();
+		int status;
+		char *pos;
+		char *nl;
+
+		if (timeout <= 0.0) {
+			refresh(0);
+			next_refresh = now() + interval;
+			continue;
+		}
+		status = poll(&pfd, 1, timeout * 1000 + 1);
+		if (status < 0 && errno == EINTR)
+			continue;
+		if (status <= 0)
+			continue;
+		status = read(0, buf + fill, sizeof(buf) - 1 - fill);
+		if (status < 0 && errno == EINTR)
+			continue;
+		if (status <= 0)
+			break;
+		fill += status;
+		buf[fill] = '\0';
+		pos = buf;
+		while ((nl = strchr(pos, '\n'))) {
+			*nl = '\0';
+			parse_line(pos);
+			pos = nl + 1;
+		}
+		fill -= pos - buf;
+		if (fill >= sizeof(buf) - 1) {
+			// overlong line: drop it
+			bad_lines++;
+			fill = 0;
+		}
+		memmove(buf, pos, fill);
+	}
+	if (fill > 0) {
+		buf[fill] = '\0';
+		parse_line(buf);
+	}
+	refresh(1);
+	return 0;
+}
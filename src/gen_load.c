@@ -0,0 +1,325 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Generates a synthetic .load file from a model fitted by fit_load.exe,
+ * see src/load_model.h for the model.
+ *
+ * The load can be made arbitrarily long (--duration or --count),
+ * faster (--rate), spread over a larger address space (--space), and
+ * multiplied by independent instances of the model (--scale), each one
+ * in its own part of the device. The instances are merged by time.
+ *
+ * Usage: gen_load.exe --model=<model> [options] | gzip > <load.gz>
+ *
+ * The copyright header is prepended by scripts/create_synthetic_load.sh.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "load_model.h"
+
+#define NS 1000000000LL
+
+static struct load_model model;
+static double duration = 0.0;
+static long long count_limit = 0;
+static double rate = 1.0;
+static double space = 1.0;
+static int scale = 1;
+static unsigned long long seed = 0;
+
+struct gen_stream {
+	unsigned long long g_state;
+	long long  g_stamp_ns;
+	int        g_class;
+	int        g_seq;
+	int        g_write;
+	long long  g_end;
+	long long  g_index;
+	long long  g_base;    // start of this instance on the device
+	long long  g_extent;  // size of this instance
+	long long *g_ring_sector;
+	int       *g_ring_length;
+	// the current request
+	long long  g_sector;
+	int        g_length;
+};
+
+static struct gen_stream *streams = NULL;
+
+/////////////////////////////////////////////////////////////////
+
+// random numbers
+
+// same xorshift generator as in random_data.c
+static inline
+unsigned long long next_random(unsigned long long *state)
+{
+	unsigned long long x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 2685821657736338717ULL;
+}
+
+static inline
+double next_uniform(unsigned long long *state)
+{
+	return (next_random(state) >> 11) * (1.0 / (1ULL << 53));
+}
+
+// returns 1 with probability yes / (no + yes)
+static inline
+int next_chance(unsigned long long *state, long long no, long long yes)
+{
+	if (yes <= 0)
+		return 0;
+	return (long long)(next_random(state) % (unsigned long long)(no + yes)) >= no;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// generation
+
+static
+int draw_size(struct gen_stream *st, int is_write)
+{
+	const struct model_dist *d = &model.m_size[is_write];
+	long long length;
+
+	if (!d->d_total)
+		d = &model.m_size[!is_write];
+	length = dist_draw(d, next_random(&st->g_state));
+	return length > 0 ? length : 8;
+}
+
+static
+void gen_next(struct gen_stream *st)
+{
+	unsigned long long *state = &st->g_state;
+	const struct model_dist *gaps = &model.m_gap[st->g_class];
+	long long sector = -1;
+	int length = 0;
+	int is_write;
+	int is_seq;
+	int cls;
+
+	// arrival
+	if (!gaps->d_total)
+		gaps = &model.m_gap_all;
+	cls = dist_draw(gaps, next_random(state));
+	st->g_stamp_ns += llround(model_gap_value(cls, next_uniform(state)) / rate * NS);
+	st->g_class = cls;
+
+	// position and size
+	is_seq = st->g_index && next_chance(state, model.m_seq[st->g_write][st->g_seq][0], model.m_seq[st->g_write][st->g_seq][1]);
+	if (is_seq) {
+		is_write = st->g_write;
+		sector = st->g_end;
+		length = draw_size(st, is_write);
+	} else {
+		if (st->g_index)
+			is_write = next_chance(state, model.m_op[st->g_write][0], model.m_op[st->g_write][1]);
+		else
+			is_write = next_chance(state, model.m_size[0].d_total, model.m_size[1].d_total);
+		if (next_chance(state, model.m_reuse[is_write][0], model.m_reuse[is_write][1]) && model.m_reuse_dist.d_total) {
+			int bucket = dist_draw(&model.m_reuse_dist, next_random(state));
+			long long distance = llround(model_log_value(bucket, next_uniform(state)));
+
+			if (distance < 1)
+				distance = 1;
+			if (distance <= st->g_index && distance <= MODEL_REUSE_MAX) {
+				long long slot = (st->g_index - distance) & (MODEL_REUSE_MAX - 1);
+				sector = st->g_ring_sector[slot];
+				length = st->g_ring_length[slot];
+			}
+		}
+		if (sector < 0) {
+			long long region = dist_draw(&model.m_region, next_random(state));
+			double pos = (region + next_uniform(state)) * (double)(1LL << model.m_region_shift);
+
+			sector = pos * space;
+			if (next_chance(state, model.m_align[0], model.m_align[1]))
+				sector &= ~7LL;
+			length = draw_size(st, is_write);
+		}
+	}
+	if (sector + length > st->g_extent)
+		sector = st->g_extent > length ? (st->g_extent - length) & ~7LL : 0;
+
+	st->g_ring_sector[st->g_index & (MODEL_REUSE_MAX - 1)] = sector;
+	st->g_ring_length[st->g_index & (MODEL_REUSE_MAX - 1)] = length;
+	st->g_index++;
+	st->g_sector = sector;
+	st->g_length = length;
+	st->g_end = sector + length;
+	st->g_seq = is_seq;
+	st->g_write = is_write;
+}
+
+static
+void gen_init(void)
+{
+	long long extent = ((long long)((model.m_max_sector + 1) * space) + 2047) & ~2047LL;
+	int i;
+
+	streams = calloc(scale, sizeof(struct gen_stream));
+	if (!streams) {
+		fprintf(stderr, "FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	for (i = 0; i < scale; i++) {
+		struct gen_stream *st = &streams[i];
+		unsigned long long mix = (seed + i + 1) * 0x9e3779b97f4a7c15ULL;
+
+		mix ^= mix >> 31;
+		st->g_state = mix ? mix : 1;
+		st->g_base = i * extent;
+		st->g_extent = extent;
+		st->g_ring_sector = malloc(MODEL_REUSE_MAX * sizeof(long long));
+		st->g_ring_length = malloc(MODEL_REUSE_MAX * sizeof(int));
+		if (!st->g_ring_sector || !st->g_ring_length) {
+			fprintf(stderr, "FATAL ERROR: out of memory\n");
+			exit(-1);
+		}
+		gen_next(st);
+	}
+}
+
+static
+long long gen_output(FILE *out)
+{
+	long long limit_ns = duration * NS;
+	long long count = 0;
+	long long last_ns = 0;
+
+	while (!count_limit || count < count_limit) {
+		struct gen_stream *best = &streams[0];
+		int i;
+
+		for (i = 1; i < scale; i++) {
+			if (streams[i].g_stamp_ns < best->g_stamp_ns)
+				best = &streams[i];
+		}
+		if (!count_limit && best->g_stamp_ns > limit_ns)
+			break;
+		fprintf(out, "%7lld.%09lld ; %12lld ; %4d ; %c ; 0.0 ; 0.0\n",
+			best->g_stamp_ns / NS, best->g_stamp_ns % NS,
+			best->g_base + best->g_sector, best->g_length,
+			best->g_write ? 'W' : 'R');
+		last_ns = best->g_stamp_ns;
+		count++;
+		gen_next(best);
+	}
+	duration = (double)last_ns / NS;
+	return count;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s --model=<file> [options] > <load>\n"
+		"  --duration=<seconds>  length of the load (default: as the original)\n"
+		"  --count=<requests>    number of requests instead of a duration\n"
+		"  --rate=<factor>       speed up the arrivals (default 1)\n"
+		"  --space=<factor>      spread the positions (default 1)\n"
+		"  --scale=<instances>   independent instances side by side (default 1)\n"
+		"  --seed=<number>       (default 0)\n",
+		name);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	char *model_file = NULL;
+	FILE *inp;
+	long long count;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (!strncmp(arg, "--model=", 8)) {
+			model_file = arg + 8;
+		} else if (!strncmp(arg, "--duration=", 11)) {
+			duration = atof(arg + 11);
+		} else if (!strncmp(arg, "--count=", 8)) {
+			count_limit = atoll(arg + 8);
+		} else if (!strncmp(arg, "--rate=", 7)) {
+			rate = atof(arg + 7);
+		} else if (!strncmp(arg, "--space=", 8)) {
+			space = atof(arg + 8);
+		} else if (!strncmp(arg, "--scale=", 8)) {
+			scale = atoi(arg + 8);
+		} else if (!strncmp(arg, "--seed=", 7)) {
+			seed = strtoull(arg + 7, NULL, 0);
+		} else {
+			fprintf(stderr, "ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		}
+	}
+	if (!model_file || rate <= 0.0 || space <= 0.0 || scale < 1 || duration < 0.0 || count_limit < 0)
+		usage(argv[0]);
+
+	inp = strcmp(model_file, "-") ? fopen(model_file, "r") : stdin;
+	if (!inp) {
+		fprintf(stderr, "ERROR: cannot open model '%s'\n", model_file);
+		exit(-1);
+	}
+	if (model_load(&model, inp) < 0) {
+		fprintf(stderr, "ERROR: bad model file '%s'\n", model_file);
+		exit(-1);
+	}
+	if (inp != stdin)
+		fclose(inp);
+	if (model.m_duration <= 0.0 && !count_limit) {
+		// all gaps are 0, so the time would never advance
+		if (duration > 0.0 || model.m_requests <= 0) {
+			fprintf(stderr, "ERROR: model '%s' has no duration, please give --count\n", model_file);
+			exit(-1);
+		}
+		count_limit = model.m_requests;
+	}
+	if (!duration && !count_limit)
+		duration = model.m_duration / rate;
+
+	gen_init();
+	printf("start ; sector; length ; op ;  replay_delay=0 ; replay_duration=0\n");
+	count = gen_output(stdout);
+	fprintf(stderr, "INFO: generated %lld requests, %d instances, duration %.3f s\n", count, scale, duration);
+	for (i = 0; i < scale; i++) {
+		free(streams[i].g_ring_sector);
+		free(streams[i].g_ring_length);
+	}
+	free(streams);
+	model_free(&model);
+	return 0;
+}
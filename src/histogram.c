@@ -0,0 +1,251 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "histogram.h"
+
+#if !HAVE_DECL_EXP10
+# define exp10(x) (exp((x) * log(10)))
+#endif
+
+#define HIST_MAGIC "BLKHIST1"
+
+void hist_init(struct histogram *h, double subdiv)
+{
+	memset(h, 0, sizeof(*h));
+	h->h_subdiv = subdiv > 0 ? subdiv : HIST_DEFAULT_SUBDIV;
+}
+
+void hist_free(struct histogram *h)
+{
+	free(h->h_count);
+	h->h_count = NULL;
+	h->h_alloc = 0;
+	h->h_min = h->h_max = 0;
+	h->h_total = 0;
+}
+
+/* Make sure that the bucket is inside the allocated range.
+ */
+static
+void hist_grow(struct histogram *h, int bucket)
+{
+	if (!h->h_alloc) {
+		h->h_alloc = 256;
+		h->h_base = bucket - h->h_alloc / 2;
+		h->h_count = calloc(h->h_alloc, sizeof(long long));
+		if (!h->h_count)
+			goto oom;
+		h->h_min = bucket;
+		h->h_max = bucket + 1;
+	}
+	while (bucket < h->h_base || bucket >= h->h_base + h->h_alloc) {
+		long long *new = calloc(h->h_alloc * 2, sizeof(long long));
+		int shift = bucket < h->h_base ? h->h_alloc : 0;
+
+		if (!new)
+			goto oom;
+		memcpy(new + shift, h->h_count, h->h_alloc * sizeof(long long));
+		free(h->h_count);
+		h->h_count = new;
+		h->h_base -= shift;
+		h->h_alloc *= 2;
+	}
+	return;
+
+oom:
+	printf("FATAL ERROR: out of memory\n");
+	exit(-1);
+}
+
+void hist_add(struct histogram *h, int bucket, long long count)
+{
+	if (bucket < -HIST_MAX_BUCKET || bucket >= HIST_MAX_BUCKET) {
+		h->h_ignored += count;
+		return;
+	}
+	hist_grow(h, bucket);
+	h->h_count[bucket - h->h_base] += count;
+	h->h_total += count;
+
+	if (bucket < h->h_min)
+		h->h_min = bucket;
+	if (bucket >= h->h_max)
+		h->h_max = bucket + 1;
+}
+
+void hist_put(struct histogram *h, double val)
+{
+	if (val <= 0) {
+		h->h_ignored++;
+		return;
+	}
+	hist_add(h, log10(val) * h->h_subdiv, 1);
+}
+
+int hist_merge(struct histogram *dst, const struct histogram *src)
+{
+	int i;
+
+	if (dst->h_subdiv != src->h_subdiv)
+		return -1;
+	for (i = src->h_min; i < src->h_max; i++) {
+		long long count = src->h_count[i - src->h_base];
+
+		if (count)
+			hist_add(dst, i, count);
+	}
+	dst->h_ignored += src->h_ignored;
+	return 0;
+}
+
+double hist_value(const struct histogram *h, int bucket)
+{
+	return exp10((double)bucket / h->h_subdiv);
+}
+
+/* Returns the value of the bucket where the given percentage of all
+ * values is reached, thus precise up to the bucket resolution.
+ */
+double hist_percentile(const struct histogram *h, double percent)
+{
+	long long limit = ceil(h->h_total * percent / 100.0);
+	long long sum = 0;
+	int i;
+
+	if (!h->h_total)
+		return 0.0;
+	if (limit < 1)
+		limit = 1;
+	for (i = h->h_min; i < h->h_max; i++) {
+		sum += h->h_count[i - h->h_base];
+		if (sum >= limit)
+			break;
+	}
+	if (i >= h->h_max)
+		i = h->h_max - 1;
+	return hist_value(h, i);
+}
+
+void hist_print(const struct histogram *h, FILE *out)
+{
+	int i;
+
+	for (i = h->h_min; i < h->h_max; i++) {
+		fprintf(out, "%le %6lld\n", hist_value(h, i), h->h_count[i - h->h_base]);
+	}
+}
+
+/////////////////////////////////////////////////////////////////
+
+// binary format
+
+/* All numbers are stored as 64bit little endian, independent from
+ * the host. The subdivision is stored in units of 1/1000000.
+ */
+
+static
+int put_u64(FILE *out, unsigned long long val)
+{
+	unsigned char buf[8];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		buf[i] = val & 0xff;
+		val >>= 8;
+	}
+	return fwrite(buf, sizeof(buf), 1, out) == 1 ? 0 : -1;
+}
+
+static
+int get_u64(FILE *in, unsigned long long *val)
+{
+	unsigned char buf[8];
+	int i;
+
+	if (fread(buf, sizeof(buf), 1, in) != 1)
+		return -1;
+	*val = 0;
+	for (i = 7; i >= 0; i--)
+		*val = (*val << 8) | buf[i];
+	return 0;
+}
+
+int hist_save(const struct histogram *h, FILE *out)
+{
+	int i;
+
+	if (fwrite(HIST_MAGIC, 8, 1, out) != 1 ||
+	    put_u64(out, llrint(h->h_subdiv * 1000000.0)) ||
+	    put_u64(out, (long long)h->h_min) ||
+	    put_u64(out, (long long)h->h_max) ||
+	    put_u64(out, h->h_ignored))
+		return -1;
+	for (i = h->h_min; i < h->h_max; i++) {
+		if (put_u64(out, h->h_count[i - h->h_base]))
+			return -1;
+	}
+	return 0;
+}
+
+/* Adds one saved histogram to h, which must have been initialized.
+ * When h is still empty, it takes over the subdivision of the file.
+ * Returns 1 at EOF, and < 0 on errors.
+ */
+int hist_load(struct histogram *h, FILE *in)
+{
+	char magic[8];
+	unsigned long long subdiv;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long ignored;
+	long long i;
+
+	if (fread(magic, sizeof(magic), 1, in) != 1)
+		return 1;
+	if (memcmp(magic, HIST_MAGIC, sizeof(magic)) ||
+	    get_u64(in, &subdiv) ||
+	    get_u64(in, &min) ||
+	    get_u64(in, &max) ||
+	    get_u64(in, &ignored))
+		return -1;
+	if (!h->h_total && !h->h_ignored)
+		h->h_subdiv = subdiv / 1000000.0;
+	if (llrint(h->h_subdiv * 1000000.0) != (long long)subdiv)
+		return -2;
+	if ((long long)min < -HIST_MAX_BUCKET || (long long)max > HIST_MAX_BUCKET || (long long)min > (long long)max)
+		return -1;
+	for (i = (long long)min; i < (long long)max; i++) {
+		unsigned long long count;
+
+		if (get_u64(in, &count))
+			return -1;
+		if (count)
+			hist_add(h, i, count);
+	}
+	h->h_ignored += ignored;
+	return 0;
+}
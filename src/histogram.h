@@ -0,0 +1,64 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/* Logarithmic histograms as used by bins.exe and analyze.exe.
+ *
+ * A value v > 0 falls into bucket (int)(log10(v) * subdiv), so there
+ * are subdiv buckets per decade. Only the range of buckets actually
+ * hit is allocated, typically a few hundred counters.
+ *
+ * Partial histograms can be saved in a portable binary format and
+ * merged later, e.g. across several runs or hosts.
+ */
+
+#define HIST_DEFAULT_SUBDIV 10.0
+#define HIST_MAX_BUCKET     (1024 * 1024 * 4)
+
+struct histogram {
+	long long *h_count;
+	int        h_base;    // bucket number of h_count[0]
+	int        h_alloc;
+	int        h_min;     // range of used buckets, h_min <= b < h_max
+	int        h_max;
+	double     h_subdiv;
+	long long  h_total;
+	long long  h_ignored; // values <= 0 or out of range
+};
+
+extern void hist_init(struct histogram *h, double subdiv);
+extern void hist_free(struct histogram *h);
+
+extern void hist_put(struct histogram *h, double val);
+extern void hist_add(struct histogram *h, int bucket, long long count);
+extern int hist_merge(struct histogram *dst, const struct histogram *src);
+
+extern double hist_value(const struct histogram *h, int bucket);
+extern double hist_percentile(const struct histogram *h, double percent);
+
+// text output as "<value> <count>" lines
+extern void hist_print(const struct histogram *h, FILE *out);
+
+// binary partials, return 0 on success
+extern int hist_save(const struct histogram *h, FILE *out);
+extern int hist_load(struct histogram *h, FILE *in);
+
+#endif
@@ -0,0 +1,60 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+/* Interface between the blkreplay workers and the engines doing the IO.
+ *
+ * Each worker process opens all devices via be_open(), and then
+ * executes one request at a time by be_submit() followed by be_reap().
+ * Synchronous engines may do all the work in be_submit(), asynchronous
+ * ones may start the IO there and wait for it in be_reap().
+ *
+ * External backends can be loaded by --io-backend=<file.so>. The shared
+ * object must export a symbol BACKEND_SYMBOL of type struct io_backend.
+ */
+
+#define BACKEND_SYMBOL "blkreplay_backend"
+
+struct io_req {
+	long long io_pos;      // in bytes
+	void     *io_buffer;   // aligned to 4096
+	int       io_len;      // in bytes
+	int       io_write;
+	int       io_status;   // transferred bytes, or < 0 with errno set
+	void     *io_private;  // free for use by the backend
+};
+
+struct io_backend {
+	const char *be_name;
+	const char *be_descr;
+	int         be_has_data; // 0 = no data is transferred, results are FAKE
+	/* Returns a handle >= 0, and the size of the device in bytes.
+	 * flags are the open() flags blkreplay would use.
+	 */
+	int       (*be_open)(const char *name, int flags, long long *size);
+	// returns < 0 when the request could not be started
+	int       (*be_submit)(int handle, struct io_req *req);
+	// waits for the completion, returns req->io_status
+	int       (*be_reap)(int handle, struct io_req *req);
+	void      (*be_close)(int handle);
+};
+
+#endif
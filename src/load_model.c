@@ -0,0 +1,343 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "load_model.h"
+
+#if !HAVE_DECL_EXP10
+# define exp10(x) (exp((x) * log(10)))
+#endif
+
+static
+void *model_realloc(void *ptr, size_t size)
+{
+	void *res = realloc(ptr, size);
+
+	if (!res && size) {
+		fprintf(stderr, "FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	return res;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// empirical distributions
+
+static
+unsigned int dist_hash(long long value)
+{
+	unsigned long long x = value;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static
+void dist_reindex(struct model_dist *d)
+{
+	int i;
+
+	d->d_index_size = d->d_index_size ? d->d_index_size * 2 : 64;
+	free(d->d_index);
+	d->d_index = model_realloc(NULL, d->d_index_size * sizeof(int));
+	memset(d->d_index, -1, d->d_index_size * sizeof(int));
+	for (i = 0; i < d->d_count; i++) {
+		unsigned int pos = dist_hash(d->d_value[i]) & (d->d_index_size - 1);
+		while (d->d_index[pos] >= 0)
+			pos = (pos + 1) & (d->d_index_size - 1);
+		d->d_index[pos] = i;
+	}
+}
+
+void dist_add(struct model_dist *d, long long value, long long weight)
+{
+	unsigned int pos;
+
+	if (d->d_count * 2 >= d->d_index_size)
+		dist_reindex(d);
+	pos = dist_hash(value) & (d->d_index_size - 1);
+	while (d->d_index[pos] >= 0) {
+		if (d->d_value[d->d_index[pos]] == value) {
+			d->d_weight[d->d_index[pos]] += weight;
+			d->d_total += weight;
+			return;
+		}
+		pos = (pos + 1) & (d->d_index_size - 1);
+	}
+	if (d->d_count >= d->d_alloc) {
+		d->d_alloc = d->d_alloc ? d->d_alloc * 2 : 16;
+		d->d_value = model_realloc(d->d_value, d->d_alloc * sizeof(long long));
+		d->d_weight = model_realloc(d->d_weight, d->d_alloc * sizeof(long long));
+	}
+	d->d_value[d->d_count] = value;
+	d->d_weight[d->d_count] = weight;
+	d->d_index[pos] = d->d_count++;
+	d->d_total += weight;
+}
+
+static long long *sort_value;
+
+static
+int dist_compare(const void *a, const void *b)
+{
+	long long va = sort_value[*(const int *)a];
+	long long vb = sort_value[*(const int *)b];
+
+	return va < vb ? -1 : va > vb;
+}
+
+void dist_finish(struct model_dist *d)
+{
+	long long *value;
+	long long *weight;
+	long long sum = 0;
+	int *order;
+	int i;
+
+	if (d->d_finished)
+		return;
+	order = model_realloc(NULL, (d->d_count + 1) * sizeof(int));
+	value = model_realloc(NULL, (d->d_count + 1) * sizeof(long long));
+	weight = model_realloc(NULL, (d->d_count + 1) * sizeof(long long));
+	for (i = 0; i < d->d_count; i++)
+		order[i] = i;
+	sort_value = d->d_value;
+	qsort(order, d->d_count, sizeof(int), dist_compare);
+	for (i = 0; i < d->d_count; i++) {
+		sum += d->d_weight[order[i]];
+		value[i] = d->d_value[order[i]];
+		weight[i] = sum;
+	}
+	free(order);
+	free(d->d_value);
+	free(d->d_weight);
+	free(d->d_index);
+	d->d_value = value;
+	d->d_weight = weight;
+	d->d_index = NULL;
+	d->d_index_size = 0;
+	d->d_alloc = d->d_count;
+	d->d_finished = 1;
+}
+
+long long dist_draw(const struct model_dist *d, unsigned long long rnd)
+{
+	long long target;
+	int lo = 0;
+	int hi = d->d_count - 1;
+
+	if (!d->d_total)
+		return 0;
+	target = rnd % d->d_total;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (d->d_weight[mid] > target)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return d->d_value[lo];
+}
+
+void dist_free(struct model_dist *d)
+{
+	free(d->d_value);
+	free(d->d_weight);
+	free(d->d_index);
+	memset(d, 0, sizeof(*d));
+}
+
+static
+long long dist_weight(const struct model_dist *d, int i)
+{
+	if (!d->d_finished)
+		return d->d_weight[i];
+	return d->d_weight[i] - (i ? d->d_weight[i - 1] : 0);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// log classes
+
+int model_log_bucket(double val)
+{
+	return floor(log10(val) * MODEL_SUBDIV);
+}
+
+double model_log_value(int bucket, double u)
+{
+	return exp10((bucket + u) / MODEL_SUBDIV);
+}
+
+int model_gap_class(double gap)
+{
+	int bucket;
+
+	if (gap <= 0.0)
+		return 0;
+	bucket = model_log_bucket(gap);
+	if (bucket < MODEL_GAP_MIN)
+		bucket = MODEL_GAP_MIN;
+	if (bucket > MODEL_GAP_MAX)
+		bucket = MODEL_GAP_MAX;
+	return bucket - MODEL_GAP_MIN + 1;
+}
+
+double model_gap_value(int cls, double u)
+{
+	if (cls <= 0)
+		return 0.0;
+	return model_log_value(cls - 1 + MODEL_GAP_MIN, u);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// model
+
+void model_init(struct load_model *m)
+{
+	memset(m, 0, sizeof(*m));
+}
+
+void model_free(struct load_model *m)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		dist_free(&m->m_size[i]);
+	dist_free(&m->m_reuse_dist);
+	dist_free(&m->m_region);
+	for (i = 0; i < MODEL_GAP_CLASSES; i++)
+		dist_free(&m->m_gap[i]);
+	dist_free(&m->m_gap_all);
+}
+
+void model_finish(struct load_model *m)
+{
+	int i;
+	int k;
+
+	dist_free(&m->m_gap_all);
+	for (i = 0; i < MODEL_GAP_CLASSES; i++) {
+		for (k = 0; k < m->m_gap[i].d_count; k++)
+			dist_add(&m->m_gap_all, m->m_gap[i].d_value[k], dist_weight(&m->m_gap[i], k));
+		dist_finish(&m->m_gap[i]);
+	}
+	dist_finish(&m->m_gap_all);
+	for (i = 0; i < 2; i++)
+		dist_finish(&m->m_size[i]);
+	dist_finish(&m->m_reuse_dist);
+	dist_finish(&m->m_region);
+}
+
+static
+void save_dist(FILE *out, const char *name, const struct model_dist *d)
+{
+	int i;
+
+	for (i = 0; i < d->d_count; i++)
+		fprintf(out, "%s %lld %lld\n", name, d->d_value[i], dist_weight(d, i));
+}
+
+int model_save(struct load_model *m, FILE *out)
+{
+	char name[32];
+	int i;
+
+	fprintf(out, "# blkreplay load model, see src/load_model.h\n");
+	fprintf(out, "model %d\n", MODEL_VERSION);
+	fprintf(out, "requests %lld\n", m->m_requests);
+	fprintf(out, "duration %.9f\n", m->m_duration);
+	fprintf(out, "max_sector %lld\n", m->m_max_sector);
+	fprintf(out, "region_shift %d\n", m->m_region_shift);
+	for (i = 0; i < 2; i++)
+		fprintf(out, "seq_%c %lld %lld %lld %lld\n", i ? 'W' : 'R', m->m_seq[i][0][0], m->m_seq[i][0][1], m->m_seq[i][1][0], m->m_seq[i][1][1]);
+	fprintf(out, "op %lld %lld %lld %lld\n", m->m_op[0][0], m->m_op[0][1], m->m_op[1][0], m->m_op[1][1]);
+	fprintf(out, "reuse %lld %lld %lld %lld\n", m->m_reuse[0][0], m->m_reuse[0][1], m->m_reuse[1][0], m->m_reuse[1][1]);
+	fprintf(out, "align %lld %lld\n", m->m_align[0], m->m_align[1]);
+	save_dist(out, "size_R", &m->m_size[0]);
+	save_dist(out, "size_W", &m->m_size[1]);
+	save_dist(out, "reuse_dist", &m->m_reuse_dist);
+	save_dist(out, "region", &m->m_region);
+	for (i = 0; i < MODEL_GAP_CLASSES; i++) {
+		snprintf(name, sizeof(name), "gap %d", i);
+		save_dist(out, name, &m->m_gap[i]);
+	}
+	return ferror(out) ? -1 : 0;
+}
+
+int model_load(struct load_model *m, FILE *in)
+{
+	char line[256];
+	int version = 0;
+
+	model_init(m);
+	while (fgets(line, sizeof(line), in)) {
+		long long a, b, c, d;
+		char op;
+		int cls;
+		int i;
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "model %d", &version) == 1) {
+			if (version != MODEL_VERSION)
+				return -1;
+		} else if (sscanf(line, "requests %lld", &m->m_requests) == 1) {
+		} else if (sscanf(line, "duration %lf", &m->m_duration) == 1) {
+		} else if (sscanf(line, "max_sector %lld", &m->m_max_sector) == 1) {
+		} else if (sscanf(line, "region_shift %d", &m->m_region_shift) == 1) {
+		} else if (sscanf(line, "seq_%c %lld %lld %lld %lld", &op, &a, &b, &c, &d) == 5 && (op == 'R' || op == 'W')) {
+			i = op == 'W';
+			m->m_seq[i][0][0] = a; m->m_seq[i][0][1] = b; m->m_seq[i][1][0] = c; m->m_seq[i][1][1] = d;
+		} else if (sscanf(line, "op %lld %lld %lld %lld", &a, &b, &c, &d) == 4) {
+			m->m_op[0][0] = a; m->m_op[0][1] = b; m->m_op[1][0] = c; m->m_op[1][1] = d;
+		} else if (sscanf(line, "reuse %lld %lld %lld %lld", &a, &b, &c, &d) == 4) {
+			m->m_reuse[0][0] = a; m->m_reuse[0][1] = b; m->m_reuse[1][0] = c; m->m_reuse[1][1] = d;
+		} else if (sscanf(line, "align %lld %lld", &a, &b) == 2) {
+			m->m_align[0] = a; m->m_align[1] = b;
+		} else if (sscanf(line, "size_R %lld %lld", &a, &b) == 2) {
+			dist_add(&m->m_size[0], a, b);
+		} else if (sscanf(line, "size_W %lld %lld", &a, &b) == 2) {
+			dist_add(&m->m_size[1], a, b);
+		} else if (sscanf(line, "reuse_dist %lld %lld", &a, &b) == 2) {
+			dist_add(&m->m_reuse_dist, a, b);
+		} else if (sscanf(line, "region %lld %lld", &a, &b) == 2) {
+			dist_add(&m->m_region, a, b);
+		} else if (sscanf(line, "gap %d %lld %lld", &cls, &a, &b) == 3 && cls >= 0 && cls < MODEL_GAP_CLASSES) {
+			dist_add(&m->m_gap[cls], a, b);
+		} else {
+			return -1;
+		}
+	}
+	if (version != MODEL_VERSION || !m->m_requests)
+		return -1;
+	model_finish(m);
+	return 0;
+}
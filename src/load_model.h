@@ -0,0 +1,101 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef LOAD_MODEL_H
+#define LOAD_MODEL_H
+
+/* Compact statistical model of a load, fitted by fit_load.exe and
+ * used by gen_load.exe for generating loads of any length and scale.
+ *
+ * Each request is classified in this order:
+ *   sequential: starts at the end of the previous request, with the
+ *               same operation. A 2-state Markov chain per operation
+ *               gives the runs.
+ *   reuse:      the start sector was used before, at most
+ *               MODEL_REUSE_MAX requests ago. The distance is taken
+ *               from a log histogram, and the old request is repeated.
+ *   new:        the position is drawn from a histogram over
+ *               MODEL_REGIONS regions of the device, uniformly inside
+ *               the region, and aligned to 8 sectors like the original.
+ * The operation of the non-sequential requests is a 2-state Markov
+ * chain, the request sizes are drawn per operation. The arrival
+ * process is a Markov chain over logarithmic classes of the gaps
+ * between requests, which retains bursts and idle phases.
+ *
+ * The model is saved as text, one table entry per line.
+ */
+
+#define MODEL_VERSION    1
+#define MODEL_SUBDIV     10.0  // buckets per decade of the log histograms
+#define MODEL_GAP_MIN    -90   // 1 ns
+#define MODEL_GAP_MAX    60    // 1e6 s
+#define MODEL_GAP_CLASSES (MODEL_GAP_MAX - MODEL_GAP_MIN + 2) // class 0 = no gap
+#define MODEL_REUSE_MAX  (1 << 18)
+#define MODEL_REGIONS    4096
+
+// empirical distribution over integer values
+struct model_dist {
+	long long *d_value;
+	long long *d_weight;  // after dist_finish(): cumulative
+	int        d_count;
+	int        d_alloc;
+	int       *d_index;   // hash index value -> position, while filling
+	int        d_index_size;
+	long long  d_total;
+	int        d_finished;
+};
+
+struct load_model {
+	long long m_requests;
+	double    m_duration;      // sum of the gaps
+	long long m_max_sector;
+	int       m_region_shift;  // regions of 2^shift sectors
+	long long m_seq[2][2][2];  // [previous is write][previous is sequential][this is sequential]
+	long long m_op[2][2];      // [previous is write][this is write], non-sequential only
+	long long m_reuse[2][2];   // [is write][is reuse], non-sequential only
+	long long m_align[2];      // new positions [unaligned, aligned to 8]
+	struct model_dist m_size[2];   // per operation, 0 = read
+	struct model_dist m_reuse_dist;
+	struct model_dist m_region;
+	struct model_dist m_gap[MODEL_GAP_CLASSES]; // per previous class
+	struct model_dist m_gap_all;   // marginal, for unseen classes
+};
+
+extern void dist_add(struct model_dist *d, long long value, long long weight);
+// sorts by value and prepares dist_draw()
+extern void dist_finish(struct model_dist *d);
+// rnd is a uniform 64 bit random number
+extern long long dist_draw(const struct model_dist *d, unsigned long long rnd);
+extern void dist_free(struct model_dist *d);
+
+extern int model_gap_class(double gap);
+// inverse of model_gap_class(), u in [0,1) selects inside the class
+extern double model_gap_value(int cls, double u);
+extern int model_log_bucket(double val);
+extern double model_log_value(int bucket, double u);
+
+extern void model_init(struct load_model *m);
+extern void model_free(struct load_model *m);
+// returns 0 on success
+extern int model_save(struct load_model *m, FILE *out);
+extern int model_load(struct load_model *m, FILE *in);
+// computes the marginals and finishes all distributions
+extern void model_finish(struct load_model *m);
+
+#endif
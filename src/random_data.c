@@ -21,6 +21,13 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
 
 #ifdef STDC_HEADERS
 # include <stdlib.h>
@@ -35,40 +42,253 @@
 # include <unistd.h>
 #endif
 
-#if HAVE_DECL_RANDOM
-# define TYPE long int
-#else
-# define TYPE int
-# define random rand
+/* Infinitely create random data on stdout, until some error occurs,
+ * or until --size is reached.
+ *
+ * Each thread fills its own blocks with a xorshift generator and
+ * writes them to stdout independently. The order of the blocks
+ * does not matter for random data.
+ *
+ * When stdout is a pipe, vmsplice() hands the pages to the pipe
+ * without copying. The pipe keeps references to them, so a buffer
+ * may be refilled while the reader has not yet consumed it. This
+ * is harmless here: the reader just gets different random data.
+ * Each thread cycles through BUFFERS buffers to make that rare.
+ */
+
+#define DEFAULT_BLOCK (1024 * 1024)
+#define BUFFERS       4
+#define UNIT          4096
+
+int thread_count = 0;
+long long block_size = DEFAULT_BLOCK;
+long long size_limit = 0;
+int compress_percent = 0;
+unsigned long long seed = 0;
+
+int use_splice = 1;
+
+volatile long long remaining = 0;
+volatile long long count = 0;
+volatile int stop = 0;
+
+/////////////////////////////////////////////////////////////////
+
+// fast PRNG
+
+/* xorshift64* from Marsaglia / Vigna, plenty for filling devices.
+ */
+static inline
+unsigned long long next_random(unsigned long long *state)
+{
+	unsigned long long x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 2685821657736338717ULL;
+}
+
+/* Only the first part of each UNIT is random, the rest stays
+ * zero, giving roughly compress_percent for compressors.
+ */
+static
+void fill_block(void *buf, unsigned long long *state)
+{
+	int random_len = UNIT - UNIT * compress_percent / 100;
+	long long pos;
+
+	random_len &= ~(sizeof(unsigned long long) - 1);
+	for (pos = 0; pos < block_size; pos += UNIT) {
+		unsigned long long *ptr = buf + pos;
+		int i;
+
+		for (i = 0; i < random_len / sizeof(unsigned long long); i++)
+			ptr[i] = next_random(state);
+	}
+}
+
+/////////////////////////////////////////////////////////////////
+
+// output
+
+static
+int output(void *buf, long long len)
+{
+	while (len > 0 && !stop) {
+		ssize_t status = -1;
+
+#if HAVE_DECL_VMSPLICE
+		if (use_splice) {
+			struct iovec iov = {
+				.iov_base = buf,
+				.iov_len  = len,
+			};
+
+			status = vmsplice(1, &iov, 1, 0);
+			if (status < 0 && (errno == EBADF || errno == EINVAL)) {
+				// not a pipe
+				use_splice = 0;
+				continue;
+			}
+		} else
 #endif
+			status = write(1, buf, len);
+		if (status <= 0) {
+			if (status < 0 && errno == EINTR)
+				continue;
+			return -1;
+		}
+		__sync_fetch_and_add(&count, (long long)status);
+		buf += status;
+		len -= status;
+	}
+	return 0;
+}
 
-/* Infinitely create random data on stdout, until some error occurs.
+/* Claim the next piece of the output. Returns 0 when done.
  */
+static
+long long claim(void)
+{
+	long long old;
 
-#define SIZE (1024 * 1024)
+	if (stop)
+		return 0;
+	if (!size_limit)
+		return block_size;
+	old = __sync_fetch_and_sub(&remaining, block_size);
+	if (old <= 0)
+		return 0;
+	return old < block_size ? old : block_size;
+}
 
-int main(int argc, char *argv[])
+static
+void *worker(void *data)
 {
-	static char buf[SIZE];
+	unsigned long long state = *(unsigned long long *)data;
+	void *bufs[BUFFERS] = {};
+	long long len;
+	int nr = 0;
 	int i;
-	int status;
-	long long count = 0;
-	
-	for (i = 0; i < SIZE / sizeof(TYPE); i++) {
-		TYPE *ptr = (void*)&buf[i * sizeof(TYPE)];
-		*ptr = random();
+
+	for (i = 0; i < BUFFERS; i++) {
+		if (posix_memalign(&bufs[i], UNIT, block_size)) {
+			fprintf(stderr, "ERROR: cannot allocate memory\n");
+			stop = 1;
+			goto done;
+		}
+		memset(bufs[i], 0, block_size);
 	}
 
-	do {
-		for (i = 0; i < SIZE / sizeof(TYPE); i += 512 / sizeof(TYPE)) {
-			TYPE *ptr = (void*)&buf[i * sizeof(TYPE)];
-			*ptr = random();
+	while ((len = claim()) > 0) {
+		fill_block(bufs[nr], &state);
+		if (output(bufs[nr], len) < 0) {
+			stop = 1;
+			break;
 		}
-		status = write(1, buf, sizeof(buf));
-		if (status > 0)
-			count += status;
+		nr = (nr + 1) % BUFFERS;
+	}
+done:
+	for (i = 0; i < BUFFERS; i++)
+		free(bufs[i]);
+	return NULL;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] | dd of=<device> bs=1M iflag=fullblock\n"
+		"  --threads=<count>      generator threads (default: number of CPUs)\n"
+		"  --block=<bytes>        block size, suffix k/m/g allowed (default 1m)\n"
+		"  --size=<bytes>         stop after this amount, suffix k/m/g/t allowed (default: never)\n"
+		"  --compress=<percent>   target compressibility 0..100 (default 0)\n"
+		"  --seed=<number>\n",
+		name);
+	exit(-1);
+}
+
+static
+long long parse_bytes(const char *str)
+{
+	char *end;
+	long long val = strtoll(str, &end, 0);
 
-	} while (status == sizeof(buf));
+	switch (tolower(*end)) {
+	case 't':
+		val *= 1024;
+	case 'g':
+		val *= 1024;
+	case 'm':
+		val *= 1024;
+	case 'k':
+		val *= 1024;
+	}
+	return val;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[256];
+	unsigned long long states[256];
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (!strncmp(arg, "--threads=", 10)) {
+			thread_count = atoi(arg + 10);
+		} else if (!strncmp(arg, "--block=", 8)) {
+			block_size = parse_bytes(arg + 8);
+		} else if (!strncmp(arg, "--size=", 7)) {
+			size_limit = parse_bytes(arg + 7);
+		} else if (!strncmp(arg, "--compress=", 11)) {
+			compress_percent = atoi(arg + 11);
+		} else if (!strncmp(arg, "--seed=", 7)) {
+			seed = strtoull(arg + 7, NULL, 0);
+		} else {
+			fprintf(stderr, "ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		}
+	}
+	if (block_size < UNIT || block_size % UNIT || size_limit < 0 ||
+	    compress_percent < 0 || compress_percent > 100)
+		usage(argv[0]);
+	if (thread_count <= 0)
+		thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (thread_count <= 0)
+		thread_count = 1;
+	if (thread_count > 256)
+		thread_count = 256;
+	if (!seed)
+		seed = time(NULL) ^ ((unsigned long long)getpid() << 32);
+	remaining = size_limit;
+
+#ifdef F_SETPIPE_SZ
+	// larger pipes mean fewer wakeups, failure does not matter
+	fcntl(1, F_SETPIPE_SZ, (int)block_size);
+#endif
+
+	for (i = 0; i < thread_count; i++) {
+		// splitmix64 step, gives well separated nonzero states
+		unsigned long long z = seed + (i + 1) * 0x9e3779b97f4a7c15ULL;
+
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		z ^= z >> 31;
+		states[i] = z ? z : 1;
+		if (pthread_create(&threads[i], NULL, worker, &states[i])) {
+			fprintf(stderr, "ERROR: cannot create thread\n");
+			exit(-1);
+		}
+	}
+	for (i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
 
 	fprintf(stderr,
 		"%s wrote %lld KiBytes (%lld MiBytes, %lld GiBytes)\n",
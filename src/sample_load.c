@@ -0,0 +1,388 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Shrinks a .load file by spatial and / or temporal sampling.
+ *
+ * The selection is done by src/sampling.c, the same code as used by
+ * blkreplay.exe --filter-sample. Lines which are no requests (e.g.
+ * the copyright header) are passed through.
+ *
+ * At the end, the IOPS, the footprint and the average working set
+ * estimated from the sample (scaled by 1 / space rate) are compared
+ * against the full trace on stderr.
+ *
+ * Usage: zcat -f <load> | sample_load.exe [options] > <sampled load>
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "sampling.h"
+
+#define NS 1000000000LL
+
+static struct sampler sampler;
+static double ws_window = 60.0;
+static int quiet = 0;
+
+/////////////////////////////////////////////////////////////////
+
+// sets of block numbers, cleared in O(1) by generation counting
+
+struct block_set {
+	unsigned long long *bs_key;
+	unsigned int       *bs_gen;
+	long long           bs_size;  // power of 2
+	long long           bs_count;
+	unsigned int        bs_current;
+};
+
+static
+void set_alloc(struct block_set *set, long long size)
+{
+	set->bs_key = calloc(size, sizeof(*set->bs_key));
+	set->bs_gen = calloc(size, sizeof(*set->bs_gen));
+	if (!set->bs_key || !set->bs_gen) {
+		fprintf(stderr, "FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+	set->bs_size = size;
+}
+
+static
+unsigned long long set_hash(unsigned long long key)
+{
+	key ^= key >> 31;
+	key *= 0x7fb5d329728ea185ULL;
+	key ^= key >> 27;
+	return key;
+}
+
+static
+void set_insert(struct block_set *set, unsigned long long key);
+
+static
+void set_grow(struct block_set *set)
+{
+	struct block_set old = *set;
+	long long i;
+
+	set_alloc(set, old.bs_size * 2);
+	set->bs_count = 0;
+	for (i = 0; i < old.bs_size; i++) {
+		if (old.bs_gen[i] == old.bs_current)
+			set_insert(set, old.bs_key[i]);
+	}
+	free(old.bs_key);
+	free(old.bs_gen);
+}
+
+static
+void set_insert(struct block_set *set, unsigned long long key)
+{
+	long long mask;
+	long long pos;
+
+	if (!set->bs_size) {
+		set->bs_current = 1;
+		set_alloc(set, 1024);
+	}
+	if (set->bs_count * 2 >= set->bs_size)
+		set_grow(set);
+	mask = set->bs_size - 1;
+	for (pos = set_hash(key) & mask; set->bs_gen[pos] == set->bs_current; pos = (pos + 1) & mask) {
+		if (set->bs_key[pos] == key)
+			return;
+	}
+	set->bs_key[pos] = key;
+	set->bs_gen[pos] = set->bs_current;
+	set->bs_count++;
+}
+
+static
+void set_clear(struct block_set *set)
+{
+	set->bs_count = 0;
+	if (++set->bs_current == 0) { // wrapped around
+		memset(set->bs_gen, 0, set->bs_size * sizeof(*set->bs_gen));
+		set->bs_current = 1;
+	}
+}
+
+/////////////////////////////////////////////////////////////////
+
+// statistics of the full trace and of the sample
+
+struct load_stat {
+	long long ls_requests;
+	double    ls_weight;    // requests, split ones counting by their kept part
+	long long ls_first_ns;
+	long long ls_last_ns;
+	struct block_set ls_footprint;
+	struct block_set ls_ws;
+	long long ls_ws_window;
+	long long ls_ws_count;  // input may go back in time, so count the changes
+	long long ls_ws_sum;
+};
+
+static struct load_stat full_stat = {};
+static struct load_stat sample_stat = {};
+
+static
+void stat_request(struct load_stat *ls, long long stamp_ns, double weight)
+{
+	long long window = stamp_ns > 0 ? stamp_ns / (long long)(ws_window * NS) : 0;
+
+	if (!ls->ls_requests++) {
+		ls->ls_first_ns = stamp_ns;
+		ls->ls_ws_window = window;
+		ls->ls_ws_count = 1;
+	}
+	ls->ls_weight += weight;
+	ls->ls_last_ns = stamp_ns;
+	if (window != ls->ls_ws_window) {
+		ls->ls_ws_sum += ls->ls_ws.bs_count;
+		set_clear(&ls->ls_ws);
+		ls->ls_ws_window = window;
+		ls->ls_ws_count++;
+	}
+}
+
+static
+void stat_blocks(struct load_stat *ls, long long sector, int length)
+{
+	long long block = sector / sampler.s_block;
+	long long last = length > 0 ? (sector + length - 1) / sampler.s_block : block;
+
+	for (; block <= last; block++) {
+		set_insert(&ls->ls_footprint, block);
+		set_insert(&ls->ls_ws, block);
+	}
+}
+
+static
+double stat_iops(struct load_stat *ls)
+{
+	double duration = (double)(ls->ls_last_ns - ls->ls_first_ns) / NS;
+
+	return duration > 0.0 ? ls->ls_weight / duration : 0.0;
+}
+
+static
+double stat_ws(struct load_stat *ls)
+{
+	if (!ls->ls_requests)
+		return 0.0;
+	return (double)(ls->ls_ws_sum + ls->ls_ws.bs_count) / ls->ls_ws_count;
+}
+
+static
+void print_compare(const char *name, const char *unit, double full, double estimate)
+{
+	fprintf(stderr, "INFO: %-10s full=%14.3f %-7s estimate=%14.3f %-7s error=%+8.3f %%\n",
+		name, full, unit, estimate, unit,
+		full > 0.0 ? (estimate - full) / full * 100.0 : 0.0);
+}
+
+static
+void print_summary(void)
+{
+	double scale = 1.0 / sampler.s_space_rate;
+	double mb = sampler.s_block / 2048.0;
+
+	fprintf(stderr, "INFO: space_rate=%f block=%lld rescale=%d time_rate=%f window=%f seed=%llu\n",
+		sampler.s_space_rate, sampler.s_block, sampler.s_rescale,
+		sampler.s_time_rate, sampler.s_window, sampler.s_seed);
+	fprintf(stderr, "INFO: requests full=%lld sampled=%lld (%.3f %%, including split pieces)\n",
+		full_stat.ls_requests, sample_stat.ls_requests,
+		full_stat.ls_requests ? sample_stat.ls_requests * 100.0 / full_stat.ls_requests : 0.0);
+	fprintf(stderr, "INFO: duration full=%.3f s sampled=%.3f s\n",
+		(double)(full_stat.ls_last_ns - full_stat.ls_first_ns) / NS,
+		(double)(sample_stat.ls_last_ns - sample_stat.ls_first_ns) / NS);
+	print_compare("iops", "IOPS", stat_iops(&full_stat), stat_iops(&sample_stat) * scale);
+	print_compare("footprint", "MiB", full_stat.ls_footprint.bs_count * mb, sample_stat.ls_footprint.bs_count * mb * scale);
+	print_compare("workingset", "MiB", stat_ws(&full_stat) * mb, stat_ws(&sample_stat) * mb * scale);
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+/* Parses "<sec>.<frac>" exactly into nanoseconds.
+ */
+static
+int parse_stamp(const char *str, long long *stamp_ns)
+{
+	long long sec = 0;
+	long long frac = 0;
+	int digits = 0;
+
+	while (isspace(*str))
+		str++;
+	if (!isdigit(*str))
+		return 0;
+	while (isdigit(*str))
+		sec = sec * 10 + (*str++ - '0');
+	if (*str == '.') {
+		str++;
+		for (; isdigit(*str); str++) {
+			if (digits < 9) {
+				frac = frac * 10 + (*str - '0');
+				digits++;
+			}
+		}
+	}
+	for (; digits < 9; digits++)
+		frac *= 10;
+	*stamp_ns = sec * NS + frac;
+	return 1;
+}
+
+static
+char *trim(char *str)
+{
+	char *end;
+
+	while (isspace(*str))
+		str++;
+	end = str + strlen(str);
+	while (end > str && isspace(end[-1]))
+		*--end = '\0';
+	return str;
+}
+
+static
+void sample_input(FILE *inp, FILE *out)
+{
+	char line[4096];
+	struct sample_piece pieces[SAMPLE_MAX_PIECES];
+
+	while (fgets(line, sizeof(line), inp)) {
+		char copy[4096];
+		char *field[6] = {};
+		char *save = NULL;
+		long long stamp_ns;
+		long long new_ns;
+		long long sector;
+		int length;
+		char op;
+		int nr;
+		int i;
+
+		strcpy(copy, line);
+		for (nr = 0; nr < 6; nr++) {
+			field[nr] = strtok_r(nr ? NULL : copy, ";", &save);
+			if (!field[nr])
+				break;
+		}
+		if (nr < 4 || !parse_stamp(field[0], &stamp_ns) ||
+		    sscanf(field[1], "%lld", &sector) != 1 ||
+		    sscanf(field[2], "%d", &length) != 1 ||
+		    sscanf(field[3], " %c", &op) != 1) {
+			fputs(line, out);
+			continue;
+		}
+		stat_request(&full_stat, stamp_ns, 1.0);
+		if (!quiet)
+			stat_blocks(&full_stat, sector, length);
+
+		if (!sample_time(&sampler, stamp_ns, &new_ns))
+			continue;
+		nr = sample_space(&sampler, sector, length, pieces, SAMPLE_MAX_PIECES);
+		if (!nr)
+			continue;
+		for (i = 0; i < nr; i++) {
+			char stamp[64];
+
+			/* The pieces are what gets replayed. For the IOPS
+			 * estimate, they count by their part of the request.
+			 */
+			stat_request(&sample_stat, new_ns, length > 0 ? (double)pieces[i].sp_length / length : 1.0);
+			if (!quiet)
+				stat_blocks(&sample_stat, pieces[i].sp_sector, pieces[i].sp_length);
+			if (sampler.s_time_rate >= 1.0)
+				snprintf(stamp, sizeof(stamp), "%s", trim(field[0]));
+			else
+				snprintf(stamp, sizeof(stamp), "%lld.%09lld", new_ns / NS, new_ns % NS);
+			fprintf(out, "%17s ; %12lld ; %4d ; %c ; %s ; %s\n",
+				stamp, pieces[i].sp_sector, pieces[i].sp_length, op,
+				field[4] ? trim(field[4]) : "0.0",
+				field[5] ? trim(field[5]) : "0.0");
+		}
+	}
+}
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: zcat -f <load> | %s [options] > <sampled load>\n"
+		"  --space=<rate>       fraction of the blocks to keep, 0 < rate <= 1 (default 1)\n"
+		"  --block=<sectors>    block size for spatial sampling (default 8)\n"
+		"  --rescale            renumber the kept blocks densely\n"
+		"  --time=<rate>        fraction of the time windows to keep (default 1)\n"
+		"  --window=<seconds>   time window size (default 60)\n"
+		"  --seed=<number>      select a different sample (default 0)\n"
+		"  --ws-window=<seconds> window for the working set summary (default 60)\n"
+		"  --quiet              only count requests, no footprint / working set\n",
+		name);
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	sampler_defaults(&sampler);
+	for (i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		if (!strncmp(arg, "--space=", 8)) {
+			sampler.s_space_rate = atof(arg + 8);
+		} else if (!strncmp(arg, "--block=", 8)) {
+			sampler.s_block = atoll(arg + 8);
+		} else if (!strcmp(arg, "--rescale")) {
+			sampler.s_rescale = 1;
+		} else if (!strncmp(arg, "--time=", 7)) {
+			sampler.s_time_rate = atof(arg + 7);
+		} else if (!strncmp(arg, "--window=", 9)) {
+			sampler.s_window = atof(arg + 9);
+		} else if (!strncmp(arg, "--seed=", 7)) {
+			sampler.s_seed = strtoull(arg + 7, NULL, 0);
+		} else if (!strncmp(arg, "--ws-window=", 12)) {
+			ws_window = atof(arg + 12);
+		} else if (!strcmp(arg, "--quiet")) {
+			quiet = 1;
+		} else {
+			fprintf(stderr, "ERROR: unknown option '%s'\n", arg);
+			usage(argv[0]);
+		}
+	}
+	if (sampler_init(&sampler) < 0 || ws_window <= 0.0)
+		usage(argv[0]);
+
+	sample_input(stdin, stdout);
+	print_summary();
+	sampler_free(&sampler);
+	return 0;
+}
@@ -0,0 +1,218 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sampling.h"
+
+#define SAMPLE_TIME_SALT 0x9e3779b97f4a7c15ULL
+
+void sampler_defaults(struct sampler *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->s_space_rate = 1.0;
+	s->s_block = 8;
+	s->s_time_rate = 1.0;
+	s->s_window = 60.0;
+}
+
+int sampler_parse(struct sampler *s, const char *spec)
+{
+	char *copy = strdup(spec);
+	char *item;
+	char *save = NULL;
+	int status = 0;
+
+	if (!copy)
+		return -1;
+	for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+		if (!strncmp(item, "space=", 6)) {
+			s->s_space_rate = atof(item + 6);
+		} else if (!strncmp(item, "block=", 6)) {
+			s->s_block = atoll(item + 6);
+		} else if (!strncmp(item, "rescale=", 8)) {
+			s->s_rescale = atoi(item + 8);
+		} else if (!strcmp(item, "rescale")) {
+			s->s_rescale = 1;
+		} else if (!strncmp(item, "time=", 5)) {
+			s->s_time_rate = atof(item + 5);
+		} else if (!strncmp(item, "window=", 7)) {
+			s->s_window = atof(item + 7);
+		} else if (!strncmp(item, "seed=", 5)) {
+			s->s_seed = strtoull(item + 5, NULL, 0);
+		} else {
+			status = -1;
+			break;
+		}
+	}
+	free(copy);
+	return status;
+}
+
+int sampler_init(struct sampler *s)
+{
+	if (s->s_space_rate <= 0.0 || s->s_space_rate > 1.0 ||
+	    s->s_time_rate <= 0.0 || s->s_time_rate > 1.0 ||
+	    s->s_block < 1 || s->s_window <= 0.0)
+		return -1;
+	s->s_window_ns = s->s_window * 1000000000.0;
+	if (s->s_window_ns < 1)
+		return -1;
+	memset(&s->s_space, 0, sizeof(s->s_space));
+	memset(&s->s_time, 0, sizeof(s->s_time));
+	s->s_space.r_salt = s->s_seed;
+	s->s_space.r_limit = s->s_space_rate * (1ULL << SAMPLE_BITS);
+	s->s_time.r_salt = s->s_seed ^ SAMPLE_TIME_SALT;
+	s->s_time.r_limit = s->s_time_rate * (1ULL << SAMPLE_BITS);
+	return 0;
+}
+
+void sampler_free(struct sampler *s)
+{
+	free(s->s_space.r_prefix);
+	free(s->s_time.r_prefix);
+	memset(&s->s_space, 0, sizeof(s->s_space));
+	memset(&s->s_time, 0, sizeof(s->s_time));
+}
+
+/////////////////////////////////////////////////////////////////
+
+// selection and ranking
+
+// same as hash_block() in cache_sim.c
+static
+unsigned long long sample_hash(unsigned long long item)
+{
+	item ^= item >> 33;
+	item *= 0xff51afd7ed558ccdULL;
+	item ^= item >> 33;
+	item *= 0xc4ceb9fe1a85ec53ULL;
+	item ^= item >> 33;
+	return item;
+}
+
+static
+int rank_kept(const struct sample_rank *r, long long item)
+{
+	return (sample_hash(item ^ r->r_salt) & ((1ULL << SAMPLE_BITS) - 1)) < r->r_limit;
+}
+
+/* Number of kept items below item. The prefix counts per chunk are
+ * computed lazily, so the cost grows with the highest item seen, and
+ * each lookup hashes at most one chunk.
+ */
+static
+long long rank_of(struct sample_rank *r, long long item)
+{
+	long long chunk = item >> SAMPLE_CHUNK_BITS;
+	long long rank;
+	long long i;
+
+	while (r->r_count <= chunk) {
+		long long prev = r->r_count - 1;
+		long long count = 0;
+
+		if (r->r_count >= r->r_alloc) {
+			long long new_alloc = r->r_alloc ? r->r_alloc * 2 : 1024;
+			long long *new_prefix = realloc(r->r_prefix, new_alloc * sizeof(long long));
+			if (!new_prefix) {
+				printf("FATAL ERROR: out of memory for sampling\n");
+				exit(-1);
+			}
+			r->r_prefix = new_prefix;
+			r->r_alloc = new_alloc;
+		}
+		if (prev >= 0) {
+			count = r->r_prefix[prev];
+			for (i = prev << SAMPLE_CHUNK_BITS; i < (prev + 1) << SAMPLE_CHUNK_BITS; i++)
+				count += rank_kept(r, i);
+		}
+		r->r_prefix[r->r_count++] = count;
+	}
+	rank = r->r_prefix[chunk];
+	for (i = chunk << SAMPLE_CHUNK_BITS; i < item; i++)
+		rank += rank_kept(r, i);
+	return rank;
+}
+
+int sample_block_kept(const struct sampler *s, long long block)
+{
+	return rank_kept(&s->s_space, block);
+}
+
+int sample_time(struct sampler *s, long long stamp_ns, long long *new_ns)
+{
+	long long window;
+
+	if (s->s_time_rate >= 1.0) {
+		*new_ns = stamp_ns;
+		return 1;
+	}
+	window = stamp_ns > 0 ? stamp_ns / s->s_window_ns : 0;
+	if (!rank_kept(&s->s_time, window))
+		return 0;
+	*new_ns = rank_of(&s->s_time, window) * s->s_window_ns + (stamp_ns - window * s->s_window_ns);
+	return 1;
+}
+
+int sample_space(struct sampler *s, long long sector, int length, struct sample_piece *pieces, int max)
+{
+	long long end = sector + length;
+	long long first;
+	long long last;
+	long long block;
+	long long prev = -2;
+	int count = 0;
+
+	if (s->s_space_rate >= 1.0) {
+		pieces[0].sp_sector = sector;
+		pieces[0].sp_length = length;
+		return 1;
+	}
+	if (sector < 0)
+		return 0;
+	first = sector / s->s_block;
+	last = length > 0 ? (end - 1) / s->s_block : first;
+	for (block = first; block <= last; block++) {
+		long long start = block * s->s_block;
+		long long from = sector > start ? sector : start;
+		long long to = end < start + s->s_block ? end : start + s->s_block;
+
+		if (!sample_block_kept(s, block))
+			continue;
+		if (length <= 0)
+			to = from + length;
+		if (prev == block - 1) { // consecutive ranks stay contiguous
+			pieces[count - 1].sp_length += to - from;
+		} else {
+			if (count >= max)
+				break;
+			pieces[count].sp_sector = s->s_rescale ? rank_of(&s->s_space, block) * s->s_block + (from - start) : from;
+			pieces[count].sp_length = to - from;
+			count++;
+		}
+		prev = block;
+	}
+	return count;
+}
@@ -0,0 +1,91 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+/* Hash based sampling of loads, as used by sample_load.exe and by
+ * blkreplay.exe --filter-sample.
+ *
+ * Spatial: the device is divided into blocks of s_block sectors, and
+ * a block is kept when its hash falls below s_space_rate. Kept blocks
+ * retain their full access sequence and timing. With seed 0, the hash
+ * selects the same blocks as cache_sim.exe --sample.
+ * With s_rescale, the kept blocks are renumbered densely in their
+ * original order, shrinking the sector range by about s_space_rate.
+ *
+ * Temporal: time is divided into windows of s_window seconds, which
+ * are selected by an independent hash. The kept windows are glued
+ * together, so the sampled load is shorter by about s_time_rate.
+ *
+ * All decisions are stateless, so repeated or merged inputs are
+ * sampled consistently.
+ */
+
+#define SAMPLE_BITS        24
+#define SAMPLE_CHUNK_BITS  10  // items per chunk of struct sample_rank
+#define SAMPLE_MAX_PIECES  64
+
+struct sample_piece {
+	long long sp_sector;
+	int       sp_length;
+};
+
+// order preserving renumbering of the kept blocks or windows
+struct sample_rank {
+	unsigned long long r_salt;
+	unsigned long long r_limit;
+	long long *r_prefix; // kept items before each chunk
+	long long  r_count;
+	long long  r_alloc;
+};
+
+struct sampler {
+	double    s_space_rate;  // 1.0 = keep all blocks
+	long long s_block;       // in sectors
+	int       s_rescale;
+	double    s_time_rate;   // 1.0 = keep all windows
+	double    s_window;      // in seconds
+	unsigned long long s_seed;
+	// internal state, set up by sampler_init()
+	long long s_window_ns;
+	struct sample_rank s_space;
+	struct sample_rank s_time;
+};
+
+extern void sampler_defaults(struct sampler *s);
+// parses "space=<rate>,block=<sectors>,rescale=<0|1>,time=<rate>,window=<sec>,seed=<n>", returns 0 on success
+extern int sampler_parse(struct sampler *s, const char *spec);
+// returns 0 on success
+extern int sampler_init(struct sampler *s);
+extern void sampler_free(struct sampler *s);
+
+extern int sample_block_kept(const struct sampler *s, long long block);
+
+/* Returns 0 when the timestamp is dropped. Otherwise *new_ns is the
+ * compressed time (unchanged when temporal sampling is off).
+ */
+extern int sample_time(struct sampler *s, long long stamp_ns, long long *new_ns);
+
+/* Splits a request into the runs of kept blocks. Returns the number
+ * of pieces (at most max), 0 when nothing is kept.
+ */
+extern int sample_space(struct sampler *s, long long sector, int length, struct sample_piece *pieces, int max);
+
+#endif
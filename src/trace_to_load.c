@@ -0,0 +1,662 @@
+/* Copyright 2009-2012 Thomas Schoebel-Theuer /  1&1 Internet AG
+ *
+ * Email: tst@1und1.de
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Streaming importer for third-party block traces.
+ *
+ * Each supported format has a line parser which normalizes
+ * timestamps, units and op codes into a common record. The records
+ * are put through a bounded reordering window and written in the
+ * .load format. Records which are out of order beyond the window are
+ * a fatal error; raise --window for such inputs.
+ *
+ * Timestamps are made relative to the earliest one, except for the
+ * diskmon format, where they are kept as in the input (like the old
+ * conv_windows_diskmon_to_load.sh did).
+ *
+ * Usage: trace_to_load.exe --format=<name> [--device=<id>] [--split]
+ *                          [--window=<records>] [--header=<file>]
+ *                          <input> [<output>]
+ *
+ * Input may be '-' for stdin. Inputs ending in .gz are decompressed,
+ * outputs ending in .gz are compressed on the fly.
+ * With --split, one output file per device is created.
+ * The copyright header given by --header is prepended to each output.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#define MAX_FIELDS 32
+#define MAX_DEVICES 1024
+#define MAX_ID 64
+#define BUF_SIZE (1024 * 1024)
+
+// normalized trace record
+struct record {
+	unsigned long long rec_time;     // nanoseconds
+	unsigned long long rec_duration; // nanoseconds, 0 when unknown
+	unsigned long long rec_sector;
+	unsigned int rec_sectors;
+	char rec_op;
+	int rec_dev;
+	long long rec_seqnr;
+};
+
+struct parser {
+	const char *p_name;
+	const char *p_descr;
+	const char *p_dev_prefix;
+	char p_sep; // 0 means whitespace
+	int p_absolute; // keep the timestamps of the input
+	// returns 1 for a valid record, 0 for lines to be ignored
+	int (*p_parse)(char **field, int count, struct record *rec, char *dev_id);
+};
+
+struct parser *parser = NULL;
+char *input = NULL;
+char *output = NULL;
+char *select_id = NULL;
+char *header_file = NULL;
+int split_mode = 0;
+int window = 100000;
+
+long long count_lines = 0;
+long long count_ignored = 0;
+long long count_records = 0;
+
+char *header = NULL;
+size_t header_len = 0;
+
+/////////////////////////////////////////////////////////////////
+
+// field conversion helpers
+
+/* Exact conversion of a decimal number to an integer multiple
+ * of 10^-scale, e.g. seconds to nanoseconds with scale=9.
+ * Avoids the rounding errors of floating point.
+ */
+static
+int parse_decimal(const char *str, int scale, unsigned long long *res)
+{
+	unsigned long long val = 0;
+	int digits = 0;
+	int frac = -1;
+
+	while (isspace(*str))
+		str++;
+	for (; *str; str++) {
+		if (*str == '.' && frac < 0) {
+			frac = 0;
+			continue;
+		}
+		if (!isdigit(*str))
+			break;
+		if (frac >= 0) {
+			if (frac >= scale)
+				continue;
+			frac++;
+		}
+		val = val * 10 + (*str - '0');
+		digits++;
+	}
+	if (!digits)
+		return 0;
+	for (frac = frac < 0 ? 0 : frac; frac < scale; frac++)
+		val *= 10;
+	*res = val;
+	return 1;
+}
+
+static
+int parse_op(const char *str, struct record *rec)
+{
+	while (isspace(*str))
+		str++;
+	switch (toupper(*str)) {
+	case 'R':
+		rec->rec_op = 'R';
+		return 1;
+	case 'W':
+		rec->rec_op = 'W';
+		return 1;
+	}
+	return 0;
+}
+
+static
+int parse_bytes(const char *offset, const char *size, struct record *rec)
+{
+	unsigned long long off;
+	unsigned long long len;
+
+	if (!parse_decimal(offset, 0, &off) || !parse_decimal(size, 0, &len))
+		return 0;
+	rec->rec_sector = off >> 9;
+	rec->rec_sectors = (len + 511) >> 9;
+	return 1;
+}
+
+static
+void copy_id(char *dev_id, const char *str)
+{
+	while (isspace(*str))
+		str++;
+	snprintf(dev_id, MAX_ID, "%s", str);
+	while (*dev_id && !isspace(*dev_id))
+		dev_id++;
+	*dev_id = '\0';
+}
+
+/////////////////////////////////////////////////////////////////
+
+// format parsers
+
+/* Windows DiskMon .LOG:
+ *   #  time  duration  disk  request  sector  length
+ * with times in seconds.
+ */
+static
+int parse_diskmon(char **field, int count, struct record *rec, char *dev_id)
+{
+	unsigned long long val;
+
+	if (count < 7)
+		return 0;
+	if (!parse_decimal(field[1], 9, &rec->rec_time) ||
+	    !parse_decimal(field[2], 9, &rec->rec_duration) ||
+	    !parse_op(field[4], rec) ||
+	    !parse_decimal(field[5], 0, &rec->rec_sector) ||
+	    !parse_decimal(field[6], 0, &val))
+		return 0;
+	rec->rec_sectors = val;
+	copy_id(dev_id, field[3]);
+	return 1;
+}
+
+/* MSR Cambridge:
+ *   Timestamp,Hostname,DiskNumber,Type,Offset,Size,ResponseTime
+ * with Windows filetime stamps and response times in 100ns units,
+ * offsets and sizes in bytes.
+ */
+static
+int parse_msr(char **field, int count, struct record *rec, char *dev_id)
+{
+	if (count < 7)
+		return 0;
+	if (!parse_decimal(field[0], 0, &rec->rec_time) ||
+	    !parse_decimal(field[6], 0, &rec->rec_duration) ||
+	    !parse_op(field[3], rec) ||
+	    !parse_bytes(field[4], field[5], rec))
+		return 0;
+	rec->rec_time *= 100;
+	rec->rec_duration *= 100;
+	snprintf(dev_id, MAX_ID, "%s.%s", field[1], field[2]);
+	return 1;
+}
+
+/* SNIA IOTTA (Systor '17 style):
+ *   Timestamp,Response,IOType,LUN,Offset,Size
+ * with times in seconds, offsets and sizes in bytes.
+ */
+static
+int parse_snia(char **field, int count, struct record *rec, char *dev_id)
+{
+	if (count < 6)
+		return 0;
+	if (!parse_decimal(field[0], 9, &rec->rec_time) ||
+	    !parse_decimal(field[1], 9, &rec->rec_duration) ||
+	    !parse_op(field[2], rec) ||
+	    !parse_bytes(field[4], field[5], rec))
+		return 0;
+	copy_id(dev_id, field[3]);
+	return 1;
+}
+
+/* Alibaba block traces:
+ *   device_id,opcode,offset,length,timestamp
+ * with timestamps in microseconds, offsets and lengths in bytes.
+ */
+static
+int parse_alibaba(char **field, int count, struct record *rec, char *dev_id)
+{
+	if (count < 5)
+		return 0;
+	if (!parse_op(field[1], rec) ||
+	    !parse_bytes(field[2], field[3], rec) ||
+	    !parse_decimal(field[4], 3, &rec->rec_time))
+		return 0;
+	rec->rec_duration = 0;
+	copy_id(dev_id, field[0]);
+	return 1;
+}
+
+struct parser parsers[] = {
+	{ "diskmon", "Windows DiskMon .LOG", "disk", 0, 1, parse_diskmon },
+	{ "msr", "MSR Cambridge CSV", "dev", ',', 0, parse_msr },
+	{ "snia", "SNIA IOTTA CSV (Systor '17 columns)", "dev", ',', 0, parse_snia },
+	{ "alibaba", "Alibaba block trace CSV", "dev", ',', 0, parse_alibaba },
+	{}
+};
+
+static
+int split_fields(char *line, char sep, char **field)
+{
+	int count = 0;
+
+	if (!sep) {
+		char *tmp;
+		for (tmp = strtok(line, " \t\r\n"); tmp && count < MAX_FIELDS; tmp = strtok(NULL, " \t\r\n"))
+			field[count++] = tmp;
+		return count;
+	}
+	line[strcspn(line, "\r\n")] = '\0';
+	while (count < MAX_FIELDS) {
+		char *next = strchr(line, sep);
+		field[count++] = line;
+		if (!next)
+			break;
+		*next = '\0';
+		line = next + 1;
+	}
+	return count;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// outputs
+
+struct device {
+	char dev_id[MAX_ID];
+	FILE *dev_out;
+	int dev_pipe;
+	long long dev_count;
+};
+
+struct device devices[MAX_DEVICES];
+int device_count = 0;
+int have_base = 0;
+unsigned long long base_time = 0;
+unsigned long long last_time = 0;
+
+static
+int is_gz(const char *name)
+{
+	int len = strlen(name);
+	return len > 3 && !strcmp(name + len - 3, ".gz");
+}
+
+static
+void read_header(void)
+{
+	FILE *f;
+	size_t alloc = 0;
+	size_t len;
+	char chunk[4096];
+
+	if (!header_file) {
+		header = "";
+		return;
+	}
+	f = fopen(header_file, "r");
+	if (!f) {
+		printf("FATAL ERROR: cannot open header file '%s'\n", header_file);
+		exit(-1);
+	}
+	while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+		if (header_len + len > alloc) {
+			alloc = (header_len + len) * 2;
+			header = realloc(header, alloc);
+			if (!header) {
+				printf("FATAL ERROR: out of memory\n");
+				exit(-1);
+			}
+		}
+		memcpy(header + header_len, chunk, len);
+		header_len += len;
+	}
+	fclose(f);
+}
+
+static
+void output_open(struct device *dev)
+{
+	char name[4096];
+	const char *file = output;
+
+	if (split_mode) {
+		char base[4096];
+		const char *tmp = strrchr(input, '/');
+		char *dot;
+
+		// strip .gz and .log / .csv like the diskmon script
+		snprintf(base, sizeof(base), "%s", tmp ? tmp + 1 : input);
+		if (is_gz(base))
+			base[strlen(base) - 3] = '\0';
+		dot = strrchr(base, '.');
+		if (dot && (!strcasecmp(dot, ".log") || !strcasecmp(dot, ".csv")))
+			*dot = '\0';
+		snprintf(name, sizeof(name), "%s.%s%s.load.gz", base, parser->p_dev_prefix, dev->dev_id);
+		file = name;
+	}
+
+	if (!strcmp(file, "-")) {
+		dev->dev_out = stdout;
+	} else if (is_gz(file)) {
+		char cmd[8192];
+		snprintf(cmd, sizeof(cmd), "gzip -9 > '%s'", file);
+		dev->dev_out = popen(cmd, "w");
+		dev->dev_pipe = 1;
+	} else {
+		dev->dev_out = fopen(file, "w");
+	}
+	if (!dev->dev_out) {
+		printf("FATAL ERROR: cannot create '%s' (errno=%d)\n", file, errno);
+		exit(-1);
+	}
+	setvbuf(dev->dev_out, NULL, _IOFBF, BUF_SIZE);
+	fprintf(stderr, "output: %s\n", file);
+
+	fwrite(header, 1, header_len, dev->dev_out);
+	fprintf(dev->dev_out, "INFO: format=%s\n", parser->p_name);
+	if (split_mode || select_id)
+		fprintf(dev->dev_out, "INFO: device=%s\n", dev->dev_id);
+	fprintf(dev->dev_out, "start ; sector; length ; op ;  replay_delay=0 ; replay_duration=0\n");
+}
+
+static
+int lookup_device(const char *dev_id)
+{
+	int i;
+
+	if (!split_mode)
+		return 0;
+	for (i = 0; i < device_count; i++) {
+		if (!strcmp(devices[i].dev_id, dev_id))
+			return i;
+	}
+	if (device_count >= MAX_DEVICES) {
+		printf("FATAL ERROR: too many devices (max %d)\n", MAX_DEVICES);
+		exit(-1);
+	}
+	snprintf(devices[device_count].dev_id, MAX_ID, "%s", dev_id);
+	return device_count++;
+}
+
+static
+void emit_record(struct record *rec)
+{
+	struct device *dev = &devices[rec->rec_dev];
+	unsigned long long rel;
+
+	if (!have_base) {
+		base_time = parser->p_absolute ? 0 : rec->rec_time;
+		last_time = rec->rec_time;
+		have_base = 1;
+	}
+	// beyond the reordering window: the output would be unsorted
+	if (rec->rec_time < last_time) {
+		printf("FATAL ERROR: input record %lld is out of order beyond the window of %d records, please raise --window\n",
+		       rec->rec_seqnr + 1, window);
+		exit(-1);
+	}
+	last_time = rec->rec_time;
+
+	if (!dev->dev_out)
+		output_open(dev);
+	rel = rec->rec_time - base_time;
+	fprintf(dev->dev_out, "%s%6llu.%09llu ; %12llu ; %4u ; %c ; 0.0 ; %llu.%09llu\n",
+		parser->p_absolute ? "" : " ",
+		rel / 1000000000, rel % 1000000000,
+		rec->rec_sector, rec->rec_sectors, rec->rec_op,
+		rec->rec_duration / 1000000000, rec->rec_duration % 1000000000);
+	dev->dev_count++;
+}
+
+static
+void outputs_close(void)
+{
+	int i;
+
+	for (i = 0; i < device_count; i++) {
+		struct device *dev = &devices[i];
+		int status;
+
+		if (!dev->dev_out)
+			continue;
+		if (dev->dev_out == stdout)
+			status = fflush(stdout);
+		else if (dev->dev_pipe)
+			status = pclose(dev->dev_out);
+		else
+			status = fclose(dev->dev_out);
+		if (status) {
+			printf("FATAL ERROR: cannot finish output for device '%s'\n", dev->dev_id);
+			exit(-1);
+		}
+		if (dev->dev_id[0])
+			fprintf(stderr, "INFO: %s%s: %lld requests\n", parser->p_dev_prefix, dev->dev_id, dev->dev_count);
+		else
+			fprintf(stderr, "INFO: %lld requests\n", dev->dev_count);
+	}
+}
+
+/////////////////////////////////////////////////////////////////
+
+// reordering window (binary min-heap ordered by time, then input order)
+
+struct record *heap = NULL;
+int heap_count = 0;
+
+static
+int heap_less(struct record *a, struct record *b)
+{
+	if (a->rec_time != b->rec_time)
+		return a->rec_time < b->rec_time;
+	return a->rec_seqnr < b->rec_seqnr;
+}
+
+static
+void heap_push(struct record *rec)
+{
+	int pos = heap_count++;
+
+	while (pos > 0) {
+		int parent = (pos - 1) / 2;
+		if (!heap_less(rec, &heap[parent]))
+			break;
+		heap[pos] = heap[parent];
+		pos = parent;
+	}
+	heap[pos] = *rec;
+}
+
+static
+void heap_pop(struct record *rec)
+{
+	struct record last;
+	int pos = 0;
+
+	*rec = heap[0];
+	last = heap[--heap_count];
+	for (;;) {
+		int child = pos * 2 + 1;
+		if (child >= heap_count)
+			break;
+		if (child + 1 < heap_count && heap_less(&heap[child + 1], &heap[child]))
+			child++;
+		if (!heap_less(&heap[child], &last))
+			break;
+		heap[pos] = heap[child];
+		pos = child;
+	}
+	heap[pos] = last;
+}
+
+/////////////////////////////////////////////////////////////////
+
+// main
+
+static
+void usage(const char *name)
+{
+	struct parser *p;
+
+	printf("usage: %s --format=<name> [--device=<id>] [--split] [--window=<records>] [--header=<file>] <input> [<output>]\n", name);
+	printf("formats:\n");
+	for (p = parsers; p->p_name; p++)
+		printf("  %-10s %s%s\n", p->p_name, p->p_descr,
+		       p->p_absolute ? " (absolute timestamps)" : "");
+	printf("Timestamps are relative to the earliest record unless marked absolute.\n"
+	       "Records out of order beyond --window (default 100000) are a fatal error.\n");
+	exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+	char line[4096];
+	char name[4096];
+	FILE *inp;
+	int inp_pipe = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strncmp(argv[i], "--format=", 9)) {
+			for (parser = parsers; parser->p_name; parser++) {
+				if (!strcmp(parser->p_name, argv[i] + 9))
+					break;
+			}
+			if (!parser->p_name) {
+				printf("ERROR: unknown format '%s'\n", argv[i] + 9);
+				usage(argv[0]);
+			}
+		} else if (!strncmp(argv[i], "--device=", 9)) {
+			select_id = argv[i] + 9;
+		} else if (!strcmp(argv[i], "--split")) {
+			split_mode = 1;
+		} else if (!strncmp(argv[i], "--window=", 9)) {
+			window = atoi(argv[i] + 9);
+		} else if (!strncmp(argv[i], "--header=", 9)) {
+			header_file = argv[i] + 9;
+		} else if (argv[i][0] == '-' && argv[i][1]) {
+			printf("ERROR: unknown option '%s'\n", argv[i]);
+			usage(argv[0]);
+		} else if (!input) {
+			input = argv[i];
+		} else if (!output) {
+			output = argv[i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (!parser || !input)
+		usage(argv[0]);
+	if (split_mode && output) {
+		printf("ERROR: --split derives the output names from the input name\n");
+		exit(-1);
+	}
+	if (window < 1)
+		window = 1;
+	if (!output && !split_mode) {
+		const char *tmp = strrchr(input, '/');
+		char *dot;
+		snprintf(name, sizeof(name), "%s", tmp ? tmp + 1 : input);
+		if (is_gz(name))
+			name[strlen(name) - 3] = '\0';
+		dot = strrchr(name, '.');
+		if (dot && (!strcasecmp(dot, ".log") || !strcasecmp(dot, ".csv")))
+			*dot = '\0';
+		strncat(name, ".load.gz", sizeof(name) - strlen(name) - 1);
+		output = name;
+	}
+	if (!split_mode)
+		snprintf(devices[device_count++].dev_id, MAX_ID, "%s", select_id ? select_id : "");
+
+	read_header();
+
+	heap = malloc(sizeof(struct record) * (window + 1));
+	if (!heap) {
+		printf("FATAL ERROR: out of memory\n");
+		exit(-1);
+	}
+
+	if (!strcmp(input, "-")) {
+		inp = stdin;
+	} else if (is_gz(input)) {
+		char cmd[8192];
+		snprintf(cmd, sizeof(cmd), "gzip -cd '%s'", input);
+		inp = popen(cmd, "r");
+		inp_pipe = 1;
+	} else {
+		inp = fopen(input, "r");
+	}
+	if (!inp) {
+		printf("FATAL ERROR: cannot open '%s' (errno=%d)\n", input, errno);
+		exit(-1);
+	}
+	setvbuf(inp, NULL, _IOFBF, BUF_SIZE);
+	fprintf(stderr, "input:  %s (%s)\n", input, parser->p_descr);
+
+	while (fgets(line, sizeof(line), inp)) {
+		char *field[MAX_FIELDS];
+		char dev_id[MAX_ID] = "";
+		struct record rec = {};
+		int count;
+
+		count_lines++;
+		if (line[0] == '#' && parser->p_sep) {
+			count_ignored++;
+			continue;
+		}
+		count = split_fields(line, parser->p_sep, field);
+		if (!parser->p_parse(field, count, &rec, dev_id)) {
+			count_ignored++;
+			continue;
+		}
+		if (select_id && strcmp(dev_id, select_id))
+			continue;
+		rec.rec_dev = lookup_device(dev_id);
+		rec.rec_seqnr = count_records++;
+
+		heap_push(&rec);
+		if (heap_count >= window) {
+			heap_pop(&rec);
+			emit_record(&rec);
+		}
+	}
+	while (heap_count > 0) {
+		struct record rec;
+		heap_pop(&rec);
+		emit_record(&rec);
+	}
+
+	if (inp_pipe)
+		pclose(inp);
+	else if (inp != stdin)
+		fclose(inp);
+	outputs_close();
+
+	fprintf(stderr, "INFO: %lld lines, %lld records, %lld ignored\n", count_lines, count_records, count_ignored);
+	return 0;
+}